@@ -46,6 +46,12 @@
 #ifdef FLASH_ENV_USING_WEAR_LEVELING_MODE
 /* ENV section total bytes size in wear leveling mode. */
 #define FLASH_ENV_SECTION_SIZE          (4 * FLASH_ERASE_MIN_SIZE)/* 8K */
+#elif defined(FLASH_ENV_USING_SLOTTED_MODE)
+/* ENV section total bytes size in slotted mode. It's integral multiple of FLASH_ERASE_MIN_SIZE */
+#define FLASH_ENV_SECTION_SIZE          (2 * FLASH_ERASE_MIN_SIZE)/* 4K */
+#elif defined(FLASH_ENV_USING_SHARDED_MODE)
+/* ENV section total bytes size in sharded mode. Every shard is integral multiple of FLASH_ERASE_MIN_SIZE */
+#define FLASH_ENV_SECTION_SIZE          (FLASH_ENV_SHARD_NUM * FLASH_ERASE_MIN_SIZE)
 #else
 /* ENV section total bytes size in normal mode. It's equal with FLASH_USER_SETTING_ENV_SIZE */
 #define FLASH_ENV_SECTION_SIZE          (FLASH_USER_SETTING_ENV_SIZE)
@@ -202,6 +208,12 @@ void flash_env_unlock(void) {
     __enable_irq();
 }
 
+#ifdef FLASH_ENV_USING_ASYNC_SAVE
+/* The ENV lock masks all interrupts here, and the save worker holds it during the flash erase and
+ * write, so the asynchronous save would block the interrupts for a whole erase. */
+#error "The asynchronous ENV save needs an OS thread and a mutex lock, it's not supported without OS."
+#endif
+
 
 /**
  * This function is print flash debug info.
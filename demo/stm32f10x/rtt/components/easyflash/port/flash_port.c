@@ -45,6 +45,12 @@
 #ifdef FLASH_ENV_USING_WEAR_LEVELING_MODE
 /* ENV section total bytes size in wear leveling mode. */
 #define FLASH_ENV_SECTION_SIZE          (4 * FLASH_ERASE_MIN_SIZE)/* 8K */
+#elif defined(FLASH_ENV_USING_SLOTTED_MODE)
+/* ENV section total bytes size in slotted mode. It's integral multiple of FLASH_ERASE_MIN_SIZE */
+#define FLASH_ENV_SECTION_SIZE          (2 * FLASH_ERASE_MIN_SIZE)/* 4K */
+#elif defined(FLASH_ENV_USING_SHARDED_MODE)
+/* ENV section total bytes size in sharded mode. Every shard is integral multiple of FLASH_ERASE_MIN_SIZE */
+#define FLASH_ENV_SECTION_SIZE          (FLASH_ENV_SHARD_NUM * FLASH_ERASE_MIN_SIZE)
 #else
 /* ENV section total bytes size in normal mode. It's equal with FLASH_USER_SETTING_ENV_SIZE */
 #define FLASH_ENV_SECTION_SIZE          (FLASH_USER_SETTING_ENV_SIZE)
@@ -62,7 +68,15 @@ static const flash_env default_env_set[] = {
 };
 
 static char log_buf[RT_CONSOLEBUF_SIZE];
-static struct rt_semaphore env_cache_lock;
+/* the ENV cache lock, it's a mutex, so the waiting high priority thread raises the saving thread priority */
+static struct rt_mutex env_cache_lock;
+#ifdef FLASH_ENV_USING_ASYNC_SAVE
+/* the ENV save worker wakeup semaphore */
+static struct rt_semaphore env_async_notice;
+/* the ENV save worker thread, it's priority is lower than all application threads */
+static struct rt_thread env_async_worker;
+static rt_uint8_t env_async_worker_stack[512];
+#endif
 
 /**
  * Flash port for hardware initialize.
@@ -89,7 +103,7 @@ FlashErrCode flash_port_init(uint32_t *env_addr, size_t *env_total_size, size_t
     *default_env = default_env_set;
     *default_env_size = sizeof(default_env_set)/sizeof(default_env_set[0]);
     
-    rt_sem_init(&env_cache_lock, "env lock", 1, RT_IPC_FLAG_PRIO);
+    rt_mutex_init(&env_cache_lock, "env lock", RT_IPC_FLAG_PRIO);
 
     return result;
 }
@@ -195,16 +209,53 @@ FlashErrCode flash_write(uint32_t addr, const uint32_t *buf, size_t size) {
  * lock the ENV ram cache
  */
 void flash_env_lock(void) {
-    rt_sem_take(&env_cache_lock, RT_WAITING_FOREVER);
+    rt_mutex_take(&env_cache_lock, RT_WAITING_FOREVER);
 }
 
 /**
  * unlock the ENV ram cache
  */
 void flash_env_unlock(void) {
-    rt_sem_release(&env_cache_lock);
+    rt_mutex_release(&env_cache_lock);
+}
+
+#ifdef FLASH_ENV_USING_ASYNC_SAVE
+/**
+ * The ENV save worker thread entry.
+ *
+ * @param parameter parameter
+ */
+static void env_async_worker_entry(void *parameter) {
+    while (true) {
+        rt_sem_take(&env_async_notice, RT_WAITING_FOREVER);
+        flash_env_async_worker();
+    }
+}
+
+/**
+ * Create the low priority ENV save worker.
+ *
+ * @return result
+ */
+FlashErrCode flash_env_async_port_init(void) {
+    FlashErrCode result = FLASH_NO_ERR;
+
+    rt_sem_init(&env_async_notice, "env save", 0, RT_IPC_FLAG_FIFO);
+    rt_thread_init(&env_async_worker, "env save", env_async_worker_entry, RT_NULL,
+            env_async_worker_stack, sizeof(env_async_worker_stack), RT_THREAD_PRIORITY_MAX - 2, 10);
+    rt_thread_startup(&env_async_worker);
+
+    return result;
 }
 
+/**
+ * Notify the ENV save worker that has a new save request.
+ */
+void flash_env_async_port_notify(void) {
+    rt_sem_release(&env_async_notice);
+}
+#endif
+
 /**
  * This function is print flash debug info.
  *
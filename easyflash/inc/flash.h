@@ -44,11 +44,206 @@ extern "C" {
 #define FLASH_USING_IAP
 /* using save log function */
 #define FLASH_USING_LOG
+/* using log record, every log is framed by head and commit word, so the torn log can be skipped.
+ * The raw log (flash_log_write) can't be mixed with record. */
+/* #define FLASH_LOG_USING_RECORD */
+/* using log sector head, the log start and end address will be found by reading the sector heads.
+ * It's incompatible with the log which is saved without sector head. */
+/* #define FLASH_LOG_USING_SECTOR_HEAD */
+/* using background pre-erase, the sectors after the using sector are erased by flash_log_pre_erase
+ * in background, so the log write doesn't erase inline. It needs log sector head, and the log
+ * functions are locked by port. */
+/* #define FLASH_LOG_USING_PRE_ERASE */
+#ifdef FLASH_LOG_USING_PRE_ERASE
+/* the pre-erased sector number, the log sector number must be more than it + 2 */
+#define FLASH_LOG_PRE_ERASE_SEC_NUM     1
+#endif
+/* using log record iterator, the records can be traversed forward and backward, and sought by
+ * sequence number with a sparse RAM index. It needs log record. */
+/* #define FLASH_LOG_USING_ITERATOR */
+#ifdef FLASH_LOG_USING_ITERATOR
+/* the sparse index entry number, every entry is the first record sequence number of a sector.
+ * Only one sector of every (sector number / entry number) sectors is indexed when there are more. */
+#define FLASH_LOG_ITER_INDEX_SIZE       32
+#endif
+/* using log time index, every record has a timestamp which is got from port, and every sector head
+ * has the minimum and maximum record timestamp, so the records in a time range can be found by
+ * binary search. It needs log record and log sector head. */
+/* #define FLASH_LOG_USING_TIME_INDEX */
+#ifdef FLASH_LOG_USING_TIME_INDEX
+/* the RAM summary entry number, every entry is the minimum record timestamp of a sector. Only one
+ * sector of every (sector number / entry number) sectors is summarized when there are more. */
+#define FLASH_LOG_TIME_INDEX_SIZE       32
+#endif
+/* using log channels, every channel has its own log sectors, log state and minimum level, so the
+ * verbose channel can't overwrite the critical channel. The channels are configured in port, and
+ * the log functions are locked by port. */
+/* #define FLASH_LOG_USING_CHANNEL */
+#ifdef FLASH_LOG_USING_CHANNEL
+/* the maximum channel number */
+#define FLASH_LOG_CHANNEL_MAX           4
+#endif
+/* using log staging buffer, the log can be appended by any length. The staged log is saved when
+ * the staged size reaches the threshold or flash_log_flush has been called. */
+/* #define FLASH_LOG_USING_STAGING */
+#ifdef FLASH_LOG_USING_STAGING
+/* the staging buffer size, must be word alignment */
+#define FLASH_LOG_STAGING_SIZE          256
+/* the staged size which triggers saving, it can't be more than the staging buffer size */
+#define FLASH_LOG_STAGING_THRESHOLD     FLASH_LOG_STAGING_SIZE
+#endif
+/* using asynchronous log, the log is written to a lock-free RAM ring by multiple producers (ISR is
+ * supported), then saved to flash by the drain worker which is created by port */
+/* #define FLASH_LOG_USING_ASYNC */
+#ifdef FLASH_LOG_USING_ASYNC
+/* the RAM ring size, must be power of 2 */
+#define FLASH_LOG_ASYNC_RING_SIZE       1024
+/* the drain batch buffer size, it's the maximum size of one log, must be word alignment */
+#define FLASH_LOG_ASYNC_BATCH_SIZE      256
+#endif
+/* using crash dump, the registers, stack and last logs can be written to a pre-erased reserve area
+ * without erase and lock in fault handler. The dump is found on next boot. The reserve area is after
+ * the ENV factory snapshot area. */
+/* #define FLASH_LOG_USING_CRASHDUMP */
+#ifdef FLASH_LOG_USING_CRASHDUMP
+/* the crash dump area sector number, the sector size is erase minimum size */
+#define FLASH_LOG_CRASHDUMP_SEC_NUM     1
+#endif
 /* the user setting size of ENV, must be word alignment */
 #define FLASH_USER_SETTING_ENV_SIZE     (2 * 1024)                /* default 2K */
 /* using wear leveling mode or normal mode */
 /* #define FLASH_ENV_USING_WEAR_LEVELING_MODE */
 #define FLASH_ENV_USING_NORMAL_MODE
+/* using slotted mode, the ENV is saved to next slot of the erase sector, so the sector is only
+ * erased when all slots in it have been used. The ENV section must have 2 erase sectors at least.
+ * Only for normal mode. */
+/* #define FLASH_ENV_USING_SLOTTED_MODE */
+/* using sharded mode, the ENV is distributed into some shards by the hash of its name, every shard
+ * has its own erase sectors, so only the changed shards are saved. Only for normal mode. */
+/* #define FLASH_ENV_USING_SHARDED_MODE */
+#ifdef FLASH_ENV_USING_SHARDED_MODE
+/* the shard number, every shard is integral multiple of erase minimum size */
+#define FLASH_ENV_SHARD_NUM             4
+#endif
+/* using key class, the ENV can be volatile (only in RAM), write-back (saved by flash_save_env)
+ * or write-through (saved when it has been set). Only for normal mode. */
+/* #define FLASH_ENV_USING_KEY_CLASS */
+#ifdef FLASH_ENV_USING_KEY_CLASS
+/* the volatile ENV RAM cache size, must be word alignment */
+#define FLASH_ENV_VOLATILE_SIZE         256
+#endif
+/* using emergency flush, the changed ENV can be written to a pre-erased reserve area without
+ * erase when power failed. The reserve area is after the schema ENV area. Only for normal mode. */
+/* #define FLASH_ENV_USING_EMERGENCY_FLUSH */
+/* using factory snapshot, the provisioned ENV is saved to a protected area once, the factory reset
+ * only writes a mark word to switch to it. The area is after the emergency reserve area. Only for
+ * normal mode. */
+/* #define FLASH_ENV_USING_FACTORY_SNAPSHOT */
+/* using boot reader, the bootloader can read an ENV from flash directly without flash_init.
+ * Only for normal mode. */
+/* #define FLASH_ENV_USING_BOOT_READER */
+/* using change feed, the changed ENV name since a version can be got from a RAM journal for
+ * delta sync. Only for normal mode. */
+/* #define FLASH_ENV_USING_CHANGE_FEED */
+#ifdef FLASH_ENV_USING_CHANGE_FEED
+/* the change journal entry number, all ENV will be synchronized when it has been overflowed */
+#define FLASH_ENV_FEED_JOURNAL_SIZE     16
+/* the ENV name buffer size of every journal entry, contain '\0' */
+#define FLASH_ENV_FEED_KEY_SIZE         32
+#endif
+/* using asynchronous ENV save function, the save worker is created by port */
+/* #define FLASH_ENV_USING_ASYNC_SAVE */
+#ifdef FLASH_ENV_USING_ASYNC_SAVE
+/* the maximum number of waiting asynchronous save requests which has callback */
+#define FLASH_ENV_ASYNC_QUEUE_SIZE      8
+#endif
+/* using default overlay mode, only the ENV which is different from default is cached and saved.
+ * The FLASH_USER_SETTING_ENV_SIZE can be reduced for it. Only for normal mode. */
+/* #define FLASH_ENV_USING_DEFAULT_OVERLAY */
+/* using the default ENV image which is generated by tools/env_image, only for normal mode */
+/* #define FLASH_ENV_USING_DEFAULT_IMAGE */
+/* using schema ENV, the fixed slot typed ENV is declared at compile time */
+/* #define FLASH_ENV_USING_SCHEMA */
+#ifdef FLASH_ENV_USING_SCHEMA
+/* the schema version, it must be increased when the schema has changed */
+#define FLASH_ENV_SCHEMA_VER            1
+/* the schema area sector number, the sector size is erase minimum size, must be more than 2 */
+#define FLASH_ENV_SCHEMA_SEC_NUM        2
+/**
+ * the schema declaration, the new ENV should be added at the end
+ * NUM(name, integer type, signed (true) or unsigned (false), default value)
+ * STR(name, size contain '\0', default value)
+ */
+#define FLASH_ENV_SCHEMA(NUM, STR)                                            \
+    NUM(boot_times, uint32_t, false, 0)                                       \
+    STR(device_name, 16, "easyflash")
+#endif
+/* using erase-free counter and one-shot flag function */
+/* #define FLASH_USING_COUNTER */
+#ifdef FLASH_USING_COUNTER
+/* the counter number */
+#define FLASH_COUNTER_NUM               4
+/* the one-shot flag number */
+#define FLASH_FLAG_NUM                  8
+/* the counter area sector number, the sector size is erase minimum size, must be more than 2 */
+#define FLASH_COUNTER_SEC_NUM           2
+/* The flash supports write a written word again to clear its bits (1->0) without erase. It's
+ * recommended when the flash supports it. One sector is erased after every
+ * (sector size / 4 - 2 - FLASH_COUNTER_NUM - FLASH_FLAG_NUM) / FLASH_COUNTER_NUM * 32 increases of
+ * a counter, it's 3968 by default setting and 2K sector. Otherwise every increase writes one word,
+ * one sector is erased after every (sector size / 4 - 2 - FLASH_COUNTER_NUM - FLASH_FLAG_NUM)
+ * increases of all counters, it's 498. */
+/* #define FLASH_COUNTER_USING_BIT_CLEAR */
+#endif
+
+#if defined(FLASH_LOG_USING_PRE_ERASE) && !defined(FLASH_LOG_USING_SECTOR_HEAD)
+#error "The log background pre-erase needs log sector head."
+#endif
+#if defined(FLASH_LOG_USING_ITERATOR) && !defined(FLASH_LOG_USING_RECORD)
+#error "The log iterator needs log record."
+#endif
+#if defined(FLASH_LOG_USING_TIME_INDEX) && (!defined(FLASH_LOG_USING_RECORD) || !defined(FLASH_LOG_USING_SECTOR_HEAD))
+#error "The log time index needs log record and log sector head."
+#endif
+#if defined(FLASH_LOG_USING_STAGING) && (FLASH_LOG_STAGING_THRESHOLD > FLASH_LOG_STAGING_SIZE)
+#error "The log staging threshold can't be more than the staging buffer size."
+#endif
+#if defined(FLASH_LOG_USING_ASYNC) && (FLASH_LOG_ASYNC_RING_SIZE & (FLASH_LOG_ASYNC_RING_SIZE - 1))
+#error "The asynchronous log RAM ring size must be power of 2."
+#endif
+#if defined(FLASH_ENV_USING_SLOTTED_MODE) && !defined(FLASH_ENV_USING_NORMAL_MODE)
+#error "The slotted mode only supports normal mode."
+#endif
+#if defined(FLASH_ENV_USING_SHARDED_MODE) && !defined(FLASH_ENV_USING_NORMAL_MODE)
+#error "The sharded mode only supports normal mode."
+#endif
+#if defined(FLASH_ENV_USING_SHARDED_MODE) && defined(FLASH_ENV_USING_SLOTTED_MODE)
+#error "The sharded mode and slotted mode can't be used at the same time."
+#endif
+#if defined(FLASH_ENV_USING_KEY_CLASS) && !defined(FLASH_ENV_USING_NORMAL_MODE)
+#error "The key class only supports normal mode."
+#endif
+#if defined(FLASH_ENV_USING_EMERGENCY_FLUSH) && !defined(FLASH_ENV_USING_NORMAL_MODE)
+#error "The emergency flush only supports normal mode."
+#endif
+#if defined(FLASH_ENV_USING_FACTORY_SNAPSHOT) && !defined(FLASH_ENV_USING_NORMAL_MODE)
+#error "The factory snapshot only supports normal mode."
+#endif
+#if defined(FLASH_ENV_USING_BOOT_READER) && !defined(FLASH_ENV_USING_NORMAL_MODE)
+#error "The boot reader only supports normal mode."
+#endif
+#if defined(FLASH_ENV_USING_CHANGE_FEED) && !defined(FLASH_ENV_USING_NORMAL_MODE)
+#error "The change feed only supports normal mode."
+#endif
+#if defined(FLASH_ENV_USING_DEFAULT_IMAGE) && !defined(FLASH_ENV_USING_NORMAL_MODE)
+#error "The default ENV image only supports normal mode."
+#endif
+#if defined(FLASH_ENV_USING_DEFAULT_OVERLAY) && !defined(FLASH_ENV_USING_NORMAL_MODE)
+#error "The default overlay mode only supports normal mode."
+#endif
+#if defined(FLASH_ENV_USING_DEFAULT_OVERLAY) && defined(FLASH_ENV_USING_DEFAULT_IMAGE)
+#error "The default ENV image isn't necessary in default overlay mode."
+#endif
 
 /* Flash debug print function. Must be implement by user. */
 #define FLASH_DEBUG(...) flash_log_debug(__FILE__, __LINE__, __VA_ARGS__)
@@ -64,9 +259,22 @@ if (!(EXPR))                                                                  \
 /* EasyFlash software version number */
 #define FLASH_SW_VERSION                "1.07.02"
 
+/* the ENV key class */
+typedef enum {
+    /* saved by flash_save_env, it's the default class */
+    FLASH_ENV_WRITE_BACK,
+    /* saved when it has been set */
+    FLASH_ENV_WRITE_THROUGH,
+    /* only in RAM, it will never be saved */
+    FLASH_ENV_VOLATILE,
+} FlashEnvClass;
+
 typedef struct _flash_env{
     char *key;
     char *value;
+#ifdef FLASH_ENV_USING_KEY_CLASS
+    FlashEnvClass env_class;
+#endif
 }flash_env, *flash_env_t;
 
 /* Flash error code */
@@ -77,6 +285,11 @@ typedef enum {
     FLASH_ENV_NAME_ERR,
     FLASH_ENV_NAME_EXIST,
     FLASH_ENV_FULL,
+    FLASH_ENV_QUEUE_FULL,
+    FLASH_ENV_VALUE_CHANGED,
+    FLASH_ENV_BROKEN,
+    FLASH_LOG_NO_RECORD,
+    FLASH_LOG_RING_FULL,
 } FlashErrCode;
 
 /* the flash sector current status */
@@ -99,6 +312,57 @@ FlashErrCode flash_save_env(void);
 FlashErrCode flash_env_set_default(void);
 size_t flash_get_env_total_size(void);
 size_t flash_get_env_write_bytes(void);
+/* return the new value, NULL or the current value pointer means no change, "" means delete */
+typedef const char *(*flash_env_update_cb)(const char *key, const char *value, void *arg);
+FlashErrCode flash_env_cas(const char *key, const char *expected, const char *value);
+FlashErrCode flash_env_update(const char *key, flash_env_update_cb cb, void *arg);
+#ifdef FLASH_ENV_USING_NORMAL_MODE
+size_t flash_get_env_recovered_keys(const char **keys, size_t size);
+#endif
+#ifdef FLASH_ENV_USING_EMERGENCY_FLUSH
+FlashErrCode flash_env_emergency_flush(void);
+#endif
+#ifdef FLASH_ENV_USING_FACTORY_SNAPSHOT
+FlashErrCode flash_env_save_factory(void);
+FlashErrCode flash_env_reset_factory(void);
+#endif
+#ifdef FLASH_ENV_USING_BOOT_READER
+FlashErrCode flash_env_boot_get(const char *key, char *value, size_t size, bool verify);
+#endif
+#ifdef FLASH_ENV_USING_CHANGE_FEED
+uint32_t flash_get_env_version(void);
+size_t flash_get_env_changes(uint32_t version, const char **keys, size_t size, bool *full);
+#endif
+#ifdef FLASH_ENV_USING_KEY_CLASS
+FlashErrCode flash_set_env_with_class(const char *key, const char *value, FlashEnvClass env_class);
+#endif
+#ifdef FLASH_ENV_USING_DEFAULT_IMAGE
+/* the generated default ENV image file */
+extern const uint32_t flash_default_env_image[];
+extern const size_t flash_default_env_image_size;
+#endif
+#ifdef FLASH_ENV_USING_SCHEMA
+/* flash_env_schema.c */
+#define FLASH_SCHEMA_NUM_FIELD(name, type, sign, def) type name;
+#define FLASH_SCHEMA_STR_FIELD(name, size, def)      char name[size];
+typedef struct _flash_schema {
+    FLASH_ENV_SCHEMA(FLASH_SCHEMA_NUM_FIELD, FLASH_SCHEMA_STR_FIELD)
+} flash_schema, *flash_schema_t;
+#define FLASH_SCHEMA_NUM_API(name, type, sign, def)                           \
+    type flash_schema_get_##name(void);                                       \
+    FlashErrCode flash_schema_set_##name(type value);
+#define FLASH_SCHEMA_STR_API(name, size, def)                                 \
+    const char *flash_schema_get_##name(void);                                \
+    FlashErrCode flash_schema_set_##name(const char *value);
+FLASH_ENV_SCHEMA(FLASH_SCHEMA_NUM_API, FLASH_SCHEMA_STR_API)
+FlashErrCode flash_schema_save(void);
+#endif
+#ifdef FLASH_ENV_USING_ASYNC_SAVE
+/* flash_env_async.c */
+typedef void (*flash_env_save_cb)(FlashErrCode result, void *arg);
+FlashErrCode flash_save_env_async(flash_env_save_cb cb, void *arg);
+void flash_env_async_worker(void);
+#endif
 #endif
 
 #ifdef FLASH_USING_IAP
@@ -118,6 +382,85 @@ FlashErrCode flash_log_read(size_t index, uint32_t *log, size_t size);
 FlashErrCode flash_log_write(const uint32_t *log, size_t size);
 FlashErrCode flash_log_clean(void);
 size_t flash_log_get_used_size(void);
+#ifdef FLASH_LOG_USING_PRE_ERASE
+FlashErrCode flash_log_pre_erase(void);
+#endif
+#ifdef FLASH_LOG_USING_RECORD
+FlashErrCode flash_log_append_record(const void *data, size_t len);
+FlashErrCode flash_log_read_record(size_t *index, void *buf, size_t size, size_t *len);
+#endif
+#ifdef FLASH_LOG_USING_ITERATOR
+typedef struct _flash_log_iter {
+    /* the current record flash address, sequence number and data length */
+    uint32_t addr;
+    uint32_t seq;
+    size_t len;
+} flash_log_iter, *flash_log_iter_t;
+FlashErrCode flash_log_iter_first(flash_log_iter *iter);
+FlashErrCode flash_log_iter_last(flash_log_iter *iter);
+FlashErrCode flash_log_iter_next(flash_log_iter *iter);
+FlashErrCode flash_log_iter_prev(flash_log_iter *iter);
+FlashErrCode flash_log_iter_seek(flash_log_iter *iter, uint32_t seq);
+FlashErrCode flash_log_iter_read(const flash_log_iter *iter, void *buf, size_t size);
+#endif
+#ifdef FLASH_LOG_USING_TIME_INDEX
+typedef bool (*flash_log_query_cb)(uint32_t time, const void *data, size_t len, void *arg);
+FlashErrCode flash_log_query_range(uint32_t start_time, uint32_t end_time, void *buf, size_t size,
+        flash_log_query_cb cb, void *arg);
+#endif
+#ifdef FLASH_LOG_USING_STAGING
+FlashErrCode flash_log_append(const void *log, size_t size);
+FlashErrCode flash_log_flush(void);
+#endif
+#ifdef FLASH_LOG_USING_CHANNEL
+typedef struct _flash_log_channel {
+    /* the channel name */
+    const char *name;
+    /* the channel sector number, the sector size is erase minimum size, must be more than 2 */
+    size_t sec_num;
+    /* the minimum level, the log whose level is less than it will be dropped */
+    uint8_t level;
+} flash_log_channel, *flash_log_channel_t;
+size_t flash_log_channel_find(const char *name);
+void flash_log_channel_select(size_t channel);
+void flash_log_channel_set_level(size_t channel, uint8_t level);
+bool flash_log_channel_enabled(size_t channel, uint8_t level);
+FlashErrCode flash_log_channel_write(size_t channel, uint8_t level, const void *log, size_t size);
+#endif
+#ifdef FLASH_LOG_USING_ASYNC
+/* flash_log_async.c */
+typedef struct _flash_log_async_stats {
+    /* the dropped log number because the RAM ring is full */
+    uint32_t drops;
+    /* the maximum and current used bytes size of RAM ring */
+    uint32_t high_water;
+    uint32_t used_size;
+    /* the flush number, the flush latency (port tick) of last flush and the maximum */
+    uint32_t flush_count;
+    uint32_t flush_latency_last;
+    uint32_t flush_latency_max;
+    /* the failed flush number */
+    uint32_t flush_errors;
+} flash_log_async_stats;
+FlashErrCode flash_log_async_write(const void *log, size_t size);
+void flash_log_async_worker(void);
+void flash_log_async_get_stats(flash_log_async_stats *stats);
+#endif
+#ifdef FLASH_LOG_USING_CRASHDUMP
+/* flash_log_crashdump.c */
+FlashErrCode flash_log_crashdump_write(uint8_t type, const void *data, size_t size);
+size_t flash_log_crashdump_get_size(void);
+FlashErrCode flash_log_crashdump_read(size_t *index, uint8_t *type, void *buf, size_t size, size_t *len);
+FlashErrCode flash_log_crashdump_clean(void);
+#endif
+#endif
+
+#ifdef FLASH_USING_COUNTER
+/* flash_counter.c */
+FlashErrCode flash_counter_inc(size_t id);
+uint32_t flash_counter_get(size_t id);
+FlashErrCode flash_flag_set(size_t id);
+bool flash_flag_test(size_t id);
 #endif
 
 /* flash_utils.c */
@@ -131,6 +474,26 @@ FlashErrCode flash_erase(uint32_t addr, size_t size);
 FlashErrCode flash_write(uint32_t addr, const uint32_t *buf, size_t size);
 void flash_env_lock(void);
 void flash_env_unlock(void);
+#ifdef FLASH_ENV_USING_ASYNC_SAVE
+FlashErrCode flash_env_async_port_init(void);
+void flash_env_async_port_notify(void);
+#endif
+#if defined(FLASH_USING_LOG) && defined(FLASH_LOG_USING_ASYNC)
+FlashErrCode flash_log_async_port_init(void);
+void flash_log_async_port_notify(void);
+bool flash_log_async_port_cas(volatile uint32_t *addr, uint32_t expected, uint32_t desired);
+uint32_t flash_log_async_port_get_tick(void);
+#endif
+#if defined(FLASH_USING_LOG) && defined(FLASH_LOG_USING_TIME_INDEX)
+uint32_t flash_log_port_get_time(void);
+#endif
+#if defined(FLASH_USING_LOG) && defined(FLASH_LOG_USING_CHANNEL)
+void flash_log_port_get_channels(flash_log_channel const **channels, size_t *channel_num);
+#endif
+#if defined(FLASH_USING_LOG) && (defined(FLASH_LOG_USING_CHANNEL) || defined(FLASH_LOG_USING_PRE_ERASE))
+void flash_log_lock(void);
+void flash_log_unlock(void);
+#endif
 void flash_log_debug(const char *file, const long line, const char *format, ...);
 void flash_log_info(const char *format, ...);
 void flash_print(const char *format, ...);
@@ -35,6 +35,12 @@
 #ifdef FLASH_ENV_USING_WEAR_LEVELING_MODE
 /* ENV section total bytes size in wear leveling mode. */
 #define FLASH_ENV_SECTION_SIZE             /* @note you must define it for a value */
+#elif defined(FLASH_ENV_USING_SLOTTED_MODE)
+/* ENV section total bytes size in slotted mode. It's integral multiple of FLASH_ERASE_MIN_SIZE */
+#define FLASH_ENV_SECTION_SIZE             /* @note you must define it for a value */
+#elif defined(FLASH_ENV_USING_SHARDED_MODE)
+/* ENV section total bytes size in sharded mode. Every shard is integral multiple of FLASH_ERASE_MIN_SIZE */
+#define FLASH_ENV_SECTION_SIZE             /* @note you must define it for a value */
 #else
 /* ENV section total bytes size in normal mode. It's equal with FLASH_USER_SETTING_ENV_SIZE */
 #define FLASH_ENV_SECTION_SIZE          (FLASH_USER_SETTING_ENV_SIZE)
@@ -49,6 +55,13 @@ static const flash_env default_env_set[] = {
 
 };
 
+#ifdef FLASH_LOG_USING_CHANNEL
+/* the log channels, they are placed in log area by order, such as: {"fault", 2, 0}, {"trace", 8, 1} */
+static const flash_log_channel log_channel_set[] = {
+
+};
+#endif
+
 /**
  * Flash port for hardware initialize.
  *
@@ -141,6 +154,9 @@ FlashErrCode flash_write(uint32_t addr, const uint32_t *buf, size_t size) {
 
 /**
  * lock the ENV ram cache
+ * @note It must be a mutex which has priority inheritance when the ENV is saved asynchronously or
+ * written through, because the lock is held during the flash erase and write. The semaphore and
+ * disabling interrupts can't be used.
  */
 void flash_env_lock(void) {
 	
@@ -157,6 +173,138 @@ void flash_env_unlock(void) {
 	
 }
 
+#ifdef FLASH_ENV_USING_ASYNC_SAVE
+/**
+ * Create the low priority ENV save worker.
+ * The worker should call flash_env_async_worker() after it was notified.
+ *
+ * @return result
+ */
+FlashErrCode flash_env_async_port_init(void) {
+    FlashErrCode result = FLASH_NO_ERR;
+
+    /* You can add your code under here. */
+
+    return result;
+}
+
+/**
+ * Notify the ENV save worker that has a new save request.
+ * @note If there is no OS, you can call flash_env_async_worker() directly.
+ */
+void flash_env_async_port_notify(void) {
+
+    /* You can add your code under here. */
+
+}
+#endif
+
+#ifdef FLASH_LOG_USING_ASYNC
+/**
+ * Create the low priority log drain worker.
+ * The worker should call flash_log_async_worker() after it was notified.
+ *
+ * @return result
+ */
+FlashErrCode flash_log_async_port_init(void) {
+    FlashErrCode result = FLASH_NO_ERR;
+
+    /* You can add your code under here. */
+
+    return result;
+}
+
+/**
+ * Notify the log drain worker that has new log. It may be called in ISR.
+ */
+void flash_log_async_port_notify(void) {
+
+    /* You can add your code under here. */
+
+}
+
+/**
+ * Compare and swap the word atomically, it must be a full memory barrier.
+ * @note You can use LDREX/STREX on Cortex-M3/M4, or disable the interrupt on Cortex-M0.
+ *
+ * @param addr word address
+ * @param expected the expected value
+ * @param desired the new value
+ *
+ * @return true: the word was expected value and it has been swapped
+ */
+bool flash_log_async_port_cas(volatile uint32_t *addr, uint32_t expected, uint32_t desired) {
+    bool result = false;
+
+    /* You can add your code under here. */
+
+    return result;
+}
+
+/**
+ * Get the current tick, it's used to measure the flush latency.
+ *
+ * @return current tick
+ */
+uint32_t flash_log_async_port_get_tick(void) {
+    uint32_t tick = 0;
+
+    /* You can add your code under here. */
+
+    return tick;
+}
+#endif
+
+#ifdef FLASH_LOG_USING_CHANNEL
+/**
+ * Get the log channels. The total size of channels can't be more than log area size.
+ *
+ * @param channels the log channels
+ * @param channel_num the log channel number
+ */
+void flash_log_port_get_channels(flash_log_channel const **channels, size_t *channel_num) {
+    *channels = log_channel_set;
+    *channel_num = sizeof(log_channel_set) / sizeof(log_channel_set[0]);
+}
+#endif
+
+#if defined(FLASH_LOG_USING_CHANNEL) || defined(FLASH_LOG_USING_PRE_ERASE)
+/**
+ * lock the log rings
+ * @note It must be a mutex which has priority inheritance, because the lock is held during the
+ * flash erase and write. It isn't called in ISR.
+ */
+void flash_log_lock(void) {
+
+    /* You can add your code under here. */
+
+}
+
+/**
+ * unlock the log rings
+ */
+void flash_log_unlock(void) {
+
+    /* You can add your code under here. */
+
+}
+#endif
+
+#ifdef FLASH_LOG_USING_TIME_INDEX
+/**
+ * Get the current time, it's the log record timestamp. The unit is defined by user, such as second.
+ *
+ * @return current time
+ */
+uint32_t flash_log_port_get_time(void) {
+    uint32_t time = 0;
+
+    /* You can add your code under here. */
+
+    return time;
+}
+#endif
+
 
 /**
  * This function is print flash debug info.
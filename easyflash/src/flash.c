@@ -35,6 +35,16 @@
  * |----------------------------|
  * |      Saved log area        |   Storage size: @see FLASH_LOG_AREA_SIZE
  * |----------------------------|
+ * |       Counter area         |   FLASH_COUNTER_SEC_NUM * erase minimum size (optional)
+ * |----------------------------|
+ * |     Schema ENV area        |   FLASH_ENV_SCHEMA_SEC_NUM * erase minimum size (optional)
+ * |----------------------------|
+ * | ENV emergency reserve area |   ENV user setting size + head, erase minimum size alignment (optional)
+ * |----------------------------|
+ * |  ENV factory snapshot area |   ENV user setting size + head, erase minimum size alignment + mark sector (optional)
+ * |----------------------------|
+ * |     Crash dump area        |   FLASH_LOG_CRASHDUMP_SEC_NUM * erase minimum size (optional)
+ * |----------------------------|
  * |(IAP)Downloaded application |   IAP already downloaded application size
  * |----------------------------|
  * |       Remain flash         |   All remaining
@@ -63,17 +73,70 @@ FlashErrCode flash_init(void) {
             size_t *log_size);
     extern FlashErrCode flash_env_init(uint32_t start_addr, size_t total_size,
             size_t erase_min_size, flash_env const *default_env, size_t default_env_size);
+    extern FlashErrCode flash_env_async_init(void);
     extern FlashErrCode flash_iap_init(uint32_t start_addr);
     extern FlashErrCode flash_log_init(uint32_t start_addr, size_t log_size, size_t erase_min_size);
+    extern FlashErrCode flash_log_async_init(void);
+    extern FlashErrCode flash_counter_init(uint32_t start_addr, size_t area_size, size_t erase_min_size);
+    extern FlashErrCode flash_env_schema_init(uint32_t start_addr, size_t area_size, size_t erase_min_size);
+    extern FlashErrCode flash_env_emergency_init(uint32_t start_addr, size_t area_size, size_t erase_min_size);
+    extern FlashErrCode flash_env_factory_init(uint32_t start_addr, size_t area_size, size_t erase_min_size);
+    extern FlashErrCode flash_log_crashdump_init(uint32_t start_addr, size_t area_size, size_t erase_min_size);
 
-    uint32_t env_start_addr;
+    uint32_t env_start_addr, log_start_addr, counter_start_addr, schema_start_addr, emergency_start_addr;
+    uint32_t factory_start_addr, crashdump_start_addr;
     size_t env_total_size = 0, erase_min_size = 0, default_env_set_size = 0, log_size = 0;
+    size_t counter_area_size = 0, schema_area_size = 0, emergency_area_size = 0, factory_area_size = 0;
+    size_t crashdump_area_size = 0;
     const flash_env *default_env_set;
     FlashErrCode result = FLASH_NO_ERR;
 
     result = flash_port_init(&env_start_addr, &env_total_size, &erase_min_size, &default_env_set,
             &default_env_set_size, &log_size);
 
+    if (result == FLASH_NO_ERR) {
+        /* the ENV area size is an integral multiple of erase minimum size */
+        log_start_addr = env_start_addr
+                + (env_total_size + erase_min_size - 1) / erase_min_size * erase_min_size;
+        counter_start_addr = log_start_addr + log_size;
+#ifdef FLASH_USING_COUNTER
+        counter_area_size = FLASH_COUNTER_SEC_NUM * erase_min_size;
+#endif
+        schema_start_addr = counter_start_addr + counter_area_size;
+#if defined(FLASH_USING_ENV) && defined(FLASH_ENV_USING_SCHEMA)
+        schema_area_size = FLASH_ENV_SCHEMA_SEC_NUM * erase_min_size;
+#endif
+        emergency_start_addr = schema_start_addr + schema_area_size;
+#if defined(FLASH_USING_ENV) && defined(FLASH_ENV_USING_EMERGENCY_FLUSH)
+        /* the reserve area can save the whole ENV data section and its head */
+        emergency_area_size = (FLASH_USER_SETTING_ENV_SIZE + erase_min_size) / erase_min_size * erase_min_size;
+#endif
+        factory_start_addr = emergency_start_addr + emergency_area_size;
+#if defined(FLASH_USING_ENV) && defined(FLASH_ENV_USING_FACTORY_SNAPSHOT)
+        /* the snapshot sectors can save the whole ENV data section and its head, then a mark sector */
+        factory_area_size = (FLASH_USER_SETTING_ENV_SIZE + erase_min_size) / erase_min_size * erase_min_size
+                + erase_min_size;
+#endif
+        crashdump_start_addr = factory_start_addr + factory_area_size;
+#if defined(FLASH_USING_LOG) && defined(FLASH_LOG_USING_CRASHDUMP)
+        crashdump_area_size = FLASH_LOG_CRASHDUMP_SEC_NUM * erase_min_size;
+#endif
+    }
+
+#if defined(FLASH_USING_ENV) && defined(FLASH_ENV_USING_EMERGENCY_FLUSH)
+    /* the reserve area will be merged when load ENV */
+    if (result == FLASH_NO_ERR) {
+        result = flash_env_emergency_init(emergency_start_addr, emergency_area_size, erase_min_size);
+    }
+#endif
+
+#if defined(FLASH_USING_ENV) && defined(FLASH_ENV_USING_FACTORY_SNAPSHOT)
+    /* the factory reset mark will be checked when load ENV */
+    if (result == FLASH_NO_ERR) {
+        result = flash_env_factory_init(factory_start_addr, factory_area_size, erase_min_size);
+    }
+#endif
+
 #ifdef FLASH_USING_ENV
     if (result == FLASH_NO_ERR) {
         result = flash_env_init(env_start_addr, env_total_size, erase_min_size, default_env_set,
@@ -81,28 +144,45 @@ FlashErrCode flash_init(void) {
     }
 #endif
 
-#ifdef FLASH_USING_IAP
+#if defined(FLASH_USING_ENV) && defined(FLASH_ENV_USING_ASYNC_SAVE)
     if (result == FLASH_NO_ERR) {
-        if (flash_get_env_total_size() < erase_min_size) {
-            result = flash_iap_init(env_start_addr + erase_min_size + log_size);
-        } else if (flash_get_env_total_size() % erase_min_size == 0) {
-            result = flash_iap_init(env_start_addr + flash_get_env_total_size() + log_size);
-        } else {
-            result = flash_iap_init((flash_get_env_total_size() / erase_min_size + 1) * erase_min_size + log_size);
-        }
+        result = flash_env_async_init();
     }
 #endif
 
 #ifdef FLASH_USING_LOG
     if (result == FLASH_NO_ERR) {
-        if (flash_get_env_total_size() < erase_min_size) {
-            result = flash_log_init(env_start_addr + erase_min_size, log_size, erase_min_size);
-        } else if (flash_get_env_total_size() % erase_min_size == 0) {
-            result = flash_log_init(env_start_addr + flash_get_env_total_size(), log_size, erase_min_size);
-        } else {
-            result = flash_log_init((flash_get_env_total_size() / erase_min_size + 1) * erase_min_size,
-                    log_size, erase_min_size);
-        }
+        result = flash_log_init(log_start_addr, log_size, erase_min_size);
+    }
+#endif
+
+#if defined(FLASH_USING_LOG) && defined(FLASH_LOG_USING_ASYNC)
+    if (result == FLASH_NO_ERR) {
+        result = flash_log_async_init();
+    }
+#endif
+
+#if defined(FLASH_USING_LOG) && defined(FLASH_LOG_USING_CRASHDUMP)
+    if (result == FLASH_NO_ERR) {
+        result = flash_log_crashdump_init(crashdump_start_addr, crashdump_area_size, erase_min_size);
+    }
+#endif
+
+#ifdef FLASH_USING_COUNTER
+    if (result == FLASH_NO_ERR) {
+        result = flash_counter_init(counter_start_addr, counter_area_size, erase_min_size);
+    }
+#endif
+
+#if defined(FLASH_USING_ENV) && defined(FLASH_ENV_USING_SCHEMA)
+    if (result == FLASH_NO_ERR) {
+        result = flash_env_schema_init(schema_start_addr, schema_area_size, erase_min_size);
+    }
+#endif
+
+#ifdef FLASH_USING_IAP
+    if (result == FLASH_NO_ERR) {
+        result = flash_iap_init(crashdump_start_addr + crashdump_area_size);
     }
 #endif
 
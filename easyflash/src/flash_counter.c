@@ -0,0 +1,469 @@
+/*
+ * This file is part of the EasyFlash Library.
+ *
+ * Copyright (c) 2015, Armink, <armink.ztl@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * 'Software'), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED 'AS IS', WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Function: Erase-free monotonic counters and one-shot flags.
+ * Created on: 2026-10-19
+ */
+
+#include "flash.h"
+#include <string.h>
+
+#ifdef FLASH_USING_COUNTER
+
+/**
+ * The counter area has 2 or more sectors. Only one sector is using at a time.
+ * Using sector storage index
+ * |----------------------------|
+ * |           magic            |   written at last when the sector has been switched
+ * |         sequence           |   the newest sector has the biggest sequence
+ * | counters base value        |   FLASH_COUNTER_NUM words
+ * | flags                      |   FLASH_FLAG_NUM words, 0x00000000 is set when switched
+ * |----------------------------|
+ * |     counter 0 tally        |   FLASH_COUNTER_USING_BIT_CLEAR:
+ * |     counter 1 tally        |   the remain words are divided equally by counters
+ * |            ...             |
+ * |----------------------------|
+ * |     tally log              |   otherwise: the remain words are shared by all counters,
+ * |            ...             |   every increase appends a tally word of the counter id,
+ * |            ...             |   every flag set appends a flag word of the flag id
+ * |----------------------------|
+ *
+ * A counter value is the base value plus its tally. When FLASH_COUNTER_USING_BIT_CLEAR is defined,
+ * the tally is the cleared bits number of its own tally words. Otherwise the tally is the number
+ * of its tally words in the tally log, so a busy counter can use the whole sector.
+ * When FLASH_COUNTER_USING_BIT_CLEAR is defined the flag is set by clearing its header word,
+ * otherwise it's set by a flag word in the tally log, so every word is only written once.
+ * When the tally is full the counters will switch to next sector with the newest base value.
+ */
+
+/* the using sector magic word */
+#define COUNTER_SEC_MAGIC              0x45464354
+/* the using sector header words number */
+#define COUNTER_SEC_HEAD_WORDS         (2 + FLASH_COUNTER_NUM + FLASH_FLAG_NUM)
+#ifdef FLASH_COUNTER_USING_BIT_CLEAR
+/* the units (bits) number of each tally word */
+#define COUNTER_UNITS_PER_WORD         32
+#else
+/* the tally log word magic code(bit16-31), it's "CT" */
+#define COUNTER_TALLY_MAGIC            0x4354
+/* make the tally log word by counter id(bit0-15) */
+#define COUNTER_TALLY_WORD(id)         (((uint32_t) COUNTER_TALLY_MAGIC << 16) | (id))
+/* the flag log word magic code(bit16-31), it's "FG" */
+#define COUNTER_FLAG_MAGIC             0x4647
+/* make the flag log word by flag id(bit0-15) */
+#define COUNTER_FLAG_WORD(id)          (((uint32_t) COUNTER_FLAG_MAGIC << 16) | (id))
+/* the block words number when read tally log */
+#define COUNTER_TALLY_BLOCK_WORDS      16
+#endif
+
+/* counter area start address */
+static uint32_t counter_area_addr = 0;
+/* counter area total size */
+static size_t counter_area_size = 0;
+/* the minimum size of flash erasure */
+static size_t flash_erase_min_size = 0;
+/* current using sector address and its sequence */
+static uint32_t cur_sec_addr = 0, cur_sec_seq = 0;
+#ifdef FLASH_COUNTER_USING_BIT_CLEAR
+/* the tally words number of each counter */
+static size_t tally_words = 0;
+#else
+/* the tally log words number and the used words number in current using sector */
+static size_t tally_words = 0, tally_used = 0;
+#endif
+/* counters base value in current using sector */
+static uint32_t counter_base[FLASH_COUNTER_NUM] = { 0 };
+/* counters cleared units number in current using sector */
+static size_t counter_tally[FLASH_COUNTER_NUM] = { 0 };
+/* flags status */
+static bool flag_is_set[FLASH_FLAG_NUM] = { 0 };
+/* initialize OK flag */
+static bool init_ok = false;
+
+static FlashErrCode load_counter(void);
+static FlashErrCode switch_sector(void);
+#ifdef FLASH_COUNTER_USING_BIT_CLEAR
+static size_t get_tally(uint32_t tally_addr);
+#else
+static void load_tally_log(void);
+static FlashErrCode append_tally_log(uint32_t word);
+#endif
+
+/**
+ * The flash counter and flag function initialize.
+ *
+ * @param start_addr counter area start address
+ * @param area_size counter area total size
+ * @param erase_min_size the minimum size of flash erasure
+ *
+ * @return result
+ */
+FlashErrCode flash_counter_init(uint32_t start_addr, size_t area_size, size_t erase_min_size) {
+    FlashErrCode result = FLASH_NO_ERR;
+
+    FLASH_ASSERT(start_addr);
+    FLASH_ASSERT(erase_min_size);
+    /* the counter area size must be an integral multiple of erase minimum size. */
+    FLASH_ASSERT(area_size % erase_min_size == 0);
+    /* the counter area size must be more than 2 multiple of erase minimum size */
+    FLASH_ASSERT(area_size / erase_min_size >= 2);
+    /* every counter must has one tally word at least */
+    FLASH_ASSERT(erase_min_size / 4 >= COUNTER_SEC_HEAD_WORDS + FLASH_COUNTER_NUM);
+
+    counter_area_addr = start_addr;
+    counter_area_size = area_size;
+    flash_erase_min_size = erase_min_size;
+#ifdef FLASH_COUNTER_USING_BIT_CLEAR
+    tally_words = (erase_min_size / 4 - COUNTER_SEC_HEAD_WORDS) / FLASH_COUNTER_NUM;
+#else
+    tally_words = erase_min_size / 4 - COUNTER_SEC_HEAD_WORDS;
+#endif
+
+    result = load_counter();
+    if (result == FLASH_NO_ERR) {
+        init_ok = true;
+    }
+
+    return result;
+}
+
+#ifdef FLASH_COUNTER_USING_BIT_CLEAR
+/**
+ * Get the tally start address of the counter in current using sector.
+ *
+ * @param id counter id
+ *
+ * @return tally start address
+ */
+static uint32_t get_tally_addr(size_t id) {
+    return cur_sec_addr + (COUNTER_SEC_HEAD_WORDS + id * tally_words) * 4;
+}
+#endif
+
+/**
+ * Find the newest using sector and load all counters and flags from it.
+ * The counter area will be formatted when there has no using sector.
+ *
+ * @return result
+ */
+static FlashErrCode load_counter(void) {
+    uint32_t sec_addr, head[2], value;
+    bool found = false;
+    size_t i;
+
+    for (sec_addr = counter_area_addr; sec_addr < counter_area_addr + counter_area_size;
+            sec_addr += flash_erase_min_size) {
+        flash_read(sec_addr, head, sizeof(head));
+        if (head[0] != COUNTER_SEC_MAGIC) {
+            continue;
+        }
+        /* the sequence maybe overflow, so using the difference to compare */
+        if (!found || (int32_t)(head[1] - cur_sec_seq) > 0) {
+            cur_sec_addr = sec_addr;
+            cur_sec_seq = head[1];
+            found = true;
+        }
+    }
+
+    if (!found) {
+        FLASH_INFO("Counter area has no data. Now will format it.\n");
+        memset(counter_base, 0, sizeof(counter_base));
+        memset(counter_tally, 0, sizeof(counter_tally));
+        memset(flag_is_set, 0, sizeof(flag_is_set));
+        /* the first sector will be used after switched from the last sector */
+        cur_sec_addr = counter_area_addr + counter_area_size - flash_erase_min_size;
+        cur_sec_seq = 0;
+        return switch_sector();
+    }
+
+    for (i = 0; i < FLASH_COUNTER_NUM; i++) {
+        flash_read(cur_sec_addr + (2 + i) * 4, &counter_base[i], 4);
+#ifdef FLASH_COUNTER_USING_BIT_CLEAR
+        counter_tally[i] = get_tally(get_tally_addr(i));
+#endif
+    }
+    for (i = 0; i < FLASH_FLAG_NUM; i++) {
+        flash_read(cur_sec_addr + (2 + FLASH_COUNTER_NUM + i) * 4, &value, 4);
+        flag_is_set[i] = (value == 0x00000000);
+    }
+#ifndef FLASH_COUNTER_USING_BIT_CLEAR
+    /* the flags which are set after switched are in the tally log */
+    load_tally_log();
+#endif
+
+    return FLASH_NO_ERR;
+}
+
+#ifdef FLASH_COUNTER_USING_BIT_CLEAR
+/**
+ * Get the cleared units number of the tally.
+ * The units are cleared in order, so it will stop at the first word which isn't full.
+ *
+ * @param tally_addr tally start address
+ *
+ * @return cleared units number
+ */
+static size_t get_tally(uint32_t tally_addr) {
+    size_t i, tally = 0;
+    uint32_t value;
+
+    for (i = 0; i < tally_words; i++) {
+        flash_read(tally_addr + i * 4, &value, 4);
+        if (value == 0x00000000) {
+            tally += COUNTER_UNITS_PER_WORD;
+            continue;
+        }
+        /* the bits are cleared from low bit */
+        while (!(value & 0x01)) {
+            value >>= 1;
+            tally++;
+        }
+        break;
+    }
+
+    return tally;
+}
+#else
+/**
+ * Count the tally of all counters and find the set flags by the tally log in current using sector.
+ * The tally words are appended in order, so it will stop at the first blank word. The broken
+ * tally word is skipped.
+ */
+static void load_tally_log(void) {
+    uint32_t block[COUNTER_TALLY_BLOCK_WORDS];
+    size_t read_words, i;
+
+    memset(counter_tally, 0, sizeof(counter_tally));
+    for (tally_used = 0; tally_used < tally_words; tally_used += read_words) {
+        read_words = tally_words - tally_used;
+        read_words = read_words < COUNTER_TALLY_BLOCK_WORDS ? read_words : COUNTER_TALLY_BLOCK_WORDS;
+        flash_read(cur_sec_addr + (COUNTER_SEC_HEAD_WORDS + tally_used) * 4, block, read_words * 4);
+        for (i = 0; i < read_words; i++) {
+            if (block[i] == 0xFFFFFFFF) {
+                tally_used += i;
+                return;
+            }
+            if ((block[i] >> 16) == COUNTER_TALLY_MAGIC && (block[i] & 0xFFFF) < FLASH_COUNTER_NUM) {
+                counter_tally[block[i] & 0xFFFF]++;
+            } else if ((block[i] >> 16) == COUNTER_FLAG_MAGIC && (block[i] & 0xFFFF) < FLASH_FLAG_NUM) {
+                flag_is_set[block[i] & 0xFFFF] = true;
+            }
+        }
+    }
+}
+
+/**
+ * Append a word to the tally log. The sector will be switched when the tally log is full.
+ *
+ * @param word tally word or flag word
+ *
+ * @return result
+ */
+static FlashErrCode append_tally_log(uint32_t word) {
+    FlashErrCode result = FLASH_NO_ERR;
+
+    if (tally_used >= tally_words) {
+        result = switch_sector();
+    }
+    if (result == FLASH_NO_ERR) {
+        result = flash_write(cur_sec_addr + (COUNTER_SEC_HEAD_WORDS + tally_used) * 4, &word, 4);
+        /* the log word is used even if the write failed */
+        tally_used++;
+    }
+
+    return result;
+}
+#endif
+
+/**
+ * Switch to next sector. The newest counters value and flags will be saved to it.
+ * The old sector is available until the magic of new sector has written.
+ *
+ * @return result
+ */
+static FlashErrCode switch_sector(void) {
+    FlashErrCode result = FLASH_NO_ERR;
+    uint32_t next_sec_addr, head[2 + FLASH_COUNTER_NUM + FLASH_FLAG_NUM], magic = COUNTER_SEC_MAGIC;
+    size_t i;
+
+    next_sec_addr = cur_sec_addr + flash_erase_min_size;
+    if (next_sec_addr >= counter_area_addr + counter_area_size) {
+        next_sec_addr = counter_area_addr;
+    }
+
+    head[0] = 0xFFFFFFFF;
+    head[1] = cur_sec_seq + 1;
+    for (i = 0; i < FLASH_COUNTER_NUM; i++) {
+        head[2 + i] = counter_base[i] + counter_tally[i];
+    }
+    for (i = 0; i < FLASH_FLAG_NUM; i++) {
+        head[2 + FLASH_COUNTER_NUM + i] = flag_is_set[i] ? 0x00000000 : 0xFFFFFFFF;
+    }
+
+    result = flash_erase(next_sec_addr, flash_erase_min_size);
+    if (result == FLASH_NO_ERR) {
+        /* the magic word is written at last */
+        result = flash_write(next_sec_addr + 4, &head[1], sizeof(head) - 4);
+    }
+    if (result == FLASH_NO_ERR) {
+        result = flash_write(next_sec_addr, &magic, 4);
+    }
+
+    if (result == FLASH_NO_ERR) {
+        cur_sec_addr = next_sec_addr;
+        cur_sec_seq = head[1];
+        for (i = 0; i < FLASH_COUNTER_NUM; i++) {
+            counter_base[i] = head[2 + i];
+            counter_tally[i] = 0;
+        }
+#ifndef FLASH_COUNTER_USING_BIT_CLEAR
+        tally_used = 0;
+#endif
+    } else {
+        FLASH_INFO("Error: Counter area switch sector failed.\n");
+    }
+
+    return result;
+}
+
+/**
+ * Increase the counter by one. It only clears one bit or writes one word on flash in most times.
+ * The sector will be switched after the tally of this counter or the tally log has full.
+ *
+ * @param id counter id
+ *
+ * @return result
+ */
+FlashErrCode flash_counter_inc(size_t id) {
+    FlashErrCode result = FLASH_NO_ERR;
+#ifdef FLASH_COUNTER_USING_BIT_CLEAR
+    uint32_t value;
+#endif
+
+    FLASH_ASSERT(init_ok);
+    FLASH_ASSERT(id < FLASH_COUNTER_NUM);
+
+    /* lock the counter area, it shares the ENV lock */
+    flash_env_lock();
+
+#ifdef FLASH_COUNTER_USING_BIT_CLEAR
+    if (counter_tally[id] >= tally_words * COUNTER_UNITS_PER_WORD) {
+        result = switch_sector();
+    }
+
+    if (result == FLASH_NO_ERR) {
+        /* clear the bits from low bit to the bit of current unit */
+        if (counter_tally[id] % COUNTER_UNITS_PER_WORD == COUNTER_UNITS_PER_WORD - 1) {
+            value = 0x00000000;
+        } else {
+            value = 0xFFFFFFFF << (counter_tally[id] % COUNTER_UNITS_PER_WORD + 1);
+        }
+        result = flash_write(get_tally_addr(id) + counter_tally[id] / COUNTER_UNITS_PER_WORD * 4, &value, 4);
+        if (result == FLASH_NO_ERR) {
+            counter_tally[id]++;
+        }
+    }
+#else
+    result = append_tally_log(COUNTER_TALLY_WORD(id));
+    if (result == FLASH_NO_ERR) {
+        counter_tally[id]++;
+    }
+#endif
+
+    /* unlock the counter area */
+    flash_env_unlock();
+
+    return result;
+}
+
+/**
+ * Get the counter value.
+ *
+ * @param id counter id
+ *
+ * @return counter value
+ */
+uint32_t flash_counter_get(size_t id) {
+    uint32_t value;
+
+    FLASH_ASSERT(init_ok);
+    FLASH_ASSERT(id < FLASH_COUNTER_NUM);
+
+    flash_env_lock();
+    value = counter_base[id] + counter_tally[id];
+    flash_env_unlock();
+
+    return value;
+}
+
+/**
+ * Set the one-shot flag. The flag can't be cleared after set.
+ *
+ * @param id flag id
+ *
+ * @return result
+ */
+FlashErrCode flash_flag_set(size_t id) {
+    FlashErrCode result = FLASH_NO_ERR;
+#ifdef FLASH_COUNTER_USING_BIT_CLEAR
+    uint32_t value = 0x00000000;
+#endif
+
+    FLASH_ASSERT(init_ok);
+    FLASH_ASSERT(id < FLASH_FLAG_NUM);
+
+    flash_env_lock();
+
+    if (!flag_is_set[id]) {
+#ifdef FLASH_COUNTER_USING_BIT_CLEAR
+        /* the header word was written by 0xFFFFFFFF, it's cleared again */
+        result = flash_write(cur_sec_addr + (2 + FLASH_COUNTER_NUM + id) * 4, &value, 4);
+#else
+        result = append_tally_log(COUNTER_FLAG_WORD(id));
+#endif
+        if (result == FLASH_NO_ERR) {
+            flag_is_set[id] = true;
+        }
+    }
+
+    flash_env_unlock();
+
+    return result;
+}
+
+/**
+ * Test the one-shot flag.
+ *
+ * @param id flag id
+ *
+ * @return true: the flag has set
+ */
+bool flash_flag_test(size_t id) {
+    FLASH_ASSERT(init_ok);
+    FLASH_ASSERT(id < FLASH_FLAG_NUM);
+
+    return flag_is_set[id];
+}
+
+#endif /* FLASH_USING_COUNTER */
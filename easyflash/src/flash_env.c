@@ -39,9 +39,54 @@
  * 1. System section
  *    It storage ENV parameters. (Units: Word)
  * 2. Data section
- *    It storage all ENV. Storage format is key=value\0.
+ *    It storage all ENV. Storage format is CRC32 code(1 word) + head(1 word) + key\0value\0.
+ *    The head contains key length(bit0-7), flags(bit8-15) and value length(bit16-31), so the
+ *    next ENV can be found without scan the string.
+ *    The CRC32 code is calculated by head, key\0value\0 and the word alignment part.
  *    All ENV must be 4 bytes alignment. The remaining part must fill '\0'.
  *
+ * The data section CRC32 code is combined by every ENV's CRC32 code. The sum of all ENV's CRC32
+ * code is cached, so it only needs to calculate the changed ENV when save.
+ * When the data section CRC32 check failed, only the broken ENV will be dropped. The dropped
+ * default ENV will be recovered to default value.
+ *
+ * The ENV which was saved by old version (key=value\0 and the whole data section CRC32 code) will
+ * be upgraded to current format when load.
+ *
+ * In slotted mode, the ENV area has some erase sectors and every sector is divided into some
+ * slots by FLASH_USER_SETTING_ENV_SIZE. The ENV is saved to next empty slot, so the sector is
+ * only erased when its first slot will be used. The system section has a save sequence, the
+ * newest valid slot will be loaded.
+ *
+ * In sharded mode, the ENV area is divided equally into FLASH_ENV_SHARD_NUM shards, the ENV is
+ * distributed into shards by the CRC32 code of its name. Every shard has its own head (data size,
+ * shard information and CRC32 code) and dirty flag, so only the changed shards will be erased
+ * and written when save. The cache is same as normal mode.
+ *
+ * In default overlay mode, the default ENV is read from the default ENV set directly. The cache
+ * only contains the ENV which is different from default. The deleted default ENV is a record
+ * which has ENV_FLAG_DELETED flag.
+ *
+ * When using key class, the volatile ENV is stored in another RAM cache by same format, so it
+ * never changes the ENV which will be saved. The write-through ENV has ENV_FLAG_WRITE_THROUGH
+ * flag, it will be saved when it has been set.
+ *
+ * When using emergency flush, the ENV data section in cache can be written to a pre-erased
+ * reserve area without erase when power failed. The reserve area has a head (magic code, data
+ * size and CRC32 code), it will be merged and erased when load.
+ *
+ * When using factory snapshot, the provisioned ENV data section is written to a protected area
+ * once. The factory reset only writes a reset mark word to the mark sector of this area, then the
+ * snapshot is loaded instead of the saved ENV until the ENV is saved again. The saved mark is
+ * written after that save.
+ *
+ * When using boot reader, an ENV can be read from flash directly without cache, so the bootloader
+ * doesn't need flash_init. The emergency flushed ENV and factory reset aren't applied by it.
+ *
+ * When using change feed, every change of the saved ENV increases the ENV version and appends
+ * its name to a RAM ring journal. The changed ENV names since a version can be got from the
+ * journal, all ENV names will be got when the journal has been overflowed.
+ *
  * @note Word = 4 Bytes in this file
  */
 
@@ -51,12 +96,105 @@ enum {
     ENV_PARAM_INDEX_END_ADDR = 0,
     /* data section CRC32 code index in system section */
     ENV_PARAM_INDEX_DATA_CRC,
+#ifdef FLASH_ENV_USING_SLOTTED_MODE
+    /* the slot save sequence index in system section */
+    ENV_PARAM_INDEX_SAVE_SEQ,
+#endif
     /* flash ENV parameters word size */
     ENV_PARAM_WORD_SIZE,
     /* flash ENV parameters byte size */
     ENV_PARAM_BYTE_SIZE = ENV_PARAM_WORD_SIZE * 4,
 };
 
+#ifdef FLASH_ENV_USING_SHARDED_MODE
+/* the shard head index and size in every shard */
+enum {
+    /* the shard ENV data size index in shard head */
+    ENV_SHARD_HEAD_INDEX_DATA_SIZE = 0,
+    /* the shard information index in shard head */
+    ENV_SHARD_HEAD_INDEX_INFO,
+    /* the shard CRC32 code index in shard head */
+    ENV_SHARD_HEAD_INDEX_CRC,
+    /* the shard head word size */
+    ENV_SHARD_HEAD_WORD_SIZE,
+    /* the shard head byte size */
+    ENV_SHARD_HEAD_BYTE_SIZE = ENV_SHARD_HEAD_WORD_SIZE * 4,
+};
+/* the shard information is shard index(bit0-15) and shard number(bit16-31) */
+#define ENV_SHARD_INFO(index)          ((uint32_t) (index) | ((uint32_t) FLASH_ENV_SHARD_NUM << 16))
+#endif
+
+#ifdef FLASH_ENV_USING_EMERGENCY_FLUSH
+/* the emergency reserve area head index and size */
+enum {
+    /* the magic code index in emergency head */
+    ENV_EMERGENCY_HEAD_INDEX_MAGIC = 0,
+    /* the ENV data size index in emergency head */
+    ENV_EMERGENCY_HEAD_INDEX_DATA_SIZE,
+    /* the ENV data CRC32 code index in emergency head */
+    ENV_EMERGENCY_HEAD_INDEX_CRC,
+    /* the emergency head word size */
+    ENV_EMERGENCY_HEAD_WORD_SIZE,
+    /* the emergency head byte size */
+    ENV_EMERGENCY_HEAD_BYTE_SIZE = ENV_EMERGENCY_HEAD_WORD_SIZE * 4,
+};
+/* the emergency head magic code, it's "EFEM" */
+#define ENV_EMERGENCY_MAGIC            0x4546454D
+#endif
+
+#ifdef FLASH_ENV_USING_FACTORY_SNAPSHOT
+/* the factory snapshot head index and size */
+enum {
+    /* the magic code index in snapshot head */
+    ENV_FACTORY_HEAD_INDEX_MAGIC = 0,
+    /* the ENV data size index in snapshot head */
+    ENV_FACTORY_HEAD_INDEX_DATA_SIZE,
+    /* the ENV data CRC32 code index in snapshot head */
+    ENV_FACTORY_HEAD_INDEX_CRC,
+    /* the snapshot head word size */
+    ENV_FACTORY_HEAD_WORD_SIZE,
+    /* the snapshot head byte size */
+    ENV_FACTORY_HEAD_BYTE_SIZE = ENV_FACTORY_HEAD_WORD_SIZE * 4,
+};
+/* the factory snapshot head magic code, it's "EFFS" */
+#define ENV_FACTORY_MAGIC              0x45464653
+/* the mark of factory reset, the snapshot will be loaded */
+#define ENV_FACTORY_MARK_RESET         0x45465253
+/* the mark of the snapshot has been saved as ENV */
+#define ENV_FACTORY_MARK_SAVED         0x00000000
+#endif
+
+/* the ENV CRC32 code and head bytes size */
+#define ENV_HEAD_BYTE_SIZE             8
+/* the ENV CRC32 code bytes size, the CRC32 code is calculated by the part after it */
+#define ENV_CRC_BYTE_SIZE              4
+/* the ENV name maximum length */
+#define ENV_KEY_LEN_MAX                0xFF
+/* the ENV value maximum length */
+#define ENV_VALUE_LEN_MAX              0xFFFF
+/* make the ENV head by key length, value length and flags */
+#define ENV_MAKE_HEAD(key_len, value_len, flags) \
+        ((uint32_t) (key_len) | ((uint32_t) (flags) << 8) | ((uint32_t) (value_len) << 16))
+/* get the key length, flags and value length from the ENV address in cache */
+#define ENV_KEY_LEN(env)               (((uint32_t *) (env))[1] & 0xFF)
+#define ENV_FLAGS(env)                 ((((uint32_t *) (env))[1] >> 8) & 0xFF)
+#define ENV_VALUE_LEN(env)             (((uint32_t *) (env))[1] >> 16)
+/* the ENV flags */
+#define ENV_FLAG_DELETED               0x01
+#define ENV_FLAG_WRITE_THROUGH         0x02
+/* get the ENV flags by key class */
+#define ENV_CLASS_FLAGS(env_class)     ((env_class) == FLASH_ENV_WRITE_THROUGH ? ENV_FLAG_WRITE_THROUGH : 0)
+/* get the key and value string from the ENV address in cache */
+#define ENV_KEY(env)                   ((char *) (env) + ENV_HEAD_BYTE_SIZE)
+#define ENV_VALUE(env)                 (ENV_KEY(env) + ENV_KEY_LEN(env) + 1)
+/* the ENV storage length by key length and value length, contain head, '\0' and word alignment */
+#define ENV_STORAGE_LEN(key_len, value_len) \
+        (ENV_HEAD_BYTE_SIZE + ((key_len) + (value_len) + 2 + 3) / 4 * 4)
+/* the block bytes size when load ENV from flash, must be word alignment */
+#define ENV_LOAD_BLOCK_SIZE            64
+/* the maximum number of recorded recovered default ENV name */
+#define ENV_RECOVERED_KEY_MAX          16
+
 /* default ENV set, must be initialized by user */
 static flash_env const *default_env_set = NULL;
 /* default ENV set size, must be initialized by user */
@@ -65,29 +203,155 @@ static size_t default_env_set_size = NULL;
 static uint32_t env_cache[FLASH_USER_SETTING_ENV_SIZE / 4] = { 0 };
 /* ENV start address in flash */
 static uint32_t env_start_addr = NULL;
+#ifdef FLASH_ENV_USING_SLOTTED_MODE
+/* ENV area start address and total size in flash */
+static uint32_t env_area_addr = 0;
+static size_t env_area_size = 0;
+/* the minimum size of flash erasure */
+static size_t env_erase_min_size = 0;
+/* the slot address which ENV will be saved to */
+static uint32_t env_next_slot_addr = 0;
+#endif
+#ifdef FLASH_ENV_USING_SHARDED_MODE
+/* every shard size in flash */
+static size_t env_shard_area_size = 0;
+/* every shard ENV data size in cache */
+static size_t env_shard_data_size[FLASH_ENV_SHARD_NUM] = { 0 };
+/* the shard has been changed and it isn't saved */
+static bool env_shard_dirty[FLASH_ENV_SHARD_NUM] = { 0 };
+#endif
+#ifdef FLASH_ENV_USING_KEY_CLASS
+/* volatile ENV RAM cache, it will never be saved */
+static uint32_t env_volatile_cache[FLASH_ENV_VOLATILE_SIZE / 4] = { 0 };
+/* volatile ENV data size in cache */
+static size_t env_volatile_size = 0;
+#endif
+#ifdef FLASH_ENV_USING_EMERGENCY_FLUSH
+/* emergency reserve area start address and size in flash */
+static uint32_t env_emergency_addr = 0;
+static size_t env_emergency_size = 0;
+/* the emergency reserve area has been erased */
+static bool env_emergency_ready = false;
+/* the cache has been changed and it isn't saved */
+static bool env_cache_dirty = false;
+#endif
+#ifdef FLASH_ENV_USING_CHANGE_FEED
+/* the ENV change journal entry */
+typedef struct {
+    uint32_t version;
+    char key[FLASH_ENV_FEED_KEY_SIZE];
+} env_change;
+/* the ENV change journal, it's a ring buffer */
+static env_change env_journal[FLASH_ENV_FEED_JOURNAL_SIZE] = { 0 };
+/* the oldest entry index and entry number in journal */
+static size_t env_journal_start = 0, env_journal_num = 0;
+/* the journal contains all changes after this version */
+static uint32_t env_journal_base = 0;
+/* current ENV version, it's increased when the saved ENV has been changed */
+static uint32_t env_version = 0;
+#endif
+#ifdef FLASH_ENV_USING_FACTORY_SNAPSHOT
+/* factory snapshot area start address and size in flash, the last sector is mark sector */
+static uint32_t env_factory_addr = 0;
+static size_t env_factory_size = 0;
+/* the mark sector address and size in flash */
+static uint32_t env_factory_mark_sec_addr = 0;
+static size_t env_factory_mark_sec_size = 0;
+/* the next blank mark address */
+static uint32_t env_factory_mark_addr = 0;
+/* the factory reset has been marked and the snapshot isn't saved as ENV */
+static bool env_factory_reset = false;
+#endif
+/* the sum of all ENV's CRC32 code in cache */
+static uint32_t env_crc_sum = 0;
+/* the default ENV name which was recovered by last load */
+static const char *recovered_keys[ENV_RECOVERED_KEY_MAX] = { 0 };
+/* the recovered default ENV number by last load */
+static size_t recovered_key_num = 0;
 
 static uint32_t get_env_system_addr(void);
 static uint32_t get_env_data_addr(void);
 static uint32_t get_env_end_addr(void);
 static void set_env_end_addr(uint32_t end_addr);
-static FlashErrCode write_env(const char *key, const char *value);
+static FlashErrCode write_env(const char *key, const char *value, uint8_t flags);
 static uint32_t *find_env(const char *key);
 static FlashErrCode del_env(const char *key);
 static size_t get_env_data_size(void);
-static FlashErrCode create_env(const char *key, const char *value);
+static FlashErrCode create_env(const char *key, const char *value, uint8_t flags);
+static FlashErrCode set_env(const char *key, const char *value, uint8_t flags);
+static FlashErrCode replace_env(const char *key, const char *value);
+static size_t get_env_len(const char *env);
 static uint32_t calc_env_crc(void);
 static bool env_crc_is_ok(void);
+static void load_env(void);
+static bool load_env_data(uint32_t read_addr, char *env_start, size_t env_data_size);
+#ifdef FLASH_ENV_USING_DEFAULT_IMAGE
+static void load_default_env_image(void);
+#endif
+static bool env_is_complete(const char *env, const char *env_end, size_t *env_len);
+static bool env_is_valid(const char *env, const char *env_end, size_t *env_len);
+static void recover_env(void);
+static bool legacy_env_crc_is_ok(void);
+static void upgrade_legacy_env(void);
+#ifdef FLASH_ENV_USING_SLOTTED_MODE
+static uint32_t get_area_next_slot_addr(uint32_t area_addr, size_t area_size, size_t erase_min_size,
+        uint32_t slot_addr);
+static uint32_t get_next_slot_addr(uint32_t slot_addr);
+static uint32_t find_newest_slot(uint32_t area_addr, size_t area_size, size_t erase_min_size,
+        uint32_t seq_limit, uint32_t *seq);
+static bool load_newest_slot(void);
+#endif
+#ifdef FLASH_ENV_USING_SHARDED_MODE
+static size_t get_env_shard(const char *key, size_t key_len);
+static void update_env_shards(bool set_dirty);
+static void load_env_shards(void);
+static FlashErrCode save_env_shard(size_t shard);
+#endif
+#ifdef FLASH_ENV_USING_EMERGENCY_FLUSH
+static bool emergency_area_is_blank(void);
+static void merge_emergency_env(void);
+#endif
+#ifdef FLASH_ENV_USING_FACTORY_SNAPSHOT
+static void load_saved_env(void);
+static bool factory_snapshot_is_valid(uint32_t *head);
+static bool load_factory_env(void);
+static FlashErrCode write_factory_mark(uint32_t mark);
+static void finish_factory_reset(void);
+#endif
+#ifdef FLASH_ENV_USING_DEFAULT_OVERLAY
+static const flash_env *find_default_env(const char *key);
+static FlashErrCode set_overlay_env(const char *key, const char *value, uint8_t flags);
+static bool drop_default_value_env(void);
+#endif
+#ifdef FLASH_ENV_USING_KEY_CLASS
+static FlashEnvClass get_env_class(const char *key);
+static char *find_volatile_env(const char *key);
+static FlashErrCode set_volatile_env(const char *key, const char *value);
+static void set_volatile_default_env(void);
+static FlashErrCode set_class_env(const char *key, const char *value, FlashEnvClass env_class);
+#endif
+#ifdef FLASH_ENV_USING_CHANGE_FEED
+static void record_env_change(const char *key);
+#endif
+#ifdef FLASH_ENV_USING_BOOT_READER
+static void boot_read_bytes(uint32_t addr, char *buf, size_t size);
+static bool boot_find_env(uint32_t addr, uint32_t end_addr, const char *key, bool verify,
+        uint32_t *crc_sum, uint32_t *env_addr);
+#endif
 
 /**
  * Flash ENV initialize.
  *
  * @param start_addr ENV start address in flash
  * @param total_size ENV section total size (@note must be word alignment)
- * @param erase_min_size the minimum size of flash erasure. it isn't be used in normal mode.
+ * @param erase_min_size the minimum size of flash erasure. it's only used in slotted and sharded mode.
  * @param default_env default ENV set for user
  * @param default_env_size default ENV set size
  *
- * @note user_size must equal with total_size in normal mode
+ * @note user_size must equal with total_size in normal mode.
+ *       total_size is integral multiple of erase_min_size in slotted mode, and it has 2 sectors at
+ *       least, so the last saved slot is still kept when the next sector is erased.
+ *       total_size is integral multiple of FLASH_ENV_SHARD_NUM erase_min_size in sharded mode.
  *
  * @return result
  */
@@ -97,19 +361,42 @@ FlashErrCode flash_env_init(uint32_t start_addr, size_t total_size, size_t erase
 
     FLASH_ASSERT(start_addr);
     FLASH_ASSERT(total_size);
+#ifdef FLASH_ENV_USING_SLOTTED_MODE
+    /* every sector has one slot at least, the last saved sector is kept when the next is erased */
+    FLASH_ASSERT(erase_min_size);
+    FLASH_ASSERT(total_size % erase_min_size == 0);
+    FLASH_ASSERT(total_size / erase_min_size >= 2);
+    FLASH_ASSERT(FLASH_USER_SETTING_ENV_SIZE <= erase_min_size);
+#elif defined(FLASH_ENV_USING_SHARDED_MODE)
+    /* every shard is integral multiple of erase minimum size */
+    FLASH_ASSERT(erase_min_size);
+    FLASH_ASSERT(total_size % (FLASH_ENV_SHARD_NUM * erase_min_size) == 0);
+#else
     /* user_size must equal with total_size in normal mode */
     FLASH_ASSERT(FLASH_USER_SETTING_ENV_SIZE == total_size);
+#endif
     FLASH_ASSERT(default_env);
     FLASH_ASSERT(default_env_size < total_size);
     /* must be word alignment for ENV */
     FLASH_ASSERT(total_size % 4 == 0);
 
     env_start_addr = start_addr;
+#ifdef FLASH_ENV_USING_SLOTTED_MODE
+    env_area_addr = start_addr;
+    env_area_size = total_size;
+    env_erase_min_size = erase_min_size;
+#endif
+#ifdef FLASH_ENV_USING_SHARDED_MODE
+    env_shard_area_size = total_size / FLASH_ENV_SHARD_NUM;
+#endif
     default_env_set = default_env;
     default_env_set_size = default_env_size;
 
     FLASH_DEBUG("Env start address is 0x%08X, size is %d bytes.\n", start_addr, total_size);
 
+#ifdef FLASH_ENV_USING_KEY_CLASS
+    set_volatile_default_env();
+#endif
     flash_load_env();
 
     return result;
@@ -122,7 +409,9 @@ FlashErrCode flash_env_init(uint32_t start_addr, size_t total_size, size_t erase
  */
 FlashErrCode flash_env_set_default(void){
     FlashErrCode result = FLASH_NO_ERR;
+#if !defined(FLASH_ENV_USING_DEFAULT_OVERLAY) && !defined(FLASH_ENV_USING_DEFAULT_IMAGE)
     size_t i;
+#endif
 
     FLASH_ASSERT(default_env_set);
     FLASH_ASSERT(default_env_set_size);
@@ -132,11 +421,38 @@ FlashErrCode flash_env_set_default(void){
 
     /* set environment end address is at data section start address */
     set_env_end_addr(get_env_data_addr());
-
-    /* create default ENV */
+    env_crc_sum = 0;
+
+#if defined(FLASH_ENV_USING_DEFAULT_OVERLAY)
+    /* the default ENV is read from default ENV set directly, so the cache is empty */
+#elif defined(FLASH_ENV_USING_DEFAULT_IMAGE)
+    /* load the prebuilt default ENV image */
+    load_default_env_image();
+#else
+    /* the default ENV name is unique, so write them at the end of cache without finding */
     for (i = 0; i < default_env_set_size; i++) {
-        create_env(default_env_set[i].key, default_env_set[i].value);
+#ifdef FLASH_ENV_USING_KEY_CLASS
+        /* the volatile default ENV is only in volatile cache */
+        if (default_env_set[i].env_class != FLASH_ENV_VOLATILE) {
+            write_env(default_env_set[i].key, default_env_set[i].value,
+                    ENV_CLASS_FLAGS(default_env_set[i].env_class));
+        }
+#else
+        write_env(default_env_set[i].key, default_env_set[i].value, 0);
+#endif
     }
+#endif
+#ifdef FLASH_ENV_USING_KEY_CLASS
+    set_volatile_default_env();
+#endif
+#ifdef FLASH_ENV_USING_SHARDED_MODE
+    /* all shards will be saved */
+    update_env_shards(true);
+#endif
+#ifdef FLASH_ENV_USING_CHANGE_FEED
+    /* all ENV may be changed */
+    record_env_change(NULL);
+#endif
 
     /* unlock the ENV cache */
     flash_env_unlock();
@@ -146,6 +462,27 @@ FlashErrCode flash_env_set_default(void){
     return result;
 }
 
+#ifdef FLASH_ENV_USING_DEFAULT_IMAGE
+/**
+ * Load the prebuilt default ENV image to cache by one copy.
+ * The image is generated by tools/env_image, so only the CRC32 code sum need be calculated.
+ */
+static void load_default_env_image(void) {
+    char *env = (char *) env_cache + ENV_PARAM_BYTE_SIZE;
+    char *env_end = env + flash_default_env_image_size;
+
+    FLASH_ASSERT(flash_default_env_image_size % 4 == 0);
+    FLASH_ASSERT(ENV_PARAM_BYTE_SIZE + flash_default_env_image_size <= flash_get_env_total_size());
+
+    memcpy(env, flash_default_env_image, flash_default_env_image_size);
+    while (env < env_end) {
+        env_crc_sum += *(uint32_t *) env;
+        env += get_env_len(env);
+    }
+    set_env_end_addr(get_env_data_addr() + flash_default_env_image_size);
+}
+#endif
+
 /**
  * Get ENV system section start address.
  *
@@ -219,46 +556,55 @@ size_t flash_get_env_write_bytes(void) {
  *
  * @param key ENV name
  * @param value ENV value
+ * @param flags ENV flags
  *
  * @return result
  */
-static FlashErrCode write_env(const char *key, const char *value) {
+static FlashErrCode write_env(const char *key, const char *value, uint8_t flags) {
     FlashErrCode result = FLASH_NO_ERR;
-    size_t ker_len = strlen(key), value_len = strlen(value), env_str_len;
-    char *env_cache_bak = (char *)env_cache;
+    size_t key_len = strlen(key), value_len = strlen(value), env_len;
+    char *env;
+#ifdef FLASH_ENV_USING_SHARDED_MODE
+    size_t shard = get_env_shard(key, key_len);
+#endif
 
-    /* calculate ENV storage length, contain '=' and '\0'. */
-    env_str_len = ker_len + value_len + 2;
-    if (env_str_len % 4 != 0) {
-        env_str_len = (env_str_len / 4 + 1) * 4;
+    if (value_len > ENV_VALUE_LEN_MAX) {
+        return FLASH_ENV_FULL;
     }
+    /* calculate ENV storage length, contain head, two '\0' and word alignment */
+    env_len = ENV_STORAGE_LEN(key_len, value_len);
     /* check capacity of ENV  */
-    if (env_str_len + get_env_data_size() >= flash_get_env_total_size()) {
+    if (env_len + flash_get_env_write_bytes() > flash_get_env_total_size()) {
+        return FLASH_ENV_FULL;
+    }
+#ifdef FLASH_ENV_USING_SHARDED_MODE
+    /* check capacity of the shard */
+    if (ENV_SHARD_HEAD_BYTE_SIZE + env_shard_data_size[shard] + env_len > env_shard_area_size) {
         return FLASH_ENV_FULL;
     }
+    env_shard_data_size[shard] += env_len;
+    env_shard_dirty[shard] = true;
+#endif
     /* calculate current ENV ram cache end address */
-    env_cache_bak += flash_get_env_write_bytes();
-    /* copy key name */
-    memcpy(env_cache_bak, key, ker_len);
-    env_cache_bak += ker_len;
-    /* copy equal sign */
-    *env_cache_bak = '=';
-    env_cache_bak++;
-    /* copy value */
-    memcpy(env_cache_bak, value, value_len);
-    env_cache_bak += value_len;
-    /* fill '\0' for string end sign */
-    *env_cache_bak = '\0';
-    env_cache_bak ++;
-    /* fill '\0' for word alignment */
-    memset(env_cache_bak, 0, env_str_len - (ker_len + value_len + 2));
-    set_env_end_addr(get_env_end_addr() + env_str_len);
+    env = (char *) env_cache + flash_get_env_write_bytes();
+    ((uint32_t *) env)[1] = ENV_MAKE_HEAD(key_len, value_len, flags);
+    /* fill '\0' for string end sign and word alignment */
+    memset(ENV_KEY(env), 0, env_len - ENV_HEAD_BYTE_SIZE);
+    memcpy(ENV_KEY(env), key, key_len);
+    memcpy(ENV_VALUE(env), value, value_len);
+    /* calculate this ENV CRC32 code and add it to sum */
+    *(uint32_t *) env = calc_crc32(0, env + ENV_CRC_BYTE_SIZE, env_len - ENV_CRC_BYTE_SIZE);
+    env_crc_sum += *(uint32_t *) env;
+    set_env_end_addr(get_env_end_addr() + env_len);
+#ifdef FLASH_ENV_USING_EMERGENCY_FLUSH
+    env_cache_dirty = true;
+#endif
 
     return result;
 }
 
 /**
- * Find ENV.
+ * Find ENV. Only the ENV which has same key length will be compared.
  *
  * @param key ENV name
  *
@@ -267,7 +613,7 @@ static FlashErrCode write_env(const char *key, const char *value) {
 static uint32_t *find_env(const char *key) {
     uint32_t *env_cache_addr = NULL;
     char *env_start, *env_end, *env;
-    size_t key_len = strlen(key), env_len;
+    size_t key_len = strlen(key);
 
     FLASH_ASSERT(env_start_addr);
 
@@ -280,41 +626,39 @@ static uint32_t *find_env(const char *key) {
     env_start = (char *) ((char *) env_cache + ENV_PARAM_BYTE_SIZE);
     env_end = (char *) ((char *) env_cache + flash_get_env_write_bytes());
 
-    /* ENV is null */
-    if (env_start == env_end) {
-        return NULL;
-    }
-
-    env = env_start;
-    while (env < env_end) {
-        /* the key length must be equal */
-        if (!strncmp(env, key, key_len) && (env[key_len] == '=')) {
+    for (env = env_start; env < env_end; env += get_env_len(env)) {
+        if ((ENV_KEY_LEN(env) == key_len) && !memcmp(ENV_KEY(env), key, key_len)) {
             env_cache_addr = (uint32_t *) env;
             break;
-        } else {
-            /* calculate ENV length, contain '\0'. */
-            env_len = strlen(env) + 1;
-            /* next ENV and word alignment */
-            if (env_len % 4 == 0) {
-                env += env_len;
-            } else {
-                env += (env_len / 4 + 1) * 4;
-            }
         }
     }
+
     return env_cache_addr;
 }
 
+/**
+ * Get the ENV storage length in cache by its head.
+ * It contains CRC32 code, head, key\0value\0 and word alignment part.
+ *
+ * @param env ENV address in cache
+ *
+ * @return ENV storage length
+ */
+static size_t get_env_len(const char *env) {
+    return ENV_STORAGE_LEN(ENV_KEY_LEN(env), ENV_VALUE_LEN(env));
+}
+
 /**
  * If the ENV is not exist, create it.
  * @see flash_write_env
  *
  * @param key ENV name
  * @param value ENV value
+ * @param flags ENV flags
  *
  * @return result
  */
-static FlashErrCode create_env(const char *key, const char *value) {
+static FlashErrCode create_env(const char *key, const char *value, uint8_t flags) {
     FlashErrCode result = FLASH_NO_ERR;
 
     FLASH_ASSERT(key);
@@ -330,13 +674,18 @@ static FlashErrCode create_env(const char *key, const char *value) {
         return FLASH_ENV_NAME_ERR;
     }
 
+    if (strlen(key) > ENV_KEY_LEN_MAX) {
+        FLASH_INFO("Flash ENV name is too long.\n");
+        return FLASH_ENV_NAME_ERR;
+    }
+
     /* find ENV */
     if (find_env(key)) {
         FLASH_INFO("The name of \"%s\" is already exist.\n", key);
         return FLASH_ENV_NAME_EXIST;
     }
     /* write ENV at the end of cache */
-    result = write_env(key, value);
+    result = write_env(key, value, flags);
 
     return result;
 }
@@ -372,20 +721,23 @@ static FlashErrCode del_env(const char *key){
         FLASH_INFO("Not find \"%s\" in ENV.\n", key);
         return FLASH_ENV_NAME_ERR;
     }
-    del_env_length = strlen(del_env_str);
-    /* '\0' also must be as ENV length */
-    del_env_length ++;
-    /* the address must multiple of 4 */
-    if (del_env_length % 4 != 0) {
-        del_env_length = (del_env_length / 4 + 1) * 4;
-    }
+    del_env_length = get_env_len(del_env_str);
+#ifdef FLASH_ENV_USING_SHARDED_MODE
+    env_shard_data_size[get_env_shard(key, strlen(key))] -= del_env_length;
+    env_shard_dirty[get_env_shard(key, strlen(key))] = true;
+#endif
+    /* subtract this ENV CRC32 code from sum */
+    env_crc_sum -= *(uint32_t *) del_env_str;
     /* calculate remain ENV length */
     remain_env_length = get_env_data_size()
             - (((uint32_t) del_env_str + del_env_length) - ((uint32_t) env_cache + ENV_PARAM_BYTE_SIZE));
     /* remain ENV move forward */
-    memcpy(del_env_str, del_env_str + del_env_length, remain_env_length);
+    memmove(del_env_str, del_env_str + del_env_length, remain_env_length);
     /* reset ENV end address */
     set_env_end_addr(get_env_end_addr() - del_env_length);
+#ifdef FLASH_ENV_USING_EMERGENCY_FLUSH
+    env_cache_dirty = true;
+#endif
 
     return result;
 }
@@ -405,6 +757,110 @@ FlashErrCode flash_set_env(const char *key, const char *value) {
     /* lock the ENV cache */
     flash_env_lock();
 
+    result = replace_env(key, value);
+
+    /* unlock the ENV cache */
+    flash_env_unlock();
+
+    return result;
+}
+
+/**
+ * Set an ENV in cache and keep its key class.
+ * @see flash_set_env
+ *
+ * @param key ENV name
+ * @param value ENV value
+ *
+ * @return result
+ */
+static FlashErrCode replace_env(const char *key, const char *value) {
+#ifdef FLASH_ENV_USING_KEY_CLASS
+    /* keep the key class of this ENV */
+    return set_class_env(key, value, get_env_class(key));
+#else
+    return set_env(key, value, 0);
+#endif
+}
+
+/**
+ * Compare and swap an ENV. The ENV is set only when its current value is same as expected value.
+ *
+ * @param key ENV name
+ * @param expected expected current value, NULL means the ENV must not exist
+ * @param value new ENV value, delete it when it's empty
+ *
+ * @return result, FLASH_ENV_VALUE_CHANGED when the current value isn't same as expected value
+ */
+FlashErrCode flash_env_cas(const char *key, const char *expected, const char *value) {
+    FlashErrCode result = FLASH_NO_ERR;
+    char *cur_value;
+
+    /* lock the ENV cache */
+    flash_env_lock();
+
+    cur_value = flash_get_env(key);
+    if ((cur_value == NULL && expected == NULL)
+            || (cur_value != NULL && expected != NULL && !strcmp(cur_value, expected))) {
+        result = replace_env(key, value);
+    } else {
+        result = FLASH_ENV_VALUE_CHANGED;
+    }
+
+    /* unlock the ENV cache */
+    flash_env_unlock();
+
+    return result;
+}
+
+/**
+ * Read, modify and write an ENV atomically. The callback is called with ENV cache locked,
+ * so it can't call any ENV function.
+ *
+ * @param key ENV name
+ * @param cb the callback which returns new value by current value (NULL when it doesn't exist)
+ * @param arg the callback argument
+ *
+ * @return result
+ */
+FlashErrCode flash_env_update(const char *key, flash_env_update_cb cb, void *arg) {
+    FlashErrCode result = FLASH_NO_ERR;
+    const char *cur_value, *value;
+
+    FLASH_ASSERT(cb);
+
+    /* lock the ENV cache */
+    flash_env_lock();
+
+    cur_value = flash_get_env(key);
+    value = cb(key, cur_value, arg);
+    /* the current value is in cache, it will be moved when set */
+    if (value != NULL && value != cur_value) {
+        result = replace_env(key, value);
+    }
+
+    /* unlock the ENV cache */
+    flash_env_unlock();
+
+    return result;
+}
+
+/**
+ * Set an ENV in cache. If it value is empty, delete it.
+ * @see flash_set_env
+ *
+ * @param key ENV name
+ * @param value ENV value
+ * @param flags ENV flags
+ *
+ * @return result
+ */
+static FlashErrCode set_env(const char *key, const char *value, uint8_t flags) {
+    FlashErrCode result = FLASH_NO_ERR;
+
+#ifdef FLASH_ENV_USING_DEFAULT_OVERLAY
+    result = set_overlay_env(key, value, flags);
+#else
     /* if ENV value is empty, delete it */
     if (*value == NULL) {
         result = del_env(key);
@@ -414,11 +870,14 @@ FlashErrCode flash_set_env(const char *key, const char *value) {
             result = del_env(key);
         }
         if (result == FLASH_NO_ERR) {
-            result = create_env(key, value);
+            result = create_env(key, value, flags);
         }
     }
-    /* unlock the ENV cache */
-    flash_env_unlock();
+#endif
+#ifdef FLASH_ENV_USING_CHANGE_FEED
+    /* the old ENV may be deleted even if the set failed */
+    record_env_change(key);
+#endif
 
     return result;
 }
@@ -434,40 +893,59 @@ char *flash_get_env(const char *key) {
     uint32_t *env_cache_addr = NULL;
     char *value = NULL;
 
+#ifdef FLASH_ENV_USING_KEY_CLASS
+    if ((value = find_volatile_env(key)) != NULL) {
+        return ENV_VALUE(value);
+    }
+#endif
     /* find ENV */
     env_cache_addr = find_env(key);
 
     if (env_cache_addr == NULL) {
+#ifdef FLASH_ENV_USING_DEFAULT_OVERLAY
+        const flash_env *default_env = find_default_env(key);
+        return default_env ? default_env->value : NULL;
+#else
+        return NULL;
+#endif
+    } else if (ENV_FLAGS(env_cache_addr) & ENV_FLAG_DELETED) {
         return NULL;
     }
     /* get value address */
-    value = strchr((char *) env_cache_addr, '=');
-    if (value != NULL) {
-        /* the equal sign next character is value */
-        value++;
-    }
+    value = ENV_VALUE(env_cache_addr);
+
     return value;
 }
 /**
  * Print ENV.
  */
 void flash_print_env(void) {
-    uint32_t *env_cache_data_addr = env_cache + ENV_PARAM_WORD_SIZE,
-            *env_cache_end_addr =
-            (uint32_t *) (env_cache + ENV_PARAM_WORD_SIZE + get_env_data_size() / 4);
-    uint8_t j;
-    char c;
-
-    for (; env_cache_data_addr < env_cache_end_addr; env_cache_data_addr += 1) {
-        for (j = 0; j < 4; j++) {
-            c = (*env_cache_data_addr) >> (8 * j);
-            flash_print("%c", c);
-            if (c == NULL) {
-                flash_print("\n");
-                break;
-            }
+    char *env = (char *) env_cache + ENV_PARAM_BYTE_SIZE,
+            *env_end = (char *) env_cache + flash_get_env_write_bytes();
+
+#ifdef FLASH_ENV_USING_DEFAULT_OVERLAY
+    size_t i;
+
+    /* the default ENV which isn't in cache */
+    for (i = 0; i < default_env_set_size; i++) {
+        if (find_default_env(default_env_set[i].key) && find_env(default_env_set[i].key) == NULL) {
+            flash_print("%s=%s\n", default_env_set[i].key, default_env_set[i].value);
+        }
+    }
+#endif
+
+    for (; env < env_end; env += get_env_len(env)) {
+        if (!(ENV_FLAGS(env) & ENV_FLAG_DELETED)) {
+            flash_print("%s=%s\n", ENV_KEY(env), ENV_VALUE(env));
         }
     }
+#ifdef FLASH_ENV_USING_KEY_CLASS
+    /* the volatile ENV */
+    env = (char *) env_volatile_cache;
+    for (env_end = env + env_volatile_size; env < env_end; env += get_env_len(env)) {
+        flash_print("%s=%s (volatile)\n", ENV_KEY(env), ENV_VALUE(env));
+    }
+#endif
     flash_print("\nENV size: %ld/%ld bytes, mode: normal.\n",
             flash_get_env_write_bytes(), flash_get_env_total_size());
 }
@@ -476,42 +954,1588 @@ void flash_print_env(void) {
  * Load flash ENV to ram.
  */
 void flash_load_env(void) {
-    uint32_t *env_cache_bak, env_end_addr;
+    recovered_key_num = 0;
+#ifdef FLASH_ENV_USING_EMERGENCY_FLUSH
+    env_cache_dirty = false;
+#endif
+
+#ifdef FLASH_ENV_USING_FACTORY_SNAPSHOT
+    load_saved_env();
+#else
+    load_env();
+#endif
+
+#ifdef FLASH_ENV_USING_EMERGENCY_FLUSH
+    /* the ENV which was flushed when power failed is newer than the saved ENV */
+    merge_emergency_env();
+#endif
+#ifdef FLASH_ENV_USING_CHANGE_FEED
+    /* all ENV may be changed */
+    record_env_change(NULL);
+#endif
+}
 
+/**
+ * Load the saved ENV from flash to cache. The broken ENV will be recovered and saved.
+ */
+static void load_env(void) {
+    uint32_t env_end_addr;
+    bool need_save = false;
+
+#ifdef FLASH_ENV_USING_SHARDED_MODE
+    /* the shards have their own head */
+    load_env_shards();
+    return;
+#endif
+#ifdef FLASH_ENV_USING_SLOTTED_MODE
+    /* when all slots are broken, the newest slot will be recovered as normal mode */
+    if (load_newest_slot()) {
+        return;
+    }
+#endif
     /* read ENV end address from flash */
     flash_read(get_env_system_addr() + ENV_PARAM_INDEX_END_ADDR * 4, &env_end_addr, 4);
     /* if ENV is not initialize or flash has dirty data, set default for it */
     if ((env_end_addr == 0xFFFFFFFF)
-            || (env_end_addr > env_start_addr + flash_get_env_total_size())) {
+            || (env_end_addr < get_env_data_addr())
+            || (env_end_addr > env_start_addr + flash_get_env_total_size())
+            || (env_end_addr % 4 != 0)) {
         flash_env_set_default();
     } else {
         /* set ENV end address */
         set_env_end_addr(env_end_addr);
-
-        env_cache_bak = env_cache + ENV_PARAM_WORD_SIZE;
-        /* read all ENV from flash */
-        flash_read(get_env_data_addr(), env_cache_bak, get_env_data_size());
         /* read ENV CRC code from flash */
         flash_read(get_env_system_addr() + ENV_PARAM_INDEX_DATA_CRC * 4,
                 &env_cache[ENV_PARAM_INDEX_DATA_CRC] , 4);
-        /* if ENV CRC32 check is fault, set default for it */
-        if (!env_crc_is_ok()) {
-            FLASH_INFO("Warning: ENV CRC check failed. Set it to default.\n");
-            flash_env_set_default();
+        /* read all ENV from flash and verify every ENV CRC32 code */
+        env_crc_sum = 0;
+        if (!load_env_data(get_env_data_addr(), (char *) env_cache + ENV_PARAM_BYTE_SIZE,
+                get_env_data_size()) || !env_crc_is_ok()) {
+            if (legacy_env_crc_is_ok()) {
+                /* the ENV was saved by old version, it has no ENV CRC32 code head */
+                FLASH_INFO("Upgrade the ENV which was saved by old version.\n");
+                upgrade_legacy_env();
+            } else {
+                /* if ENV CRC32 check is fault, only drop the broken ENV */
+                FLASH_INFO("Warning: ENV CRC check failed. Recover the broken ENV.\n");
+                recover_env();
+            }
+            need_save = true;
+        }
+#ifdef FLASH_ENV_USING_DEFAULT_OVERLAY
+        /* the ENV which was saved without default overlay mode has default value ENV */
+        if (drop_default_value_env()) {
+            need_save = true;
+        }
+#endif
+        if (need_save) {
+            flash_save_env();
         }
     }
 }
 
 /**
- * Save ENV to flash.
+ * Read ENV data from flash to cache by blocks. The CRC32 code of each ENV will be verified when
+ * it has been read completely, so the ENV data is only traversed once. The CRC32 code of loaded
+ * ENV will be added to the sum.
+ *
+ * @param read_addr ENV data address in flash
+ * @param env_start ENV data address in cache
+ * @param env_data_size ENV data size
+ *
+ * @return false when has broken ENV
  */
-FlashErrCode flash_save_env(void) {
+static bool load_env_data(uint32_t read_addr, char *env_start, size_t env_data_size) {
+    char *env = env_start, *read_end = env_start;
+    size_t read_size, env_len;
+    bool env_is_ok = true;
+
+    while (read_end < env_start + env_data_size) {
+        read_size = env_start + env_data_size - read_end;
+        if (read_size > ENV_LOAD_BLOCK_SIZE) {
+            read_size = ENV_LOAD_BLOCK_SIZE;
+        }
+        flash_read(read_addr, (uint32_t *) read_end, read_size);
+        read_addr += read_size;
+        read_end += read_size;
+        /* verify all complete ENV in this block, the incomplete ENV will be verified in next block */
+        while (env_is_ok && env_is_complete(env, read_end, &env_len)) {
+            if (!env_is_valid(env, read_end, &env_len)) {
+                env_is_ok = false;
+            }
+            env_crc_sum += *(uint32_t *) env;
+            env += env_len;
+        }
+    }
+
+    return env_is_ok && (env == read_end);
+}
+
+/**
+ * Check the ENV which in cache has been read completely before the end address.
+ *
+ * @param env ENV address in cache
+ * @param env_end the end address of readable cache
+ * @param env_len ENV storage length when it's complete
+ *
+ * @return true is complete
+ */
+static bool env_is_complete(const char *env, const char *env_end, size_t *env_len) {
+    if (env + ENV_HEAD_BYTE_SIZE > env_end) {
+        return false;
+    }
+    *env_len = get_env_len(env);
+
+    return env + *env_len <= env_end;
+}
+
+/**
+ * Check the ENV in cache is valid. The ENV name must be not empty, the strings must be end with
+ * '\0' and the CRC32 code must be OK.
+ *
+ * @param env ENV address in cache
+ * @param env_end the end address of ENV data
+ * @param env_len ENV storage length when it's valid
+ *
+ * @return true is valid
+ */
+static bool env_is_valid(const char *env, const char *env_end, size_t *env_len) {
+    if (!env_is_complete(env, env_end, env_len) || (ENV_KEY_LEN(env) == 0)
+            || (ENV_KEY(env)[ENV_KEY_LEN(env)] != '\0')
+            || (ENV_VALUE(env)[ENV_VALUE_LEN(env)] != '\0')) {
+        return false;
+    }
+
+    return calc_crc32(0, env + ENV_CRC_BYTE_SIZE, *env_len - ENV_CRC_BYTE_SIZE)
+            == *(uint32_t *) env;
+}
+
+/**
+ * Drop all broken ENV in cache and recover the lost default ENV.
+ * The ENV which CRC32 code is OK will be kept. When an ENV is broken, the next ENV will be
+ * found by word.
+ */
+static void recover_env(void) {
+    char *env_start = (char *) env_cache + ENV_PARAM_BYTE_SIZE, *env_end, *env, *kept_end;
+    size_t env_len, broken_size = 0;
+#ifndef FLASH_ENV_USING_DEFAULT_OVERLAY
+    size_t i;
+#endif
+
+    env_end = env_start + get_env_data_size();
+    env_crc_sum = 0;
+    for (env = kept_end = env_start; env < env_end;) {
+        if (env_is_valid(env, env_end, &env_len)) {
+            /* keep this ENV */
+            memmove(kept_end, env, env_len);
+            env_crc_sum += *(uint32_t *) kept_end;
+            kept_end += env_len;
+            env += env_len;
+        } else {
+            /* find next ENV by word */
+            broken_size += 4;
+            env += 4;
+        }
+    }
+    set_env_end_addr(get_env_data_addr() + (kept_end - env_start));
+    FLASH_INFO("Dropped %ld bytes broken ENV.\n", broken_size);
+
+#ifndef FLASH_ENV_USING_DEFAULT_OVERLAY
+    /* recover the lost default ENV, it isn't necessary in default overlay mode */
+    for (i = 0; i < default_env_set_size; i++) {
+#ifdef FLASH_ENV_USING_KEY_CLASS
+        /* the volatile default ENV isn't in cache */
+        if (default_env_set[i].env_class == FLASH_ENV_VOLATILE) {
+            continue;
+        }
+        if (find_env(default_env_set[i].key) == NULL && create_env(default_env_set[i].key,
+                default_env_set[i].value, ENV_CLASS_FLAGS(default_env_set[i].env_class)) == FLASH_NO_ERR) {
+#else
+        if (find_env(default_env_set[i].key) == NULL
+                && create_env(default_env_set[i].key, default_env_set[i].value, 0) == FLASH_NO_ERR) {
+#endif
+            FLASH_INFO("Recovered ENV \"%s\" to default value.\n", default_env_set[i].key);
+            if (recovered_key_num < ENV_RECOVERED_KEY_MAX) {
+                recovered_keys[recovered_key_num] = default_env_set[i].key;
+            }
+            recovered_key_num++;
+        }
+    }
+#endif
+}
+
+/**
+ * Get the default ENV name which was recovered by last load.
+ *
+ * @param keys the buffer to store recovered ENV name
+ * @param size the keys buffer size
+ *
+ * @return total recovered default ENV number
+ */
+size_t flash_get_env_recovered_keys(const char **keys, size_t size) {
+    size_t i;
+
+    for (i = 0; (i < size) && (i < recovered_key_num) && (i < ENV_RECOVERED_KEY_MAX); i++) {
+        keys[i] = recovered_keys[i];
+    }
+
+    return recovered_key_num;
+}
+
+/**
+ * Check the ENV CRC32 which was saved by old version. The old version ENV storage format is
+ * key=value\0, the data section CRC32 code is calculated by the whole data section.
+ *
+ * @return true is ok
+ */
+static bool legacy_env_crc_is_ok(void) {
+    uint32_t crc32;
+
+    /* the data section CRC32 code which is calculated by the whole data section */
+    crc32 = calc_crc32(0, &env_cache[ENV_PARAM_INDEX_END_ADDR], 4);
+    crc32 = calc_crc32(crc32, (char *) env_cache + ENV_PARAM_BYTE_SIZE, get_env_data_size());
+
+    return crc32 == env_cache[ENV_PARAM_INDEX_DATA_CRC];
+}
+
+/**
+ * Add CRC32 code and length head for all ENV which was saved by old version.
+ * The ENV will be moved from the last to the first. If the cache has no enough space for all
+ * head, the last ENV will be dropped.
+ */
+static void upgrade_legacy_env(void) {
+    char *env_start = (char *) env_cache + ENV_PARAM_BYTE_SIZE, *env_end, *env, *new_env_end, *equal;
+    size_t env_len, env_num = 0, key_len;
+
+    /* count all ENV which can be upgraded */
+    env_end = env_start + get_env_data_size();
+    for (env = env_start; env < env_end; env += env_len) {
+        env_len = (strlen(env) + 1 + 3) / 4 * 4;
+        if (ENV_PARAM_BYTE_SIZE + (env + env_len - env_start) + (env_num + 1) * ENV_HEAD_BYTE_SIZE
+                > flash_get_env_total_size()) {
+            FLASH_INFO("Warning: No space to upgrade all ENV. The last ENV will be dropped.\n");
+            env_end = env;
+            break;
+        }
+        env_num++;
+    }
+    set_env_end_addr(get_env_data_addr() + (env_end - env_start) + env_num * ENV_HEAD_BYTE_SIZE);
+
+    /* move all ENV from the last to the first */
+    env_crc_sum = 0;
+    new_env_end = env_start + get_env_data_size();
+    for (env = env_end; env > env_start; env_end = env) {
+        /* skip the word alignment part and '\0', then find this ENV start address */
+        while ((env > env_start) && (*(env - 1) == '\0')) {
+            env--;
+        }
+        while ((env > env_start) && (*(env - 1) != '\0')) {
+            env--;
+        }
+        env_len = env_end - env;
+        new_env_end -= env_len;
+        memmove(new_env_end, env, env_len);
+        /* the key=value\0 is changed to key\0value\0 */
+        equal = strchr(new_env_end, '=');
+        key_len = equal ? (size_t) (equal - new_env_end) : strlen(new_env_end);
+        if (equal) {
+            *equal = '\0';
+        }
+        new_env_end -= ENV_HEAD_BYTE_SIZE;
+        ((uint32_t *) new_env_end)[1] = ENV_MAKE_HEAD(key_len,
+                equal ? strlen(equal + 1) : 0, 0);
+        *(uint32_t *) new_env_end = calc_crc32(0, new_env_end + ENV_CRC_BYTE_SIZE,
+                env_len + ENV_CRC_BYTE_SIZE);
+        env_crc_sum += *(uint32_t *) new_env_end;
+    }
+}
+
+#ifdef FLASH_ENV_USING_DEFAULT_OVERLAY
+
+/**
+ * Find the default ENV in default ENV set. The volatile default ENV isn't included.
+ *
+ * @param key ENV name
+ *
+ * @return default ENV, NULL when not found
+ */
+static const flash_env *find_default_env(const char *key) {
+    size_t i;
+
+    for (i = 0; i < default_env_set_size; i++) {
+        if (!strcmp(default_env_set[i].key, key)) {
+#ifdef FLASH_ENV_USING_KEY_CLASS
+            if (default_env_set[i].env_class == FLASH_ENV_VOLATILE) {
+                return NULL;
+            }
+#endif
+            return &default_env_set[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Set an ENV in default overlay mode. Only the ENV which is different from default is cached.
+ * When a default ENV is deleted, a deleted record will be cached.
+ *
+ * @param key ENV name
+ * @param value ENV value, delete it when it's empty
+ * @param flags ENV flags
+ *
+ * @return result
+ */
+static FlashErrCode set_overlay_env(const char *key, const char *value, uint8_t flags) {
     FlashErrCode result = FLASH_NO_ERR;
+    const flash_env *default_env = find_default_env(key);
+    uint32_t *env = find_env(key);
 
-    /* calculate and cache CRC32 code */
-    env_cache[ENV_PARAM_INDEX_DATA_CRC] = calc_env_crc();
+    if (*value == NULL) {
+        if (!env && !default_env) {
+            /* not found */
+            return del_env(key);
+        } else if (env && (ENV_FLAGS(env) & ENV_FLAG_DELETED)) {
+            FLASH_INFO("Not find \"%s\" in ENV.\n", key);
+            return FLASH_ENV_NAME_ERR;
+        }
+        if (env) {
+            result = del_env(key);
+        }
+        if (result == FLASH_NO_ERR && default_env) {
+            result = write_env(key, "", ENV_FLAG_DELETED);
+        }
+    } else {
+        if (env) {
+            result = del_env(key);
+        }
+        /* the ENV which is same as default will not be cached */
+        if (result == FLASH_NO_ERR && !(default_env && !strcmp(default_env->value, value))) {
+            result = create_env(key, value, flags);
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Drop the ENV which value is same as default from cache.
+ *
+ * @return true when some ENV has been dropped
+ */
+static bool drop_default_value_env(void) {
+    char *env_start = (char *) env_cache + ENV_PARAM_BYTE_SIZE, *env_end, *env, *kept_end;
+    const flash_env *default_env;
+    size_t env_len;
+    bool dropped = false;
+
+    env_end = env_start + get_env_data_size();
+    for (env = kept_end = env_start; env < env_end; env += env_len) {
+        env_len = get_env_len(env);
+        default_env = find_default_env(ENV_KEY(env));
+        if (default_env && !(ENV_FLAGS(env) & ENV_FLAG_DELETED)
+                && !strcmp(default_env->value, ENV_VALUE(env))) {
+            env_crc_sum -= *(uint32_t *) env;
+            dropped = true;
+        } else {
+            memmove(kept_end, env, env_len);
+            kept_end += env_len;
+        }
+    }
+    set_env_end_addr(get_env_data_addr() + (kept_end - env_start));
+
+    return dropped;
+}
+#endif /* FLASH_ENV_USING_DEFAULT_OVERLAY */
+
+#ifdef FLASH_ENV_USING_KEY_CLASS
+/**
+ * Set an ENV with key class. The volatile ENV is only set in volatile cache. The write-through
+ * ENV will be saved after it has been set.
+ *
+ * @param key ENV name
+ * @param value ENV value, delete it when it's empty
+ * @param env_class ENV key class
+ *
+ * @return result
+ */
+FlashErrCode flash_set_env_with_class(const char *key, const char *value, FlashEnvClass env_class) {
+    FlashErrCode result = FLASH_NO_ERR;
+
+    /* lock the ENV cache */
+    flash_env_lock();
+
+    result = set_class_env(key, value, env_class);
+
+    /* unlock the ENV cache */
+    flash_env_unlock();
+
+    return result;
+}
+
+/**
+ * Get the key class of ENV. The class of new ENV is same as default ENV.
+ *
+ * @param key ENV name
+ *
+ * @return ENV key class
+ */
+static FlashEnvClass get_env_class(const char *key) {
+    uint32_t *env;
+    size_t i;
+
+    if (find_volatile_env(key)) {
+        return FLASH_ENV_VOLATILE;
+    } else if ((env = find_env(key)) != NULL) {
+        return (ENV_FLAGS(env) & ENV_FLAG_WRITE_THROUGH) ? FLASH_ENV_WRITE_THROUGH : FLASH_ENV_WRITE_BACK;
+    }
+    for (i = 0; i < default_env_set_size; i++) {
+        if (!strcmp(default_env_set[i].key, key)) {
+            return default_env_set[i].env_class;
+        }
+    }
+
+    return FLASH_ENV_WRITE_BACK;
+}
+
+/**
+ * Set an ENV in cache by key class. The ENV which has same name in other class will be deleted.
+ *
+ * @param key ENV name
+ * @param value ENV value, delete it when it's empty
+ * @param env_class ENV key class
+ *
+ * @return result
+ */
+static FlashErrCode set_class_env(const char *key, const char *value, FlashEnvClass env_class) {
+    FlashErrCode result = FLASH_NO_ERR;
+    uint32_t *env;
+
+    if (env_class == FLASH_ENV_VOLATILE) {
+        if ((env = find_env(key)) != NULL && !(ENV_FLAGS(env) & ENV_FLAG_DELETED)) {
+            del_env(key);
+#ifdef FLASH_ENV_USING_CHANGE_FEED
+            record_env_change(key);
+#endif
+        }
+        return set_volatile_env(key, value);
+    }
+
+    if (find_volatile_env(key)) {
+        set_volatile_env(key, "");
+    }
+    result = set_env(key, value, ENV_CLASS_FLAGS(env_class));
+    /* the write-through ENV is saved immediately. In sharded mode only its shard is saved, otherwise the
+     * whole ENV is saved, so the waiting write-back changes are saved with it. */
+    if (result == FLASH_NO_ERR && env_class == FLASH_ENV_WRITE_THROUGH) {
+#ifdef FLASH_ENV_USING_SHARDED_MODE
+        result = save_env_shard(get_env_shard(key, strlen(key)));
+        if (result == FLASH_NO_ERR) {
+            env_shard_dirty[get_env_shard(key, strlen(key))] = false;
+        }
+#else
+        result = flash_save_env();
+#endif
+    }
+
+    return result;
+}
+
+/**
+ * Find the volatile ENV.
+ *
+ * @param key ENV name
+ *
+ * @return ENV address in volatile cache, NULL when not found
+ */
+static char *find_volatile_env(const char *key) {
+    char *env = (char *) env_volatile_cache, *env_end = env + env_volatile_size;
+    size_t key_len = strlen(key);
+
+    for (; env < env_end; env += get_env_len(env)) {
+        if ((ENV_KEY_LEN(env) == key_len) && !memcmp(ENV_KEY(env), key, key_len)) {
+            return env;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Set a volatile ENV. If it value is empty, delete it.
+ *
+ * @param key ENV name
+ * @param value ENV value
+ *
+ * @return result
+ */
+static FlashErrCode set_volatile_env(const char *key, const char *value) {
+    char *env = find_volatile_env(key);
+    size_t key_len = strlen(key), value_len = strlen(value), env_len;
+
+    if (*key == NULL || strchr(key, '=') || key_len > ENV_KEY_LEN_MAX) {
+        FLASH_INFO("Flash ENV name is invalid.\n");
+        return FLASH_ENV_NAME_ERR;
+    }
+    if (*value == NULL && !env) {
+        FLASH_INFO("Not find \"%s\" in ENV.\n", key);
+        return FLASH_ENV_NAME_ERR;
+    }
+    env_len = ENV_STORAGE_LEN(key_len, value_len);
+    if (*value != NULL && (value_len > ENV_VALUE_LEN_MAX || env_volatile_size + env_len
+            - (env ? get_env_len(env) : 0) > FLASH_ENV_VOLATILE_SIZE)) {
+        return FLASH_ENV_FULL;
+    }
+    /* delete the old ENV */
+    if (env) {
+        env_volatile_size -= get_env_len(env);
+        memmove(env, env + get_env_len(env), (char *) env_volatile_cache + env_volatile_size - env);
+    }
+    if (*value != NULL) {
+        /* the volatile ENV has no CRC32 code */
+        env = (char *) env_volatile_cache + env_volatile_size;
+        memset(env, 0, env_len);
+        ((uint32_t *) env)[1] = ENV_MAKE_HEAD(key_len, value_len, 0);
+        memcpy(ENV_KEY(env), key, key_len);
+        memcpy(ENV_VALUE(env), value, value_len);
+        env_volatile_size += env_len;
+    }
+
+    return FLASH_NO_ERR;
+}
+
+/**
+ * Set all volatile ENV to default.
+ */
+static void set_volatile_default_env(void) {
+    size_t i;
+
+    env_volatile_size = 0;
+    for (i = 0; i < default_env_set_size; i++) {
+        if (default_env_set[i].env_class == FLASH_ENV_VOLATILE) {
+            set_volatile_env(default_env_set[i].key, default_env_set[i].value);
+        }
+    }
+}
+#endif /* FLASH_ENV_USING_KEY_CLASS */
+
+#ifdef FLASH_ENV_USING_SLOTTED_MODE
+/**
+ * Get the next slot address in the slotted area. The next slot is in the next sector when the
+ * sector is full.
+ *
+ * @param area_addr slotted area start address
+ * @param area_size slotted area size
+ * @param erase_min_size the minimum size of flash erasure
+ * @param slot_addr current slot address
+ *
+ * @return the next slot address
+ */
+static uint32_t get_area_next_slot_addr(uint32_t area_addr, size_t area_size, size_t erase_min_size,
+        uint32_t slot_addr) {
+    uint32_t sec_addr = slot_addr - (slot_addr - area_addr) % erase_min_size;
+
+    slot_addr += FLASH_USER_SETTING_ENV_SIZE;
+    if (slot_addr + FLASH_USER_SETTING_ENV_SIZE > sec_addr + erase_min_size) {
+        slot_addr = sec_addr + erase_min_size;
+        if (slot_addr >= area_addr + area_size) {
+            slot_addr = area_addr;
+        }
+    }
+
+    return slot_addr;
+}
+
+/**
+ * Get the next slot address in the ENV area.
+ *
+ * @param slot_addr current slot address
+ *
+ * @return the next slot address
+ */
+static uint32_t get_next_slot_addr(uint32_t slot_addr) {
+    return get_area_next_slot_addr(env_area_addr, env_area_size, env_erase_min_size, slot_addr);
+}
+
+/**
+ * Find the newest used slot which save sequence is less than the limit.
+ *
+ * @param area_addr slotted area start address
+ * @param area_size slotted area size
+ * @param erase_min_size the minimum size of flash erasure
+ * @param seq_limit save sequence limit
+ * @param seq the found slot save sequence
+ *
+ * @return the found slot address, 0 when not found
+ */
+static uint32_t find_newest_slot(uint32_t area_addr, size_t area_size, size_t erase_min_size,
+        uint32_t seq_limit, uint32_t *seq) {
+    uint32_t slot_addr = area_addr, newest_addr = 0, param[ENV_PARAM_WORD_SIZE];
+
+    *seq = 0;
+    do {
+        flash_read(slot_addr, param, ENV_PARAM_BYTE_SIZE);
+        if (param[ENV_PARAM_INDEX_END_ADDR] != 0xFFFFFFFF && param[ENV_PARAM_INDEX_SAVE_SEQ] < seq_limit
+                && param[ENV_PARAM_INDEX_SAVE_SEQ] >= *seq) {
+            newest_addr = slot_addr;
+            *seq = param[ENV_PARAM_INDEX_SAVE_SEQ];
+        }
+        slot_addr = get_area_next_slot_addr(area_addr, area_size, erase_min_size, slot_addr);
+    } while (slot_addr != area_addr);
+
+    return newest_addr;
+}
+
+/**
+ * Load the newest valid slot to cache. The slots are verified from newest to oldest, so the
+ * broken slot which was interrupted when save will be skipped.
+ * When there is no valid slot, the ENV start address is the newest used slot.
+ *
+ * @return true when a valid slot has been loaded
+ */
+static bool load_newest_slot(void) {
+    uint32_t slot_addr, newest_addr, seq, max_seq = 0, end_addr;
+    bool loaded = false;
+
+    /* the slot which save sequence is unwritten will be skipped */
+    newest_addr = slot_addr = find_newest_slot(env_area_addr, env_area_size, env_erase_min_size, 0xFFFFFFFF,
+            &max_seq);
+    for (seq = max_seq; slot_addr;
+            slot_addr = find_newest_slot(env_area_addr, env_area_size, env_erase_min_size, seq, &seq)) {
+        flash_read(slot_addr, env_cache, ENV_PARAM_BYTE_SIZE);
+        end_addr = get_env_end_addr();
+        if ((end_addr >= slot_addr + ENV_PARAM_BYTE_SIZE)
+                && (end_addr <= slot_addr + flash_get_env_total_size())
+                && (end_addr % 4 == 0)) {
+            env_start_addr = slot_addr;
+            env_crc_sum = 0;
+            if (load_env_data(get_env_data_addr(), (char *) env_cache + ENV_PARAM_BYTE_SIZE,
+                    get_env_data_size()) && env_crc_is_ok()) {
+                loaded = true;
+                break;
+            }
+        }
+    }
+    if (newest_addr == 0) {
+        /* all slots are empty */
+        env_start_addr = env_area_addr;
+        env_next_slot_addr = env_area_addr;
+    } else {
+        if (!loaded) {
+            /* the newest used slot will be recovered */
+            env_start_addr = newest_addr;
+        }
+        /* the next slot must be empty, the sector will be erased when its first slot is used */
+        env_next_slot_addr = get_next_slot_addr(env_start_addr);
+        while ((env_next_slot_addr - env_area_addr) % env_erase_min_size != 0) {
+            flash_read(env_next_slot_addr, &end_addr, 4);
+            if (end_addr == 0xFFFFFFFF) {
+                break;
+            }
+            env_next_slot_addr = get_next_slot_addr(env_next_slot_addr);
+        }
+    }
+    /* the next save sequence is greater than all used slots */
+    env_cache[ENV_PARAM_INDEX_SAVE_SEQ] = max_seq;
+
+    return loaded;
+}
+#endif /* FLASH_ENV_USING_SLOTTED_MODE */
+
+#ifdef FLASH_ENV_USING_SHARDED_MODE
+/**
+ * Get the shard index of ENV by the CRC32 code of its name.
+ *
+ * @param key ENV name
+ * @param key_len ENV name length
+ *
+ * @return shard index
+ */
+static size_t get_env_shard(const char *key, size_t key_len) {
+    return calc_crc32(0, key, key_len) % FLASH_ENV_SHARD_NUM;
+}
+
+/**
+ * Calculate every shard ENV data size by cache.
+ *
+ * @param set_dirty all shards will be set dirty when it's true
+ */
+static void update_env_shards(bool set_dirty) {
+    char *env = (char *) env_cache + ENV_PARAM_BYTE_SIZE,
+            *env_end = (char *) env_cache + flash_get_env_write_bytes();
+    size_t i;
+
+    for (i = 0; i < FLASH_ENV_SHARD_NUM; i++) {
+        env_shard_data_size[i] = 0;
+        if (set_dirty) {
+            env_shard_dirty[i] = true;
+        }
+    }
+    for (; env < env_end; env += get_env_len(env)) {
+        env_shard_data_size[get_env_shard(ENV_KEY(env), ENV_KEY_LEN(env))] += get_env_len(env);
+    }
+}
+
+/**
+ * Load all shards to cache one by one. The broken shard will be recovered and saved.
+ */
+static void load_env_shards(void) {
+    char *env_start = (char *) env_cache + ENV_PARAM_BYTE_SIZE, *env_end = env_start;
+    uint32_t shard_addr, head[ENV_SHARD_HEAD_WORD_SIZE], crc_sum;
+    size_t i, blank_num = 0;
+    bool env_is_ok = true;
+
+    env_crc_sum = 0;
+    for (i = 0; i < FLASH_ENV_SHARD_NUM; i++) {
+        shard_addr = env_start_addr + i * env_shard_area_size;
+        flash_read(shard_addr, head, ENV_SHARD_HEAD_BYTE_SIZE);
+        env_shard_dirty[i] = false;
+        if (head[ENV_SHARD_HEAD_INDEX_DATA_SIZE] == 0xFFFFFFFF) {
+            blank_num++;
+            env_shard_dirty[i] = true;
+            env_is_ok = false;
+            continue;
+        }
+        /* the shard which head is wrong or it can't be cached will be dropped */
+        if ((head[ENV_SHARD_HEAD_INDEX_DATA_SIZE] % 4 != 0)
+                || (head[ENV_SHARD_HEAD_INDEX_DATA_SIZE] > env_shard_area_size - ENV_SHARD_HEAD_BYTE_SIZE)
+                || (head[ENV_SHARD_HEAD_INDEX_INFO] != ENV_SHARD_INFO(i))
+                || (env_end + head[ENV_SHARD_HEAD_INDEX_DATA_SIZE]
+                        > (char *) env_cache + flash_get_env_total_size())) {
+            env_shard_dirty[i] = true;
+            env_is_ok = false;
+            continue;
+        }
+        crc_sum = env_crc_sum;
+        if (!load_env_data(shard_addr + ENV_SHARD_HEAD_BYTE_SIZE, env_end, head[ENV_SHARD_HEAD_INDEX_DATA_SIZE])
+                || calc_crc32(env_crc_sum - crc_sum, head, ENV_SHARD_HEAD_INDEX_CRC * 4)
+                        != head[ENV_SHARD_HEAD_INDEX_CRC]) {
+            env_shard_dirty[i] = true;
+            env_is_ok = false;
+        }
+        env_end += head[ENV_SHARD_HEAD_INDEX_DATA_SIZE];
+    }
+    set_env_end_addr(get_env_data_addr() + (env_end - env_start));
+
+    /* if ENV is not initialize, set default for it */
+    if (blank_num == FLASH_ENV_SHARD_NUM) {
+        flash_env_set_default();
+        return;
+    }
+    update_env_shards(false);
+    if (!env_is_ok) {
+        /* only drop the broken ENV, the lost default ENV will be recovered */
+        FLASH_INFO("Warning: ENV shard check failed. Recover the broken ENV.\n");
+        recover_env();
+        update_env_shards(false);
+    }
+#ifdef FLASH_ENV_USING_DEFAULT_OVERLAY
+    /* the ENV which was saved without default overlay mode has default value ENV */
+    if (drop_default_value_env()) {
+        update_env_shards(true);
+    }
+#endif
+    /* only the dirty shards will be saved */
+    flash_save_env();
+}
+
+/**
+ * Save a shard to flash. The continuous ENV of this shard in cache will be written by once.
+ *
+ * @param shard shard index
+ *
+ * @return result
+ */
+static FlashErrCode save_env_shard(size_t shard) {
+    FlashErrCode result = FLASH_NO_ERR;
+    char *env_start = (char *) env_cache + ENV_PARAM_BYTE_SIZE,
+            *env_end = (char *) env_cache + flash_get_env_write_bytes(), *env, *run_end;
+    uint32_t shard_addr = env_start_addr + shard * env_shard_area_size, write_addr,
+            head[ENV_SHARD_HEAD_WORD_SIZE], crc_sum = 0;
+
+    /* make the shard head */
+    for (env = env_start; env < env_end; env += get_env_len(env)) {
+        if (get_env_shard(ENV_KEY(env), ENV_KEY_LEN(env)) == shard) {
+            crc_sum += *(uint32_t *) env;
+        }
+    }
+    head[ENV_SHARD_HEAD_INDEX_DATA_SIZE] = env_shard_data_size[shard];
+    head[ENV_SHARD_HEAD_INDEX_INFO] = ENV_SHARD_INFO(shard);
+    head[ENV_SHARD_HEAD_INDEX_CRC] = calc_crc32(crc_sum, head, ENV_SHARD_HEAD_INDEX_CRC * 4);
+
+    /* erase the shard */
+    result = flash_erase(shard_addr, ENV_SHARD_HEAD_BYTE_SIZE + head[ENV_SHARD_HEAD_INDEX_DATA_SIZE]);
+    if (result != FLASH_NO_ERR) {
+        FLASH_INFO("Warning: Erased ENV shard %d fault!\n", shard);
+        return result;
+    }
+
+    /* write the shard head and ENV to flash */
+    result = flash_write(shard_addr, head, ENV_SHARD_HEAD_BYTE_SIZE);
+    write_addr = shard_addr + ENV_SHARD_HEAD_BYTE_SIZE;
+    for (env = env_start; (result == FLASH_NO_ERR) && (env < env_end); env = run_end) {
+        for (run_end = env; (run_end < env_end)
+                && (get_env_shard(ENV_KEY(run_end), ENV_KEY_LEN(run_end)) == shard);
+                run_end += get_env_len(run_end));
+        if (run_end == env) {
+            run_end = env + get_env_len(env);
+        } else {
+            result = flash_write(write_addr, (uint32_t *) env, run_end - env);
+            write_addr += run_end - env;
+        }
+    }
+    if (result == FLASH_NO_ERR) {
+        FLASH_INFO("Saved ENV shard %d OK.\n", shard);
+    } else {
+        FLASH_INFO("Warning: Saved ENV shard %d fault!\n", shard);
+    }
+
+    return result;
+}
+#endif /* FLASH_ENV_USING_SHARDED_MODE */
+
+#ifdef FLASH_ENV_USING_EMERGENCY_FLUSH
+/**
+ * Flash ENV emergency reserve area initialize. It must be initialized before flash_env_init.
+ *
+ * @param start_addr reserve area start address in flash
+ * @param area_size reserve area size, it can save the whole ENV data section and head
+ * @param erase_min_size the minimum size of flash erasure
+ *
+ * @return result
+ */
+FlashErrCode flash_env_emergency_init(uint32_t start_addr, size_t area_size, size_t erase_min_size) {
+    FLASH_ASSERT(start_addr);
+    FLASH_ASSERT(area_size % erase_min_size == 0);
+    FLASH_ASSERT(area_size >= ENV_EMERGENCY_HEAD_BYTE_SIZE + FLASH_USER_SETTING_ENV_SIZE - ENV_PARAM_BYTE_SIZE);
+
+    env_emergency_addr = start_addr;
+    env_emergency_size = area_size;
+
+    return FLASH_NO_ERR;
+}
+
+/**
+ * Flush the changed ENV in cache to the pre-erased reserve area without erase. It is designed
+ * for power-fail interrupt, so the ENV cache isn't locked. The flushed ENV will be merged when
+ * next load. It only can be flushed once until next load.
+ *
+ * @return result
+ */
+FlashErrCode flash_env_emergency_flush(void) {
+    FlashErrCode result = FLASH_NO_ERR;
+    uint32_t head[ENV_EMERGENCY_HEAD_WORD_SIZE];
+#ifdef FLASH_ENV_USING_SHARDED_MODE
+    bool dirty = false;
+    size_t i;
+
+    for (i = 0; i < FLASH_ENV_SHARD_NUM; i++) {
+        dirty = dirty || env_shard_dirty[i];
+    }
+#else
+    bool dirty = env_cache_dirty;
+#endif
+
+    FLASH_ASSERT(env_emergency_addr);
+
+    if (!dirty) {
+        return result;
+    }
+    /* the reserve area has been written */
+    if (!env_emergency_ready) {
+        return FLASH_WRITE_ERR;
+    }
+    env_emergency_ready = false;
+
+    /* the head is written first, so the reserve area is blank when head is blank */
+    head[ENV_EMERGENCY_HEAD_INDEX_MAGIC] = ENV_EMERGENCY_MAGIC;
+    head[ENV_EMERGENCY_HEAD_INDEX_DATA_SIZE] = get_env_data_size();
+    head[ENV_EMERGENCY_HEAD_INDEX_CRC] = calc_crc32(env_crc_sum, &head[ENV_EMERGENCY_HEAD_INDEX_DATA_SIZE], 4);
+    result = flash_write(env_emergency_addr, head, ENV_EMERGENCY_HEAD_BYTE_SIZE);
+    if (result == FLASH_NO_ERR) {
+        result = flash_write(env_emergency_addr + ENV_EMERGENCY_HEAD_BYTE_SIZE,
+                (uint32_t *) ((char *) env_cache + ENV_PARAM_BYTE_SIZE), get_env_data_size());
+    }
+
+    return result;
+}
+
+/**
+ * Check the emergency reserve area is blank.
+ *
+ * @return true is blank
+ */
+static bool emergency_area_is_blank(void) {
+    uint32_t buf[ENV_LOAD_BLOCK_SIZE / 4], read_addr;
+    size_t i;
+
+    for (read_addr = env_emergency_addr; read_addr < env_emergency_addr + env_emergency_size;
+            read_addr += ENV_LOAD_BLOCK_SIZE) {
+        flash_read(read_addr, buf, ENV_LOAD_BLOCK_SIZE);
+        for (i = 0; i < ENV_LOAD_BLOCK_SIZE / 4; i++) {
+            if (buf[i] != 0xFFFFFFFF) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Merge the ENV which was flushed to the reserve area when power failed. The merged ENV will be
+ * saved, then the reserve area will be erased for next flush.
+ */
+static void merge_emergency_env(void) {
+    uint32_t head[ENV_EMERGENCY_HEAD_WORD_SIZE];
+
+    env_emergency_ready = false;
+    flash_read(env_emergency_addr, head, ENV_EMERGENCY_HEAD_BYTE_SIZE);
+    if (head[ENV_EMERGENCY_HEAD_INDEX_MAGIC] == 0xFFFFFFFF && emergency_area_is_blank()) {
+        env_emergency_ready = true;
+        return;
+    }
+
+    if ((head[ENV_EMERGENCY_HEAD_INDEX_MAGIC] == ENV_EMERGENCY_MAGIC)
+            && (head[ENV_EMERGENCY_HEAD_INDEX_DATA_SIZE] % 4 == 0)
+            && (head[ENV_EMERGENCY_HEAD_INDEX_DATA_SIZE] <= flash_get_env_total_size() - ENV_PARAM_BYTE_SIZE)) {
+        env_crc_sum = 0;
+        if (load_env_data(env_emergency_addr + ENV_EMERGENCY_HEAD_BYTE_SIZE,
+                (char *) env_cache + ENV_PARAM_BYTE_SIZE, head[ENV_EMERGENCY_HEAD_INDEX_DATA_SIZE])
+                && calc_crc32(env_crc_sum, &head[ENV_EMERGENCY_HEAD_INDEX_DATA_SIZE], 4)
+                        == head[ENV_EMERGENCY_HEAD_INDEX_CRC]) {
+            set_env_end_addr(get_env_data_addr() + head[ENV_EMERGENCY_HEAD_INDEX_DATA_SIZE]);
+#ifdef FLASH_ENV_USING_SHARDED_MODE
+            update_env_shards(true);
+#endif
+            FLASH_INFO("Merged the ENV which was flushed when power failed.\n");
+            /* the reserve area is kept when save failed, it will be merged again */
+            if (flash_save_env() != FLASH_NO_ERR) {
+                return;
+            }
+        } else {
+            /* the flush was interrupted, the saved ENV will be loaded again */
+            FLASH_INFO("Warning: The emergency flushed ENV is broken. Drop it.\n");
+#ifdef FLASH_ENV_USING_FACTORY_SNAPSHOT
+            load_saved_env();
+#else
+            load_env();
+#endif
+        }
+    }
+
+    if (flash_erase(env_emergency_addr, env_emergency_size) == FLASH_NO_ERR) {
+        env_emergency_ready = true;
+    }
+}
+#endif /* FLASH_ENV_USING_EMERGENCY_FLUSH */
+
+#ifdef FLASH_ENV_USING_FACTORY_SNAPSHOT
+/**
+ * Flash ENV factory snapshot initialize. It must be initialized before ENV.
+ *
+ * @param start_addr factory snapshot area start address
+ * @param area_size factory snapshot area size, it contains snapshot sectors and a mark sector
+ * @param erase_min_size the minimum size of flash erasure
+ *
+ * @return result
+ */
+FlashErrCode flash_env_factory_init(uint32_t start_addr, size_t area_size, size_t erase_min_size) {
+    uint32_t mark = 0xFFFFFFFF, read_mark;
+
+    FLASH_ASSERT(start_addr);
+    FLASH_ASSERT(area_size % erase_min_size == 0);
+    FLASH_ASSERT(area_size >= ENV_FACTORY_HEAD_BYTE_SIZE + FLASH_USER_SETTING_ENV_SIZE - ENV_PARAM_BYTE_SIZE
+            + erase_min_size);
+
+    env_factory_addr = start_addr;
+    env_factory_size = area_size - erase_min_size;
+    env_factory_mark_sec_addr = start_addr + env_factory_size;
+    env_factory_mark_sec_size = erase_min_size;
+
+    /* the last written mark is the factory reset status */
+    for (env_factory_mark_addr = env_factory_mark_sec_addr;
+            env_factory_mark_addr < env_factory_mark_sec_addr + env_factory_mark_sec_size;
+            env_factory_mark_addr += 4) {
+        flash_read(env_factory_mark_addr, &read_mark, 4);
+        if (read_mark == 0xFFFFFFFF) {
+            break;
+        }
+        mark = read_mark;
+    }
+    env_factory_reset = (mark == ENV_FACTORY_MARK_RESET);
+
+    return FLASH_NO_ERR;
+}
+
+/**
+ * Save the ENV in cache as factory snapshot. It's used when provisioning, the snapshot can be
+ * saved only once.
+ *
+ * @return result
+ */
+FlashErrCode flash_env_save_factory(void) {
+    FlashErrCode result = FLASH_NO_ERR;
+    uint32_t head[ENV_FACTORY_HEAD_WORD_SIZE];
+
+    FLASH_ASSERT(env_factory_addr);
+
+    /* lock the ENV cache */
+    flash_env_lock();
+
+    flash_read(env_factory_addr, head, ENV_FACTORY_HEAD_BYTE_SIZE);
+    if (head[ENV_FACTORY_HEAD_INDEX_MAGIC] != 0xFFFFFFFF) {
+        FLASH_INFO("Warning: The factory snapshot has been saved.\n");
+        result = FLASH_WRITE_ERR;
+        goto __exit;
+    }
+    /* the head is written last, so the snapshot is invalid when it isn't complete */
+    result = flash_erase(env_factory_addr, env_factory_size);
+    if (result == FLASH_NO_ERR) {
+        result = flash_write(env_factory_addr + ENV_FACTORY_HEAD_BYTE_SIZE,
+                (uint32_t *) ((char *) env_cache + ENV_PARAM_BYTE_SIZE), get_env_data_size());
+    }
+    if (result == FLASH_NO_ERR) {
+        head[ENV_FACTORY_HEAD_INDEX_MAGIC] = ENV_FACTORY_MAGIC;
+        head[ENV_FACTORY_HEAD_INDEX_DATA_SIZE] = get_env_data_size();
+        head[ENV_FACTORY_HEAD_INDEX_CRC] = calc_crc32(env_crc_sum, &head[ENV_FACTORY_HEAD_INDEX_DATA_SIZE], 4);
+        result = flash_write(env_factory_addr, head, ENV_FACTORY_HEAD_BYTE_SIZE);
+    }
+    if (result == FLASH_NO_ERR) {
+        FLASH_INFO("Saved factory snapshot OK.\n");
+    }
+
+__exit:
+    /* unlock the ENV cache */
+    flash_env_unlock();
+
+    return result;
+}
+
+/**
+ * Reset ENV to factory snapshot. It only writes a reset mark, the snapshot is loaded to cache and
+ * it will be saved as ENV by next save. The default ENV will be set when the snapshot isn't saved.
+ *
+ * @return result
+ */
+FlashErrCode flash_env_reset_factory(void) {
+    FlashErrCode result = FLASH_NO_ERR;
+    uint32_t head[ENV_FACTORY_HEAD_WORD_SIZE];
+
+    FLASH_ASSERT(env_factory_addr);
+
+    /* lock the ENV cache */
+    flash_env_lock();
+
+    if (!factory_snapshot_is_valid(head)) {
+        /* unlock the ENV cache */
+        flash_env_unlock();
+        return flash_env_set_default();
+    }
+    if (!env_factory_reset) {
+        result = write_factory_mark(ENV_FACTORY_MARK_RESET);
+        env_factory_reset = (result == FLASH_NO_ERR);
+    }
+    if (result == FLASH_NO_ERR && !load_factory_env()) {
+        /* unlock the ENV cache */
+        flash_env_unlock();
+        return flash_env_set_default();
+    }
+#ifdef FLASH_ENV_USING_KEY_CLASS
+    if (result == FLASH_NO_ERR) {
+        set_volatile_default_env();
+    }
+#endif
+#ifdef FLASH_ENV_USING_CHANGE_FEED
+    if (result == FLASH_NO_ERR) {
+        /* all ENV may be changed */
+        record_env_change(NULL);
+    }
+#endif
+
+    /* unlock the ENV cache */
+    flash_env_unlock();
+
+    return result;
+}
+
+/**
+ * Load the saved ENV to cache. The factory snapshot is loaded instead of it when the factory reset
+ * has been marked.
+ */
+static void load_saved_env(void) {
+    bool factory_reset = env_factory_reset;
+
+    /* the saved ENV may be saved again when load, it isn't the snapshot */
+    env_factory_reset = false;
+    load_env();
+    env_factory_reset = factory_reset;
+
+    /* the factory snapshot is used until it has been saved as ENV */
+    if (env_factory_reset && !load_factory_env()) {
+        FLASH_INFO("Warning: The factory snapshot is broken. Set default ENV for factory reset.\n");
+        flash_env_set_default();
+    }
+}
+
+/**
+ * Check the factory snapshot head.
+ *
+ * @param head the read snapshot head
+ *
+ * @return true is valid
+ */
+static bool factory_snapshot_is_valid(uint32_t *head) {
+    flash_read(env_factory_addr, head, ENV_FACTORY_HEAD_BYTE_SIZE);
+
+    return (head[ENV_FACTORY_HEAD_INDEX_MAGIC] == ENV_FACTORY_MAGIC)
+            && (head[ENV_FACTORY_HEAD_INDEX_DATA_SIZE] % 4 == 0)
+            && (head[ENV_FACTORY_HEAD_INDEX_DATA_SIZE] <= flash_get_env_total_size() - ENV_PARAM_BYTE_SIZE);
+}
+
+/**
+ * Load the factory snapshot to cache.
+ *
+ * @return true is ok
+ */
+static bool load_factory_env(void) {
+    uint32_t head[ENV_FACTORY_HEAD_WORD_SIZE];
+
+    if (factory_snapshot_is_valid(head)) {
+        env_crc_sum = 0;
+        if (load_env_data(env_factory_addr + ENV_FACTORY_HEAD_BYTE_SIZE,
+                (char *) env_cache + ENV_PARAM_BYTE_SIZE, head[ENV_FACTORY_HEAD_INDEX_DATA_SIZE])
+                && calc_crc32(env_crc_sum, &head[ENV_FACTORY_HEAD_INDEX_DATA_SIZE], 4)
+                        == head[ENV_FACTORY_HEAD_INDEX_CRC]) {
+            set_env_end_addr(get_env_data_addr() + head[ENV_FACTORY_HEAD_INDEX_DATA_SIZE]);
+#ifdef FLASH_ENV_USING_SHARDED_MODE
+            update_env_shards(true);
+#endif
+#ifdef FLASH_ENV_USING_EMERGENCY_FLUSH
+            env_cache_dirty = true;
+#endif
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Write a mark to mark sector. The mark sector is erased when it's full.
+ *
+ * @param mark factory reset mark
+ *
+ * @return result
+ */
+static FlashErrCode write_factory_mark(uint32_t mark) {
+    FlashErrCode result = FLASH_NO_ERR;
+
+    if (env_factory_mark_addr >= env_factory_mark_sec_addr + env_factory_mark_sec_size) {
+        result = flash_erase(env_factory_mark_sec_addr, env_factory_mark_sec_size);
+        if (result != FLASH_NO_ERR) {
+            return result;
+        }
+        env_factory_mark_addr = env_factory_mark_sec_addr;
+        /* the blank mark sector means the snapshot has been saved */
+        if (mark == ENV_FACTORY_MARK_SAVED) {
+            return result;
+        }
+    }
+    result = flash_write(env_factory_mark_addr, &mark, 4);
+    /* the written word can't be used again */
+    env_factory_mark_addr += 4;
+
+    return result;
+}
+
+/**
+ * Mark the factory snapshot has been saved as ENV after the ENV has been saved.
+ */
+static void finish_factory_reset(void) {
+    if (env_factory_reset && write_factory_mark(ENV_FACTORY_MARK_SAVED) == FLASH_NO_ERR) {
+        env_factory_reset = false;
+    }
+}
+#endif /* FLASH_ENV_USING_FACTORY_SNAPSHOT */
+
+#ifdef FLASH_ENV_USING_CHANGE_FEED
+/**
+ * Record an ENV change to journal and increase the ENV version.
+ *
+ * @param key changed ENV name, NULL when all ENV may be changed
+ */
+static void record_env_change(const char *key) {
+    env_change *change;
+
+    env_version++;
+    /* the journal can't contain this change, so it's cleaned */
+    if (key == NULL || strlen(key) >= FLASH_ENV_FEED_KEY_SIZE) {
+        env_journal_num = 0;
+        env_journal_base = env_version;
+        return;
+    }
+    /* overwrite the oldest change when journal is full */
+    if (env_journal_num == FLASH_ENV_FEED_JOURNAL_SIZE) {
+        env_journal_base = env_journal[env_journal_start].version;
+        env_journal_start = (env_journal_start + 1) % FLASH_ENV_FEED_JOURNAL_SIZE;
+        env_journal_num--;
+    }
+    change = &env_journal[(env_journal_start + env_journal_num) % FLASH_ENV_FEED_JOURNAL_SIZE];
+    change->version = env_version;
+    strcpy(change->key, key);
+    env_journal_num++;
+}
+
+/**
+ * Get current ENV version. It's increased when the saved ENV has been changed.
+ * The version is restarted when power on.
+ *
+ * @return ENV version
+ */
+uint32_t flash_get_env_version(void) {
+    return env_version;
+}
+
+/**
+ * Get the ENV name which was changed after the version. The changed ENV maybe has been deleted.
+ * When the changes have been overflowed from journal, all ENV name will be got as full snapshot.
+ * The volatile ENV isn't in changes.
+ *
+ * @param version the ENV version which was got last time
+ * @param keys the buffer to store ENV name, it's valid before the ENV is changed
+ * @param size the keys buffer size
+ * @param full all ENV name is got as full snapshot
+ *
+ * @return total changed ENV number
+ */
+size_t flash_get_env_changes(uint32_t version, const char **keys, size_t size, bool *full) {
+    size_t i, j, num = 0;
+    env_change *change;
+
+    FLASH_ASSERT(full);
+
+    /* lock the ENV cache */
+    flash_env_lock();
+
+    *full = (version < env_journal_base) || (version > env_version);
+    if (!*full) {
+        for (i = 0; i < env_journal_num; i++) {
+            change = &env_journal[(env_journal_start + i) % FLASH_ENV_FEED_JOURNAL_SIZE];
+            if (change->version <= version) {
+                continue;
+            }
+            /* the same ENV name is only got by its last change */
+            for (j = i + 1; j < env_journal_num; j++) {
+                if (!strcmp(env_journal[(env_journal_start + j) % FLASH_ENV_FEED_JOURNAL_SIZE].key,
+                        change->key)) {
+                    break;
+                }
+            }
+            if (j == env_journal_num) {
+                if (num < size) {
+                    keys[num] = change->key;
+                }
+                num++;
+            }
+        }
+    } else {
+        char *env = (char *) env_cache + ENV_PARAM_BYTE_SIZE,
+                *env_end = (char *) env_cache + flash_get_env_write_bytes();
+
+        for (; env < env_end; env += get_env_len(env)) {
+            if (!(ENV_FLAGS(env) & ENV_FLAG_DELETED)) {
+                if (num < size) {
+                    keys[num] = ENV_KEY(env);
+                }
+                num++;
+            }
+        }
+#ifdef FLASH_ENV_USING_DEFAULT_OVERLAY
+        /* the default ENV which isn't in cache */
+        for (i = 0; i < default_env_set_size; i++) {
+#ifdef FLASH_ENV_USING_KEY_CLASS
+            if (default_env_set[i].env_class == FLASH_ENV_VOLATILE) {
+                continue;
+            }
+#endif
+            if (!find_env(default_env_set[i].key)) {
+                if (num < size) {
+                    keys[num] = default_env_set[i].key;
+                }
+                num++;
+            }
+        }
+#endif
+    }
+
+    /* unlock the ENV cache */
+    flash_env_unlock();
+
+    return num;
+}
+#endif /* FLASH_ENV_USING_CHANGE_FEED */
+
+#ifdef FLASH_ENV_USING_BOOT_READER
+/**
+ * Get an ENV value from flash directly. It's designed for bootloader, so it doesn't need
+ * flash_init, ENV cache and lock. The default value is got when the ENV isn't saved.
+ *
+ * @param key ENV name
+ * @param value the buffer to store ENV value
+ * @param size value buffer size
+ * @param verify verify the CRC32 code of all saved ENV, the broken ENV is same as not saved
+ *
+ * @return result, FLASH_ENV_NAME_ERR when not found, FLASH_ENV_FULL when buffer is too small,
+ *         FLASH_ENV_BROKEN when the saved ENV can't be read
+ */
+FlashErrCode flash_env_boot_get(const char *key, char *value, size_t size, bool verify) {
+    extern FlashErrCode flash_port_init(uint32_t *env_addr, size_t *env_total_size,
+            size_t *erase_min_size, flash_env const **default_env, size_t *default_env_size,
+            size_t *log_size);
+
+    uint32_t start_addr, data_addr = 0, end_addr = 0, crc_sum, env_addr = 0, head[2];
+    size_t total_size, erase_min_size, default_env_size, log_size, i;
+    const flash_env *default_env;
+    bool env_is_ok = false, env_is_saved;
+#ifdef FLASH_ENV_USING_SHARDED_MODE
+    uint32_t shard_head[ENV_SHARD_HEAD_WORD_SIZE];
+    size_t shard = get_env_shard(key, strlen(key));
+#else
+    uint32_t param[ENV_PARAM_WORD_SIZE];
+#endif
+#ifdef FLASH_ENV_USING_SLOTTED_MODE
+    uint32_t slot_addr, seq;
+#endif
+
+    FLASH_ASSERT(key);
+    FLASH_ASSERT(value);
+
+    if (flash_port_init(&start_addr, &total_size, &erase_min_size, &default_env, &default_env_size,
+            &log_size) != FLASH_NO_ERR) {
+        return FLASH_ENV_NAME_ERR;
+    }
+
+#if defined(FLASH_ENV_USING_SHARDED_MODE)
+    /* only the shard which contains this ENV is read */
+    start_addr += shard * (total_size / FLASH_ENV_SHARD_NUM);
+    flash_read(start_addr, shard_head, ENV_SHARD_HEAD_BYTE_SIZE);
+    env_is_saved = shard_head[ENV_SHARD_HEAD_INDEX_DATA_SIZE] != 0xFFFFFFFF;
+    if ((shard_head[ENV_SHARD_HEAD_INDEX_DATA_SIZE] % 4 == 0)
+            && (shard_head[ENV_SHARD_HEAD_INDEX_DATA_SIZE]
+                    <= total_size / FLASH_ENV_SHARD_NUM - ENV_SHARD_HEAD_BYTE_SIZE)
+            && (shard_head[ENV_SHARD_HEAD_INDEX_INFO] == ENV_SHARD_INFO(shard))) {
+        data_addr = start_addr + ENV_SHARD_HEAD_BYTE_SIZE;
+        end_addr = data_addr + shard_head[ENV_SHARD_HEAD_INDEX_DATA_SIZE];
+        env_is_ok = boot_find_env(data_addr, end_addr, key, verify, &crc_sum, &env_addr)
+                && (!verify || calc_crc32(crc_sum, shard_head, ENV_SHARD_HEAD_INDEX_CRC * 4)
+                        == shard_head[ENV_SHARD_HEAD_INDEX_CRC]);
+    }
+#elif defined(FLASH_ENV_USING_SLOTTED_MODE)
+    /* the newest slot which can be read is used */
+    slot_addr = find_newest_slot(start_addr, total_size, erase_min_size, 0xFFFFFFFF, &seq);
+    env_is_saved = slot_addr != 0;
+    for (; slot_addr && !env_is_ok;
+            slot_addr = find_newest_slot(start_addr, total_size, erase_min_size, seq, &seq)) {
+        flash_read(slot_addr, param, ENV_PARAM_BYTE_SIZE);
+        if ((param[ENV_PARAM_INDEX_END_ADDR] >= slot_addr + ENV_PARAM_BYTE_SIZE)
+                && (param[ENV_PARAM_INDEX_END_ADDR] <= slot_addr + FLASH_USER_SETTING_ENV_SIZE)
+                && (param[ENV_PARAM_INDEX_END_ADDR] % 4 == 0)) {
+            data_addr = slot_addr + ENV_PARAM_BYTE_SIZE;
+            end_addr = param[ENV_PARAM_INDEX_END_ADDR];
+            env_is_ok = boot_find_env(data_addr, end_addr, key, verify, &crc_sum, &env_addr)
+                    && (!verify || calc_crc32(calc_crc32(crc_sum, &param[ENV_PARAM_INDEX_END_ADDR], 4),
+                            &param[ENV_PARAM_INDEX_SAVE_SEQ], 4) == param[ENV_PARAM_INDEX_DATA_CRC]);
+        }
+    }
+#else
+    flash_read(start_addr, param, ENV_PARAM_BYTE_SIZE);
+    env_is_saved = param[ENV_PARAM_INDEX_END_ADDR] != 0xFFFFFFFF;
+    if ((param[ENV_PARAM_INDEX_END_ADDR] >= start_addr + ENV_PARAM_BYTE_SIZE)
+            && (param[ENV_PARAM_INDEX_END_ADDR] <= start_addr + total_size)
+            && (param[ENV_PARAM_INDEX_END_ADDR] % 4 == 0)) {
+        data_addr = start_addr + ENV_PARAM_BYTE_SIZE;
+        end_addr = param[ENV_PARAM_INDEX_END_ADDR];
+        env_is_ok = boot_find_env(data_addr, end_addr, key, verify, &crc_sum, &env_addr)
+                && (!verify || calc_crc32(crc_sum, &param[ENV_PARAM_INDEX_END_ADDR], 4)
+                        == param[ENV_PARAM_INDEX_DATA_CRC]);
+    }
+#endif
+
+    if (env_is_ok && env_addr) {
+        flash_read(env_addr, head, ENV_HEAD_BYTE_SIZE);
+        if (ENV_FLAGS(head) & ENV_FLAG_DELETED) {
+            return FLASH_ENV_NAME_ERR;
+        }
+        if (ENV_VALUE_LEN(head) + 1 > size) {
+            return FLASH_ENV_FULL;
+        }
+        boot_read_bytes(env_addr + ENV_HEAD_BYTE_SIZE + ENV_KEY_LEN(head) + 1, value, ENV_VALUE_LEN(head));
+        value[ENV_VALUE_LEN(head)] = '\0';
+        return FLASH_NO_ERR;
+    } else if (env_is_saved && !env_is_ok) {
+        /* the saved ENV is broken, its default value maybe isn't same as the saved */
+        return FLASH_ENV_BROKEN;
+    }
+
+    /* the default value is used when the ENV isn't saved, it's same as flash_init */
+    for (i = 0; i < default_env_size; i++) {
+        if (!strcmp(default_env[i].key, key)) {
+#if !defined(FLASH_ENV_USING_DEFAULT_OVERLAY) && !defined(FLASH_ENV_USING_KEY_CLASS)
+            if (env_is_ok) {
+                break;
+            }
+#elif !defined(FLASH_ENV_USING_DEFAULT_OVERLAY)
+            if (env_is_ok && default_env[i].env_class != FLASH_ENV_VOLATILE) {
+                break;
+            }
+#endif
+            if (strlen(default_env[i].value) + 1 > size) {
+                return FLASH_ENV_FULL;
+            }
+            strcpy(value, default_env[i].value);
+            return FLASH_NO_ERR;
+        }
+    }
+
+    return FLASH_ENV_NAME_ERR;
+}
+
+/**
+ * Read bytes from flash by any address.
+ *
+ * @param addr flash address
+ * @param buf the buffer to store read bytes
+ * @param size read bytes size
+ */
+static void boot_read_bytes(uint32_t addr, char *buf, size_t size) {
+    uint32_t block[ENV_LOAD_BLOCK_SIZE / 4];
+    size_t skip = addr % 4, read_size, copy_size;
+
+    /* the flash is read by word */
+    for (addr -= skip; size; addr += read_size, skip = 0) {
+        read_size = (skip + size + 3) / 4 * 4;
+        if (read_size > ENV_LOAD_BLOCK_SIZE) {
+            read_size = ENV_LOAD_BLOCK_SIZE;
+        }
+        flash_read(addr, block, read_size);
+        copy_size = read_size - skip < size ? read_size - skip : size;
+        memcpy(buf, (char *) block + skip, copy_size);
+        buf += copy_size;
+        size -= copy_size;
+    }
+}
+
+/**
+ * Find an ENV in flash data section without cache.
+ *
+ * @param addr data section start address
+ * @param end_addr data section end address
+ * @param key ENV name
+ * @param verify verify the CRC32 code of all ENV in data section
+ * @param crc_sum the sum of all ENV's CRC32 code when verify
+ * @param env_addr the found ENV address in flash, 0 when not found
+ *
+ * @return true when the data section is ok
+ */
+static bool boot_find_env(uint32_t addr, uint32_t end_addr, const char *key, bool verify,
+        uint32_t *crc_sum, uint32_t *env_addr) {
+    uint32_t head[2], env_end, read_addr, block[ENV_LOAD_BLOCK_SIZE / 4], crc;
+    size_t key_len = strlen(key), read_size, i;
+
+    *crc_sum = 0;
+    *env_addr = 0;
+    for (; addr < end_addr; addr = env_end) {
+        flash_read(addr, head, ENV_HEAD_BYTE_SIZE);
+        env_end = addr + ENV_STORAGE_LEN(ENV_KEY_LEN(head), ENV_VALUE_LEN(head));
+        if (env_end > end_addr) {
+            return false;
+        }
+        /* compare the name by block */
+        if (*env_addr == 0 && ENV_KEY_LEN(head) == key_len) {
+            for (i = 0; i < key_len; i += read_size) {
+                read_size = key_len - i < ENV_LOAD_BLOCK_SIZE ? key_len - i : ENV_LOAD_BLOCK_SIZE;
+                boot_read_bytes(addr + ENV_HEAD_BYTE_SIZE + i, (char *) block, read_size);
+                if (memcmp(block, key + i, read_size)) {
+                    break;
+                }
+            }
+            if (i >= key_len) {
+                *env_addr = addr;
+            }
+        }
+        if (!verify) {
+            if (*env_addr) {
+                return true;
+            }
+            continue;
+        }
+        /* the CRC32 code is calculated by head, key\0value\0 and the word alignment part */
+        crc = calc_crc32(0, &head[1], 4);
+        for (read_addr = addr + ENV_HEAD_BYTE_SIZE; read_addr < env_end; read_addr += read_size) {
+            read_size = env_end - read_addr < ENV_LOAD_BLOCK_SIZE ? env_end - read_addr : ENV_LOAD_BLOCK_SIZE;
+            flash_read(read_addr, block, read_size);
+            crc = calc_crc32(crc, block, read_size);
+        }
+        if (crc != head[0]) {
+            return false;
+        }
+        *crc_sum += crc;
+    }
+
+    return true;
+}
+#endif /* FLASH_ENV_USING_BOOT_READER */
+
+/**
+ * Save ENV to flash.
+ */
+FlashErrCode flash_save_env(void) {
+    FlashErrCode result = FLASH_NO_ERR;
+
+#ifdef FLASH_ENV_USING_SHARDED_MODE
+    FlashErrCode shard_result;
+    size_t i;
+
+    /* only the changed shards will be saved, the fault shard is still dirty */
+    for (i = 0; i < FLASH_ENV_SHARD_NUM; i++) {
+        if (env_shard_dirty[i]) {
+            shard_result = save_env_shard(i);
+            if (shard_result == FLASH_NO_ERR) {
+                env_shard_dirty[i] = false;
+            } else {
+                result = shard_result;
+            }
+        }
+    }
+#ifdef FLASH_ENV_USING_FACTORY_SNAPSHOT
+    if (result == FLASH_NO_ERR) {
+        finish_factory_reset();
+    }
+#endif
+
+    return result;
+#endif
+
+#ifdef FLASH_ENV_USING_SLOTTED_MODE
+    /* move the cached ENV to next slot, the old slot is kept until its sector will be erased */
+    set_env_end_addr(get_env_end_addr() - env_start_addr + env_next_slot_addr);
+    env_start_addr = env_next_slot_addr;
+    env_cache[ENV_PARAM_INDEX_SAVE_SEQ]++;
+    /* the slot can't be written again even if this save is fault */
+    env_next_slot_addr = get_next_slot_addr(env_start_addr);
+#endif
+    /* calculate and cache CRC32 code */
+    env_cache[ENV_PARAM_INDEX_DATA_CRC] = calc_env_crc();
+#ifdef FLASH_ENV_USING_SLOTTED_MODE
+    /* only erase the sector when its first slot will be used */
+    if ((env_start_addr - env_area_addr) % env_erase_min_size == 0) {
+        result = flash_erase(env_start_addr, env_erase_min_size);
+    }
+#else
     /* erase ENV */
     result = flash_erase(get_env_system_addr(), flash_get_env_write_bytes());
+#endif
     switch (result) {
     case FLASH_NO_ERR: {
         FLASH_INFO("Erased ENV OK.\n");
@@ -529,6 +2553,12 @@ FlashErrCode flash_save_env(void) {
     switch (result) {
     case FLASH_NO_ERR: {
         FLASH_INFO("Saved ENV OK.\n");
+#ifdef FLASH_ENV_USING_EMERGENCY_FLUSH
+        env_cache_dirty = false;
+#endif
+#ifdef FLASH_ENV_USING_FACTORY_SNAPSHOT
+        finish_factory_reset();
+#endif
         break;
     }
     case FLASH_WRITE_ERR: {
@@ -548,10 +2578,13 @@ FlashErrCode flash_save_env(void) {
 static uint32_t calc_env_crc(void) {
     uint32_t crc32 = 0;
 
-    /* Calculate the ENV end address and all ENV data CRC32.
+    /* Calculate the ENV end address CRC32 by all ENV CRC32 code sum.
      * The 4 is ENV end address bytes size. */
-    crc32 = calc_crc32(crc32, &env_cache[ENV_PARAM_INDEX_END_ADDR], 4);
-    crc32 = calc_crc32(crc32, &env_cache[ENV_PARAM_WORD_SIZE], get_env_data_size());
+    crc32 = calc_crc32(env_crc_sum, &env_cache[ENV_PARAM_INDEX_END_ADDR], 4);
+#ifdef FLASH_ENV_USING_SLOTTED_MODE
+    /* the stale slot which has same ENV data can't pass the check by save sequence */
+    crc32 = calc_crc32(crc32, &env_cache[ENV_PARAM_INDEX_SAVE_SEQ], 4);
+#endif
     FLASH_DEBUG("Calculate Env CRC32 number is 0x%08X.\n", crc32);
 
     return crc32;
@@ -0,0 +1,156 @@
+/*
+ * This file is part of the EasyFlash Library.
+ *
+ * Copyright (c) 2015, Armink, <armink.ztl@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * 'Software'), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED 'AS IS', WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Function: Save ENV to flash asynchronously. (normal and wear leveling mode)
+ * Created on: 2026-10-19
+ */
+
+#include "flash.h"
+#include <string.h>
+
+#ifdef FLASH_USING_ENV
+
+#ifdef FLASH_ENV_USING_ASYNC_SAVE
+
+/**
+ * The asynchronous save requests are merged. All requests which are waiting when the worker
+ * wakes up are finished by only one flash_save_env. The requests which come during saving
+ * will be finished by the next save, because the ENV cache may be changed after it.
+ * The ENV cache is locked during saving, so the ENV can't be changed or saved by other threads
+ * (such as the write-through ENV) at the same time. The lock must be a mutex which has priority
+ * inheritance, so the low priority worker is raised when a high priority thread is waiting for it.
+ */
+
+/* asynchronous save request */
+typedef struct _env_async_req {
+    flash_env_save_cb cb;
+    void *arg;
+} env_async_req, *env_async_req_t;
+
+/* waiting requests which has callback */
+static env_async_req req_queue[FLASH_ENV_ASYNC_QUEUE_SIZE];
+/* waiting requests number in queue */
+static size_t req_queue_num = 0;
+/* has a save request waiting for worker */
+static bool save_pending = false;
+/* initialize OK flag */
+static bool init_ok = false;
+
+/**
+ * The ENV asynchronous save function initialize.
+ * The save worker will be created by port.
+ *
+ * @return result
+ */
+FlashErrCode flash_env_async_init(void) {
+    FlashErrCode result = FLASH_NO_ERR;
+
+    req_queue_num = 0;
+    save_pending = false;
+
+    result = flash_env_async_port_init();
+    if (result == FLASH_NO_ERR) {
+        init_ok = true;
+    }
+
+    return result;
+}
+
+/**
+ * Save ENV to flash by the save worker. This function will return immediately.
+ * The callback will be called in the worker context after the ENV has saved.
+ *
+ * @param cb the callback when save finish, it can be NULL
+ * @param arg the callback argument
+ *
+ * @return result
+ */
+FlashErrCode flash_save_env_async(flash_env_save_cb cb, void *arg) {
+    FlashErrCode result = FLASH_NO_ERR;
+
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    /* lock the ENV cache */
+    flash_env_lock();
+
+    if (cb) {
+        if (req_queue_num < FLASH_ENV_ASYNC_QUEUE_SIZE) {
+            req_queue[req_queue_num].cb = cb;
+            req_queue[req_queue_num].arg = arg;
+            req_queue_num++;
+        } else {
+            result = FLASH_ENV_QUEUE_FULL;
+        }
+    }
+    /* the ENV will be saved even if the callback can't be queued */
+    save_pending = true;
+
+    /* unlock the ENV cache */
+    flash_env_unlock();
+
+    /* wake up the save worker */
+    flash_env_async_port_notify();
+
+    return result;
+}
+
+/**
+ * The save worker handler. It must be called by the port worker after it was notified.
+ * @see flash_env_async_port_notify
+ */
+void flash_env_async_worker(void) {
+    env_async_req req[FLASH_ENV_ASYNC_QUEUE_SIZE];
+    size_t req_num, i;
+    FlashErrCode result;
+
+    FLASH_ASSERT(init_ok);
+
+    while (true) {
+        /* lock the ENV cache */
+        flash_env_lock();
+        if (!save_pending) {
+            flash_env_unlock();
+            break;
+        }
+        /* take all waiting requests, the new requests will wait for next save */
+        req_num = req_queue_num;
+        memcpy(req, req_queue, req_num * sizeof(env_async_req));
+        req_queue_num = 0;
+        save_pending = false;
+
+        result = flash_save_env();
+
+        /* unlock the ENV cache, the callbacks can use the ENV */
+        flash_env_unlock();
+
+        for (i = 0; i < req_num; i++) {
+            req[i].cb(result, req[i].arg);
+        }
+    }
+}
+
+#endif /* FLASH_ENV_USING_ASYNC_SAVE */
+
+#endif /* FLASH_USING_ENV */
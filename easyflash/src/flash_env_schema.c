@@ -0,0 +1,406 @@
+/*
+ * This file is part of the EasyFlash Library.
+ *
+ * Copyright (c) 2015, Armink, <armink.ztl@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * 'Software'), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED 'AS IS', WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Function: Schema ENV. The fixed slot typed ENV which is declared by FLASH_ENV_SCHEMA.
+ * Created on: 2026-10-19
+ */
+
+#include "flash.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+#ifdef FLASH_USING_ENV
+
+#ifdef FLASH_ENV_USING_SCHEMA
+
+/**
+ * Every schema ENV has a fixed offset in the schema cache, so it can be accessed directly.
+ *
+ * The schema area has 2 or more sectors. Every save will append a schema image to the using
+ * sector, when the using sector is full, the next sector will be erased and used.
+ * Schema image storage format
+ * |----------------------------|
+ * |           magic            |
+ * |         sequence           |   the newest image has the biggest sequence
+ * |  version(16bit) size(16bit)|
+ * |     CRC32 of the data      |
+ * |----------------------------|
+ * |      schema cache data     |   size bytes, word alignment
+ * |----------------------------|
+ *
+ * When the newest image version is not FLASH_ENV_SCHEMA_VER, the ENV which is fully contained
+ * by old image will be kept. The other ENV will be migrated from the string ENV which has same
+ * name, then the migrated string ENV will be deleted.
+ */
+
+/* the schema image magic word */
+#define SCHEMA_IMAGE_MAGIC             0x45465343
+/* the schema image head bytes size */
+#define SCHEMA_HEAD_BYTE_SIZE          16
+/* the schema cache data bytes size in flash, word alignment */
+#define SCHEMA_DATA_BYTE_SIZE          ((sizeof(flash_schema) + 3) / 4 * 4)
+/* the schema image bytes size */
+#define SCHEMA_IMAGE_BYTE_SIZE         (SCHEMA_HEAD_BYTE_SIZE + SCHEMA_DATA_BYTE_SIZE)
+
+/* schema cache, the word buffer is used for flash read and write */
+static union {
+    flash_schema schema;
+    uint32_t words[SCHEMA_DATA_BYTE_SIZE / 4];
+} schema_cache;
+/* schema area start address */
+static uint32_t schema_area_addr = 0;
+/* schema area total size */
+static size_t schema_area_size = 0;
+/* the minimum size of flash erasure */
+static size_t flash_erase_min_size = 0;
+/* current using sector address and the next image address, 0 means the next save must switch sector */
+static uint32_t cur_sec_addr = 0, next_image_addr = 0;
+/* the newest image sequence */
+static uint32_t cur_image_seq = 0;
+/* the schema cache has been changed after last save */
+static bool schema_is_changed = false;
+/* initialize OK flag */
+static bool init_ok = false;
+
+static bool load_schema(void);
+static bool read_image_head(uint32_t addr, uint32_t end_addr, uint32_t *head);
+static bool migrate_schema(uint32_t image_addr, size_t image_size);
+
+/**
+ * The schema ENV function initialize. It must be initialized after string ENV.
+ *
+ * @param start_addr schema area start address
+ * @param area_size schema area total size
+ * @param erase_min_size the minimum size of flash erasure
+ *
+ * @return result
+ */
+FlashErrCode flash_env_schema_init(uint32_t start_addr, size_t area_size, size_t erase_min_size) {
+    FlashErrCode result = FLASH_NO_ERR;
+    bool migrated;
+
+    FLASH_ASSERT(start_addr);
+    FLASH_ASSERT(erase_min_size);
+    /* the schema area size must be an integral multiple of erase minimum size. */
+    FLASH_ASSERT(area_size % erase_min_size == 0);
+    /* the schema area size must be more than 2 multiple of erase minimum size */
+    FLASH_ASSERT(area_size / erase_min_size >= 2);
+    /* the schema image must be saved in one sector */
+    FLASH_ASSERT(SCHEMA_IMAGE_BYTE_SIZE <= erase_min_size);
+    FLASH_ASSERT(FLASH_ENV_SCHEMA_VER <= 0xFFFF);
+
+    schema_area_addr = start_addr;
+    schema_area_size = area_size;
+    flash_erase_min_size = erase_min_size;
+
+    migrated = load_schema();
+    init_ok = true;
+
+    if (schema_is_changed) {
+        result = flash_schema_save();
+    }
+    /* the migrated string ENV will be deleted after schema ENV has saved */
+    if (result == FLASH_NO_ERR && migrated) {
+        result = flash_save_env();
+    }
+
+    return result;
+}
+
+/**
+ * Read and check the schema image head.
+ *
+ * @param addr image address
+ * @param end_addr the sector end address
+ * @param head image head
+ *
+ * @return false when the head is not an image head
+ */
+static bool read_image_head(uint32_t addr, uint32_t end_addr, uint32_t *head) {
+    size_t size;
+
+    if (addr + SCHEMA_HEAD_BYTE_SIZE > end_addr) {
+        return false;
+    }
+    flash_read(addr, head, SCHEMA_HEAD_BYTE_SIZE);
+    if (head[0] != SCHEMA_IMAGE_MAGIC) {
+        return false;
+    }
+    size = head[2] & 0xFFFF;
+    if (size % 4 != 0 || addr + SCHEMA_HEAD_BYTE_SIZE + size > end_addr) {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Calculate the CRC32 code of image data in flash.
+ *
+ * @param addr image data address
+ * @param size image data size
+ *
+ * @return CRC32 code
+ */
+static uint32_t calc_image_crc(uint32_t addr, size_t size) {
+    uint32_t buf[8], crc = 0;
+    size_t read_size;
+
+    while (size) {
+        read_size = size < sizeof(buf) ? size : sizeof(buf);
+        flash_read(addr, buf, read_size);
+        crc = calc_crc32(crc, buf, read_size);
+        addr += read_size;
+        size -= read_size;
+    }
+
+    return crc;
+}
+
+/**
+ * Find the newest schema image and load it to cache.
+ * The schema ENV will be migrated when the newest image version isn't current version.
+ *
+ * @return true when some string ENV has been migrated
+ */
+static bool load_schema(void) {
+    uint32_t sec_addr, sec_end_addr, addr, head[SCHEMA_HEAD_BYTE_SIZE / 4];
+    uint32_t image_addr = 0, image_head[SCHEMA_HEAD_BYTE_SIZE / 4];
+    bool found = false, newest_in_sec, migrated = false;
+
+    /* the first sector will be used after switched from the last sector */
+    cur_sec_addr = schema_area_addr + schema_area_size - flash_erase_min_size;
+    next_image_addr = 0;
+    cur_image_seq = 0;
+
+    for (sec_addr = schema_area_addr; sec_addr < schema_area_addr + schema_area_size;
+            sec_addr += flash_erase_min_size) {
+        sec_end_addr = sec_addr + flash_erase_min_size;
+        newest_in_sec = false;
+        for (addr = sec_addr; read_image_head(addr, sec_end_addr, head);
+                addr += SCHEMA_HEAD_BYTE_SIZE + (head[2] & 0xFFFF)) {
+            if (calc_image_crc(addr + SCHEMA_HEAD_BYTE_SIZE, head[2] & 0xFFFF) != head[3]) {
+                continue;
+            }
+            /* the sequence maybe overflow, so using the difference to compare */
+            if (!found || (int32_t)(head[1] - cur_image_seq) > 0) {
+                image_addr = addr;
+                memcpy(image_head, head, sizeof(head));
+                cur_image_seq = head[1];
+                found = true;
+                newest_in_sec = true;
+            }
+        }
+        if (newest_in_sec) {
+            cur_sec_addr = sec_addr;
+            /* the next image can be appended only when it isn't a broken head */
+            if (addr + SCHEMA_HEAD_BYTE_SIZE > sec_end_addr || head[0] == 0xFFFFFFFF) {
+                next_image_addr = addr;
+            } else {
+                next_image_addr = 0;
+            }
+        }
+    }
+
+    if (found && (image_head[2] >> 16) == FLASH_ENV_SCHEMA_VER
+            && (image_head[2] & 0xFFFF) == SCHEMA_DATA_BYTE_SIZE) {
+        flash_read(image_addr + SCHEMA_HEAD_BYTE_SIZE, schema_cache.words, SCHEMA_DATA_BYTE_SIZE);
+        schema_is_changed = false;
+    } else {
+        if (found) {
+            FLASH_INFO("Schema ENV version is changed to %d. Now will migrate it.\n", FLASH_ENV_SCHEMA_VER);
+            migrated = migrate_schema(image_addr + SCHEMA_HEAD_BYTE_SIZE, image_head[2] & 0xFFFF);
+        } else {
+            FLASH_INFO("Schema ENV has no data. Now will migrate it from string ENV.\n");
+            migrated = migrate_schema(0, 0);
+        }
+        schema_is_changed = true;
+    }
+
+    return migrated;
+}
+
+/**
+ * Migrate the schema ENV from old image and string ENV.
+ * The ENV which is fully contained by old image will be kept, otherwise it will be migrated from
+ * the string ENV which has same name. The default value is used when both are not exist.
+ *
+ * @param image_addr old image data address
+ * @param image_size old image data size, 0 means no old image
+ *
+ * @return true when some string ENV has been migrated
+ */
+static bool migrate_schema(uint32_t image_addr, size_t image_size) {
+    bool migrated = false;
+    char *value;
+
+    memset(&schema_cache, 0, sizeof(schema_cache));
+    if (image_size) {
+        flash_read(image_addr, schema_cache.words,
+                image_size < SCHEMA_DATA_BYTE_SIZE ? image_size : SCHEMA_DATA_BYTE_SIZE);
+    }
+
+#define MIGRATE_NUM(name, type, sign, def)                                    \
+    if (offsetof(flash_schema, name) + sizeof(type) > image_size) {           \
+        if ((value = flash_get_env(#name)) != NULL) {                         \
+            if (sign) {                                                       \
+                schema_cache.schema.name = (type) strtol(value, NULL, 0);     \
+            } else {                                                          \
+                schema_cache.schema.name = (type) strtoul(value, NULL, 0);    \
+            }                                                                 \
+            flash_set_env(#name, "");                                         \
+            migrated = true;                                                  \
+        } else {                                                              \
+            schema_cache.schema.name = (type) (def);                          \
+        }                                                                     \
+    }
+#define MIGRATE_STR(name, size, def)                                          \
+    if (offsetof(flash_schema, name) + (size) > image_size) {                 \
+        memset(schema_cache.schema.name, 0, (size));                          \
+        if ((value = flash_get_env(#name)) != NULL) {                         \
+            strncpy(schema_cache.schema.name, value, (size) - 1);             \
+            flash_set_env(#name, "");                                         \
+            migrated = true;                                                  \
+        } else {                                                              \
+            strncpy(schema_cache.schema.name, def, (size) - 1);               \
+        }                                                                     \
+    } else {                                                                  \
+        schema_cache.schema.name[(size) - 1] = '\0';                          \
+    }
+
+    FLASH_ENV_SCHEMA(MIGRATE_NUM, MIGRATE_STR)
+
+#undef MIGRATE_NUM
+#undef MIGRATE_STR
+
+    return migrated;
+}
+
+/**
+ * Save the schema cache to flash. It will do nothing when the schema cache has no change.
+ *
+ * @return result
+ */
+FlashErrCode flash_schema_save(void) {
+    FlashErrCode result = FLASH_NO_ERR;
+    uint32_t head[SCHEMA_HEAD_BYTE_SIZE / 4];
+
+    FLASH_ASSERT(init_ok);
+
+    /* lock the schema cache, it shares the ENV lock */
+    flash_env_lock();
+
+    if (!schema_is_changed) {
+        flash_env_unlock();
+        return result;
+    }
+
+    /* switch to next sector when current sector is full */
+    if (!next_image_addr
+            || next_image_addr + SCHEMA_IMAGE_BYTE_SIZE > cur_sec_addr + flash_erase_min_size) {
+        cur_sec_addr += flash_erase_min_size;
+        if (cur_sec_addr >= schema_area_addr + schema_area_size) {
+            cur_sec_addr = schema_area_addr;
+        }
+        next_image_addr = 0;
+        result = flash_erase(cur_sec_addr, flash_erase_min_size);
+        if (result == FLASH_NO_ERR) {
+            next_image_addr = cur_sec_addr;
+        }
+    }
+
+    if (result == FLASH_NO_ERR) {
+        head[0] = SCHEMA_IMAGE_MAGIC;
+        head[1] = cur_image_seq + 1;
+        head[2] = ((uint32_t) FLASH_ENV_SCHEMA_VER << 16) | SCHEMA_DATA_BYTE_SIZE;
+        head[3] = calc_crc32(0, schema_cache.words, SCHEMA_DATA_BYTE_SIZE);
+        /* the head is written first, so the broken image can be skipped by its size */
+        result = flash_write(next_image_addr, head, SCHEMA_HEAD_BYTE_SIZE);
+        if (result == FLASH_NO_ERR) {
+            result = flash_write(next_image_addr + SCHEMA_HEAD_BYTE_SIZE, schema_cache.words,
+                    SCHEMA_DATA_BYTE_SIZE);
+        }
+        if (result == FLASH_NO_ERR) {
+            next_image_addr += SCHEMA_IMAGE_BYTE_SIZE;
+            cur_image_seq++;
+            schema_is_changed = false;
+        } else {
+            /* the remaining part of current sector is unknown */
+            next_image_addr = 0;
+        }
+    }
+
+    /* unlock the schema cache */
+    flash_env_unlock();
+
+    if (result != FLASH_NO_ERR) {
+        FLASH_INFO("Error: Schema ENV save failed.\n");
+    }
+
+    return result;
+}
+
+/* the schema ENV typed access functions */
+#define SCHEMA_NUM_API(name, type, sign, def)                                 \
+type flash_schema_get_##name(void) {                                          \
+    FLASH_ASSERT(init_ok);                                                    \
+    return schema_cache.schema.name;                                          \
+}                                                                             \
+FlashErrCode flash_schema_set_##name(type value) {                            \
+    FLASH_ASSERT(init_ok);                                                    \
+    flash_env_lock();                                                         \
+    if (schema_cache.schema.name != value) {                                  \
+        schema_cache.schema.name = value;                                     \
+        schema_is_changed = true;                                             \
+    }                                                                         \
+    flash_env_unlock();                                                       \
+    return FLASH_NO_ERR;                                                      \
+}
+#define SCHEMA_STR_API(name, size, def)                                       \
+const char *flash_schema_get_##name(void) {                                   \
+    FLASH_ASSERT(init_ok);                                                    \
+    return schema_cache.schema.name;                                          \
+}                                                                             \
+FlashErrCode flash_schema_set_##name(const char *value) {                     \
+    FLASH_ASSERT(init_ok);                                                    \
+    FLASH_ASSERT(value);                                                      \
+    if (strlen(value) >= (size)) {                                            \
+        return FLASH_ENV_FULL;                                                \
+    }                                                                         \
+    flash_env_lock();                                                         \
+    if (strcmp(schema_cache.schema.name, value)) {                            \
+        memset(schema_cache.schema.name, 0, (size));                          \
+        strcpy(schema_cache.schema.name, value);                              \
+        schema_is_changed = true;                                             \
+    }                                                                         \
+    flash_env_unlock();                                                       \
+    return FLASH_NO_ERR;                                                      \
+}
+
+FLASH_ENV_SCHEMA(SCHEMA_NUM_API, SCHEMA_STR_API)
+
+#endif /* FLASH_ENV_USING_SCHEMA */
+
+#endif /* FLASH_USING_ENV */
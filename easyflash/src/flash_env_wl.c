@@ -49,6 +49,9 @@
  *        It storage all ENV. Storage format is key=value\0.
  *        All ENV must be 4 bytes alignment. The remaining part must fill '\0'.
  *
+ * The ENV detail part CRC32 code is combined by every ENV's CRC32 code. The sum of all ENV's CRC32
+ * code is cached, so it only needs to calculate the changed ENV when save.
+ *
  * @note Word = 4 Bytes in this file
  */
 
@@ -64,6 +67,9 @@ enum {
     ENV_PARAM_PART_BYTE_SIZE = ENV_PARAM_PART_WORD_SIZE * 4,
 };
 
+/* the block bytes size when load ENV from flash, must be word alignment */
+#define ENV_LOAD_BLOCK_SIZE            64
+
 /* default ENV set, must be initialized by user */
 static flash_env const *default_env_set = NULL;
 /* default ENV set size, must be initialized by user */
@@ -78,6 +84,8 @@ static uint32_t env_cache[FLASH_USER_SETTING_ENV_SIZE / 4] = { 0 };
 static uint32_t env_start_addr = NULL;
 /* current using data section address */
 static uint32_t cur_using_data_addr = NULL;
+/* the sum of all ENV's CRC32 code in cache */
+static uint32_t env_crc_sum = 0;
 
 static uint32_t get_env_start_addr(void);
 static uint32_t get_cur_using_data_addr(void);
@@ -91,9 +99,12 @@ static size_t get_env_detail_size(void);
 static size_t get_env_user_used_size(void);
 static FlashErrCode create_env(const char *key, const char *value);
 static FlashErrCode del_env(const char *key);
+static FlashErrCode set_env(const char *key, const char *value);
 static FlashErrCode save_cur_using_data_addr(uint32_t cur_data_addr);
 static uint32_t calc_env_crc(void);
+static uint32_t calc_env_crc_legacy(void);
 static bool env_crc_is_ok(void);
+static bool load_env_detail(void);
 
 /**
  * Flash ENV initialize.
@@ -151,10 +162,11 @@ FlashErrCode flash_env_set_default(void){
 
     /* set ENV detail part end address is at ENV detail part start address */
     set_env_detail_end_addr(get_env_detail_addr());
+    env_crc_sum = 0;
 
-    /* create default ENV */
+    /* the default ENV name is unique, so write them at the end of cache without finding */
     for (i = 0; i < default_env_set_size; i++) {
-        create_env(default_env_set[i].key, default_env_set[i].value);
+        write_env(default_env_set[i].key, default_env_set[i].value);
     }
 
     /* unlock the ENV cache */
@@ -280,7 +292,7 @@ size_t flash_get_env_total_size(void) {
 static FlashErrCode write_env(const char *key, const char *value) {
     FlashErrCode result = FLASH_NO_ERR;
     size_t ker_len = strlen(key), value_len = strlen(value), env_str_len;
-    char *env_cache_bak = (char *)env_cache;
+    char *env_cache_bak = (char *)env_cache, *env_str;
 
     /* calculate ENV storage length, contain '=' and '\0'. */
     env_str_len = ker_len + value_len + 2;
@@ -293,6 +305,7 @@ static FlashErrCode write_env(const char *key, const char *value) {
     }
     /* calculate current ENV ram cache end address */
     env_cache_bak += ENV_PARAM_PART_BYTE_SIZE + get_env_detail_size();
+    env_str = env_cache_bak;
     /* copy key name */
     memcpy(env_cache_bak, key, ker_len);
     env_cache_bak += ker_len;
@@ -307,6 +320,8 @@ static FlashErrCode write_env(const char *key, const char *value) {
     env_cache_bak ++;
     /* fill '\0' for word alignment */
     memset(env_cache_bak, 0, env_str_len - (ker_len + value_len + 2));
+    /* add this ENV CRC32 code to sum */
+    env_crc_sum += calc_crc32(0, env_str, env_str_len);
     set_env_detail_end_addr(get_env_detail_end_addr() + env_str_len);
 
     return result;
@@ -435,6 +450,8 @@ static FlashErrCode del_env(const char *key) {
     if (del_env_length % 4 != 0) {
         del_env_length = (del_env_length / 4 + 1) * 4;
     }
+    /* subtract this ENV CRC32 code from sum */
+    env_crc_sum -= calc_crc32(0, del_env_str, del_env_length);
     /* calculate remain ENV length */
     remain_env_length = get_env_detail_size()
             - (((uint32_t) del_env_str + del_env_length) - ((uint32_t) env_cache + ENV_PARAM_PART_BYTE_SIZE));
@@ -461,6 +478,26 @@ FlashErrCode flash_set_env(const char *key, const char *value) {
     /* lock the ENV cache */
     flash_env_lock();
 
+    result = set_env(key, value);
+
+    /* unlock the ENV cache */
+    flash_env_unlock();
+
+    return result;
+}
+
+/**
+ * Set an ENV in cache. If it value is empty, delete it.
+ * @see flash_set_env
+ *
+ * @param key ENV name
+ * @param value ENV value
+ *
+ * @return result
+ */
+static FlashErrCode set_env(const char *key, const char *value) {
+    FlashErrCode result = FLASH_NO_ERR;
+
     /* if ENV value is empty, delete it */
     if (*value == NULL) {
         result = del_env(key);
@@ -473,6 +510,66 @@ FlashErrCode flash_set_env(const char *key, const char *value) {
             result = create_env(key, value);
         }
     }
+
+    return result;
+}
+
+/**
+ * Compare and swap an ENV. The ENV is set only when its current value is same as expected value.
+ *
+ * @param key ENV name
+ * @param expected expected current value, NULL means the ENV must not exist
+ * @param value new ENV value, delete it when it's empty
+ *
+ * @return result, FLASH_ENV_VALUE_CHANGED when the current value isn't same as expected value
+ */
+FlashErrCode flash_env_cas(const char *key, const char *expected, const char *value) {
+    FlashErrCode result = FLASH_NO_ERR;
+    char *cur_value;
+
+    /* lock the ENV cache */
+    flash_env_lock();
+
+    cur_value = flash_get_env(key);
+    if ((cur_value == NULL && expected == NULL)
+            || (cur_value != NULL && expected != NULL && !strcmp(cur_value, expected))) {
+        result = set_env(key, value);
+    } else {
+        result = FLASH_ENV_VALUE_CHANGED;
+    }
+
+    /* unlock the ENV cache */
+    flash_env_unlock();
+
+    return result;
+}
+
+/**
+ * Read, modify and write an ENV atomically. The callback is called with ENV cache locked,
+ * so it can't call any ENV function.
+ *
+ * @param key ENV name
+ * @param cb the callback which returns new value by current value (NULL when it doesn't exist)
+ * @param arg the callback argument
+ *
+ * @return result
+ */
+FlashErrCode flash_env_update(const char *key, flash_env_update_cb cb, void *arg) {
+    FlashErrCode result = FLASH_NO_ERR;
+    const char *cur_value, *value;
+
+    FLASH_ASSERT(cb);
+
+    /* lock the ENV cache */
+    flash_env_lock();
+
+    cur_value = flash_get_env(key);
+    value = cb(key, cur_value, arg);
+    /* the current value is in cache, it will be moved when set */
+    if (value != NULL && value != cur_value) {
+        result = set_env(key, value);
+    }
+
     /* unlock the ENV cache */
     flash_env_unlock();
 
@@ -533,7 +630,7 @@ void flash_print_env(void) {
  * Load flash ENV to ram.
  */
 void flash_load_env(void) {
-    uint32_t *env_cache_bak, env_end_addr, using_data_addr;
+    uint32_t env_end_addr, using_data_addr;
 
     /* read current using data section address */
     flash_read(get_env_start_addr(), &using_data_addr, 4);
@@ -553,20 +650,23 @@ void flash_load_env(void) {
         /* read ENV detail part end address from flash */
         flash_read(get_cur_using_data_addr() + ENV_PARAM_PART_INDEX_END_ADDR * 4, &env_end_addr, 4);
         /* if ENV end address has error, set default for ENV */
-        if (env_end_addr > get_env_start_addr() + flash_get_env_total_size()) {
+        if ((env_end_addr > get_env_start_addr() + flash_get_env_total_size())
+                || (env_end_addr < get_env_detail_addr())
+                || (env_end_addr - get_env_detail_addr() >= FLASH_USER_SETTING_ENV_SIZE)
+                || (env_end_addr % 4 != 0)) {
             flash_env_set_default();
         } else {
             /* set ENV detail part end address */
             set_env_detail_end_addr(env_end_addr);
-
-            env_cache_bak = env_cache + ENV_PARAM_PART_WORD_SIZE;
-            /* read all ENV from flash */
-            flash_read(get_env_detail_addr(), env_cache_bak, get_env_detail_size());
             /* read ENV CRC code from flash */
             flash_read(get_cur_using_data_addr() + ENV_PARAM_PART_INDEX_DATA_CRC * 4,
                     &env_cache[ENV_PARAM_PART_INDEX_DATA_CRC], 4);
-            /* if ENV CRC32 check is fault, set default for it */
-            if (!env_crc_is_ok()) {
+            /* read all ENV from flash and calculate their CRC32 code sum */
+            if (!load_env_detail()) {
+                FLASH_INFO("Warning: ENV data has broken. Set it to default.\n");
+                flash_env_set_default();
+            } else if (!env_crc_is_ok()) {
+                /* if ENV CRC32 check is fault, set default for it */
                 FLASH_INFO("Warning: ENV CRC check failed. Set it to default.\n");
                 flash_env_set_default();
             }
@@ -575,6 +675,47 @@ void flash_load_env(void) {
     }
 }
 
+/**
+ * Read all ENV detail from flash to cache by blocks. The CRC32 code of each ENV will be calculated
+ * when it has been read completely, so the ENV detail is only traversed once.
+ *
+ * @return false when the last ENV is incomplete
+ */
+static bool load_env_detail(void) {
+    char *env_start = (char *) env_cache + ENV_PARAM_PART_BYTE_SIZE, *env = env_start,
+            *read_end = env_start, *env_str_end;
+    uint32_t read_addr = get_env_detail_addr();
+    size_t env_detail_size = get_env_detail_size(), read_size, env_len;
+
+    env_crc_sum = 0;
+    while (read_end < env_start + env_detail_size) {
+        read_size = env_start + env_detail_size - read_end;
+        if (read_size > ENV_LOAD_BLOCK_SIZE) {
+            read_size = ENV_LOAD_BLOCK_SIZE;
+        }
+        flash_read(read_addr, (uint32_t *) read_end, read_size);
+        read_addr += read_size;
+        read_end += read_size;
+        /* calculate all complete ENV CRC32 code in this block */
+        while (env < read_end) {
+            env_str_end = memchr(env, '\0', read_end - env);
+            if (env_str_end == NULL) {
+                /* this ENV will be completed in next block */
+                break;
+            }
+            /* ENV length contain '\0' and word alignment */
+            env_len = env_str_end - env + 1;
+            if (env_len % 4 != 0) {
+                env_len = (env_len / 4 + 1) * 4;
+            }
+            env_crc_sum += calc_crc32(0, env, env_len);
+            env += env_len;
+        }
+    }
+
+    return env == read_end;
+}
+
 /**
  * Save ENV to flash.
  */
@@ -661,11 +802,27 @@ FlashErrCode flash_save_env(void) {
 static uint32_t calc_env_crc(void) {
     uint32_t crc32 = 0;
 
+    /* Calculate the ENV end address CRC32 by all ENV CRC32 code sum.
+     * The 4 is ENV end address bytes size. */
+    crc32 = calc_crc32(env_crc_sum, &env_cache[ENV_PARAM_PART_INDEX_END_ADDR], 4);
+    FLASH_DEBUG("Calculate Env CRC32 number is 0x%08X.\n", crc32);
+
+    return crc32;
+}
+
+/**
+ * Calculate the cached ENV CRC32 value by the whole detail part.
+ * It's only used for the ENV which was saved by old version.
+ *
+ * @return CRC32 value
+ */
+static uint32_t calc_env_crc_legacy(void) {
+    uint32_t crc32 = 0;
+
     /* Calculate the ENV end address and all ENV data CRC32.
      * The 4 is ENV end address bytes size. */
     crc32 = calc_crc32(crc32, &env_cache[ENV_PARAM_PART_INDEX_END_ADDR], 4);
     crc32 = calc_crc32(crc32, &env_cache[ENV_PARAM_PART_WORD_SIZE], get_env_detail_size());
-    FLASH_DEBUG("Calculate Env CRC32 number is 0x%08X.\n", crc32);
 
     return crc32;
 }
@@ -679,6 +836,10 @@ static bool env_crc_is_ok(void) {
     if (calc_env_crc() == env_cache[ENV_PARAM_PART_INDEX_DATA_CRC]) {
         FLASH_DEBUG("Verify Env CRC32 result is OK.\n");
         return true;
+    } else if (calc_env_crc_legacy() == env_cache[ENV_PARAM_PART_INDEX_DATA_CRC]) {
+        /* it will be saved by the combined CRC32 code on next save */
+        FLASH_DEBUG("Verify Env CRC32 result is OK. It was saved by old version.\n");
+        return true;
     } else {
         return false;
     }
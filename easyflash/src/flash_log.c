@@ -27,22 +27,231 @@
  */
 
 #include "flash.h"
+#include <string.h>
 
 #ifdef FLASH_USING_LOG
 
-/* the stored logs start address and end address. It's like a ring buffer which implement by flash. */
-static uint32_t log_start_addr = 0, log_end_addr = 0;
-/* saved log area address for flash */
-static uint32_t log_area_start_addr = 0;
-/* saved log area total size */
-static size_t flash_log_size = 0;
+#ifdef FLASH_LOG_USING_SECTOR_HEAD
+/**
+ * Every log sector starts with a sector head (magic code, sequence number and state). The sequence
+ * number is increased when a new sector is used, so the oldest and newest sector can be found by
+ * reading one sector head per sector. The state is blank when the sector is using, and it will be
+ * set to full when the log moves to next sector. Only the using sector data will be scanned to find
+ * the log end address when initialize. The sector head isn't contained in the log index.
+ * When the background pre-erase is used, the sectors after the using sector are erased ahead of
+ * time, the oldest sector is dropped when it's erased. The erased sector has no sector head, so
+ * it's verified by reading when initialize.
+ * When the log time index is used, the sector head also has the minimum record timestamp (written
+ * with the first record) and the maximum record timestamp (written before the state is set to full).
+ */
+
+/* the log sector head index and size */
+enum {
+    /* the sector magic code index in head */
+    LOG_SECTOR_HEAD_INDEX_MAGIC = 0,
+    /* the sector sequence number index in head */
+    LOG_SECTOR_HEAD_INDEX_SEQ,
+    /* the sector state index in head */
+    LOG_SECTOR_HEAD_INDEX_STATE,
+#ifdef FLASH_LOG_USING_TIME_INDEX
+    /* the minimum and maximum record timestamp index in head */
+    LOG_SECTOR_HEAD_INDEX_MIN_TIME,
+    LOG_SECTOR_HEAD_INDEX_MAX_TIME,
+#endif
+    /* the sector head word size */
+    LOG_SECTOR_HEAD_WORD_SIZE,
+    /* the sector head byte size */
+    LOG_SECTOR_HEAD_BYTE_SIZE = LOG_SECTOR_HEAD_WORD_SIZE * 4,
+};
+/* the sector head magic code, it's "EFLS" */
+#define LOG_SECTOR_MAGIC               0x534C4645
+/* the sector head state when the sector is full */
+#define LOG_SECTOR_STATE_FULL          0x00000000
+#else
+/* there is no sector head in log sector */
+#define LOG_SECTOR_HEAD_BYTE_SIZE      0
+#endif
+
+#ifdef FLASH_LOG_USING_RECORD
+/**
+ * The log record storage format is head(3 words) + data + word alignment part + commit word.
+ * The head contains information (magic code and data length), sequence number and CRC32 code.
+ * The head has a timestamp word before the CRC32 code when the log time index is used.
+ * The CRC32 code is calculated by the head words before it, data and the word alignment
+ * part. The commit word (commit magic code and data length) is written last, so the torn record
+ * can be found. The record never crosses the sector, the remaining part of sector is filled by 0.
+ * The torn record at the end of log will be sealed by 0 when initialize.
+ */
+
+/* the log record head index and size */
+enum {
+    /* the record information (magic code and data length) index in head */
+    LOG_RECORD_HEAD_INDEX_INFO = 0,
+    /* the record sequence number index in head */
+    LOG_RECORD_HEAD_INDEX_SEQ,
+#ifdef FLASH_LOG_USING_TIME_INDEX
+    /* the record timestamp index in head */
+    LOG_RECORD_HEAD_INDEX_TIME,
+#endif
+    /* the record CRC32 code index in head */
+    LOG_RECORD_HEAD_INDEX_CRC,
+    /* the record head word size */
+    LOG_RECORD_HEAD_WORD_SIZE,
+    /* the record head byte size */
+    LOG_RECORD_HEAD_BYTE_SIZE = LOG_RECORD_HEAD_WORD_SIZE * 4,
+};
+/* the record information magic code(bit16-31), it's "LR" */
+#define LOG_RECORD_MAGIC               0x4C52
+/* the record commit magic code(bit16-31), it's "CM" */
+#define LOG_RECORD_COMMIT_MAGIC        0x434D
+/* make the record information and commit word by data length(bit0-15) */
+#define LOG_RECORD_INFO(len)           (((uint32_t) LOG_RECORD_MAGIC << 16) | (len))
+#define LOG_RECORD_COMMIT(len)         (((uint32_t) LOG_RECORD_COMMIT_MAGIC << 16) | (len))
+/* get the magic code and data length from record information or commit word */
+#define LOG_RECORD_MAGIC_OF(word)      ((word) >> 16)
+#define LOG_RECORD_LEN_OF(word)        ((word) & 0xFFFF)
+/* the record storage size by data length, contain head, word alignment part and commit word */
+#define LOG_RECORD_SIZE(len)           (LOG_RECORD_HEAD_BYTE_SIZE + ((len) + 3) / 4 * 4 + 4)
+/* the block bytes size when read or write record data, must be word alignment */
+#define LOG_RECORD_BLOCK_SIZE          64
+#endif
+
+#ifdef FLASH_LOG_USING_CHANNEL
+/* every log channel has its own log ring */
+#define LOG_RING_NUM                   FLASH_LOG_CHANNEL_MAX
+#else
+#define LOG_RING_NUM                   1
+#endif
+
+/* the log ring, it's the log sectors and their state */
+typedef struct _log_ring {
+    /* the stored logs start address and end address. It's like a ring buffer which implement by flash. */
+    uint32_t start_addr;
+    uint32_t end_addr;
+    /* saved log area address for flash */
+    uint32_t area_start_addr;
+    /* saved log area total size */
+    size_t area_size;
+#ifdef FLASH_LOG_USING_CHANNEL
+    /* the channel name and minimum level */
+    const char *name;
+    uint8_t level;
+#endif
+#ifdef FLASH_LOG_USING_SECTOR_HEAD
+    /* the sequence number of newest sector */
+    uint32_t sector_seq;
+#endif
+#ifdef FLASH_LOG_USING_PRE_ERASE
+    /* the erased sector number after the using sector */
+    size_t pre_erased_num;
+#endif
+#ifdef FLASH_LOG_USING_RECORD
+    /* the sequence number of last record */
+    uint32_t record_seq;
+#endif
+#ifdef FLASH_LOG_USING_ITERATOR
+    /* the sparse record index, it's the first record sequence number of every indexed sector, 0 is unknown */
+    uint32_t sec_first_seq[FLASH_LOG_ITER_INDEX_SIZE];
+    /* only one sector of every index stride sectors is indexed */
+    size_t index_stride;
+#endif
+#ifdef FLASH_LOG_USING_TIME_INDEX
+    /* the timestamp of last record */
+    uint32_t record_time;
+    /* the RAM time summary, it's the minimum record timestamp of every summarized sector,
+     * 0xFFFFFFFF is empty */
+    uint32_t sec_min_time[FLASH_LOG_TIME_INDEX_SIZE];
+    /* only one sector of every time stride sectors is summarized */
+    size_t time_stride;
+#endif
+#ifdef FLASH_LOG_USING_STAGING
+    /* the appended log which hasn't been saved */
+    uint32_t staging_buf[FLASH_LOG_STAGING_SIZE / 4];
+    /* the staged log bytes size */
+    size_t staged_size;
+#endif
+} log_ring, *log_ring_t;
+
+/**
+ * The log functions are locked by port when the log channel or the background pre-erase is used,
+ * because the log channel writer swaps the selected log ring and the pre-erase changes the log
+ * ring in other task. The public log functions only take the lock, and they call the static
+ * functions which operate on the selected log ring.
+ */
+
+/* all log rings */
+static log_ring log_rings[LOG_RING_NUM];
+/* the log ring which all log functions operate on */
+static log_ring_t cur_ring = &log_rings[0];
+#ifdef FLASH_LOG_USING_CHANNEL
+/* the log channel number */
+static size_t log_channel_num = 0;
+#endif
 /* the minimum size of flash erasure */
 static size_t flash_erase_min_size = 0;
 /* initialize OK flag */
 static bool init_ok = false;
 
+static void init_ring(log_ring_t ring, uint32_t start_addr, size_t size);
+static void log_lock(void);
+static void log_unlock(void);
 static void find_start_and_end_addr(void);
+static size_t get_used_size(void);
+static FlashErrCode read_log(size_t index, uint32_t *log, size_t size);
+static FlashErrCode write_log(const uint32_t *log, size_t size);
+static FlashErrCode clean_log(void);
 static uint32_t get_next_flash_sec_addr(uint32_t cur_addr);
+#ifdef FLASH_LOG_USING_RECORD
+static size_t get_cur_sec_remain_size(void);
+static uint32_t log_index_to_addr(size_t index);
+#endif
+#if defined(FLASH_LOG_USING_RECORD) && !defined(FLASH_LOG_USING_SECTOR_HEAD)
+static bool find_newest_record_sector(void);
+#endif
+#ifdef FLASH_LOG_USING_SECTOR_HEAD
+static FlashErrCode open_next_sector(void);
+static FlashErrCode erase_log_sector(uint32_t sec_addr);
+#endif
+#ifdef FLASH_LOG_USING_PRE_ERASE
+static FlashErrCode pre_erase_ring(bool *erased);
+#endif
+#ifdef FLASH_LOG_USING_STAGING
+static FlashErrCode stage_log(const void *log, size_t size);
+static FlashErrCode flush_staged_log(void);
+static FlashErrCode save_staged_log(bool all);
+#endif
+#ifdef FLASH_LOG_USING_ITERATOR
+static FlashErrCode iter_to_first(flash_log_iter *iter);
+static FlashErrCode iter_to_last(flash_log_iter *iter);
+static FlashErrCode iter_to_next(flash_log_iter *iter);
+static FlashErrCode iter_to_prev(flash_log_iter *iter);
+static FlashErrCode seek_iter(flash_log_iter *iter, uint32_t seq);
+static FlashErrCode read_iter(const flash_log_iter *iter, void *buf, size_t size);
+static void build_record_index(void);
+static void update_record_index(uint32_t head_addr, uint32_t seq);
+static size_t log_addr_to_index(uint32_t addr);
+static bool find_prev_record(size_t *index, uint32_t *head);
+static bool locate_iter(const flash_log_iter *iter, size_t *index);
+static FlashErrCode set_iter(flash_log_iter *iter, size_t index, const uint32_t *head);
+#endif
+#ifdef FLASH_LOG_USING_TIME_INDEX
+static FlashErrCode query_time_range(uint32_t start_time, uint32_t end_time, void *buf, size_t size,
+        flash_log_query_cb cb, void *arg);
+static void build_time_index(void);
+static void set_sec_min_time(uint32_t sec_addr, uint32_t time);
+static uint32_t get_sec_min_time(size_t sec_index);
+static FlashErrCode write_sec_min_time(uint32_t sec_addr, uint32_t time);
+static FlashErrCode write_sec_max_time(uint32_t sec_addr);
+#endif
+#ifdef FLASH_LOG_USING_RECORD
+static FlashErrCode append_record(const void *data, size_t len);
+static FlashErrCode read_next_record(size_t *index, void *buf, size_t size, size_t *len);
+static uint32_t calc_record_crc(const uint32_t *head, const void *data, size_t len);
+static bool check_record(size_t index, uint32_t *head, void *buf, size_t size);
+static bool find_next_record(size_t *index, size_t end_index, uint32_t *head, void *buf, size_t size);
+static bool fill_blank_words(uint32_t addr, uint32_t end_addr);
+static void seal_torn_record(void);
+#endif
 
 /**
  * The flash save log function initialize.
@@ -55,6 +264,11 @@ static uint32_t get_next_flash_sec_addr(uint32_t cur_addr);
  */
 FlashErrCode flash_log_init(uint32_t start_addr, size_t log_size, size_t erase_min_size) {
     FlashErrCode result = FLASH_NO_ERR;
+    size_t ring_num = 1, i;
+#ifdef FLASH_LOG_USING_CHANNEL
+    const flash_log_channel *channels;
+    size_t ring_size;
+#endif
 
     FLASH_ASSERT(start_addr);
     FLASH_ASSERT(log_size);
@@ -64,18 +278,91 @@ FlashErrCode flash_log_init(uint32_t start_addr, size_t log_size, size_t erase_m
     /* the log area size must be more than 2 multiple of erase minimum size */
     FLASH_ASSERT(log_size / erase_min_size >= 2);
 
-    log_area_start_addr = start_addr;
-    flash_log_size = log_size;
     flash_erase_min_size = erase_min_size;
 
-    /* find the log store start address and end address */
-    find_start_and_end_addr();
+#ifdef FLASH_LOG_USING_CHANNEL
+    flash_log_port_get_channels(&channels, &log_channel_num);
+    FLASH_ASSERT(log_channel_num && log_channel_num <= FLASH_LOG_CHANNEL_MAX);
+    ring_num = log_channel_num;
+    /* the channels are placed in log area by order */
+    for (i = 0; i < log_channel_num; i++) {
+        ring_size = channels[i].sec_num * erase_min_size;
+        /* the channel sector number must be more than 2 */
+        FLASH_ASSERT(channels[i].sec_num >= 2);
+        FLASH_ASSERT(ring_size <= log_size);
+        log_rings[i].name = channels[i].name;
+        log_rings[i].level = channels[i].level;
+        init_ring(&log_rings[i], start_addr, ring_size);
+        start_addr += ring_size;
+        log_size -= ring_size;
+    }
+#else
+    init_ring(&log_rings[0], start_addr, log_size);
+#endif
     /* initialize OK */
     init_ok = true;
+    for (i = 0; i < ring_num; i++) {
+        cur_ring = &log_rings[i];
+#ifdef FLASH_LOG_USING_ITERATOR
+        build_record_index();
+#endif
+#ifdef FLASH_LOG_USING_TIME_INDEX
+        build_time_index();
+#endif
+    }
+    cur_ring = &log_rings[0];
 
     return result;
 }
 
+/**
+ * Initialize the log ring, find its log store start address and end address.
+ *
+ * @param ring log ring
+ * @param start_addr ring area start address
+ * @param size ring area total size
+ */
+static void init_ring(log_ring_t ring, uint32_t start_addr, size_t size) {
+    cur_ring = ring;
+    cur_ring->area_start_addr = start_addr;
+    cur_ring->area_size = size;
+#ifdef FLASH_LOG_USING_PRE_ERASE
+    /* the using sector and the oldest sector are never pre-erased */
+    FLASH_ASSERT(size / flash_erase_min_size >= FLASH_LOG_PRE_ERASE_SEC_NUM + 2);
+    /* the erased sectors will be verified by reading in background */
+    cur_ring->pre_erased_num = 0;
+#endif
+
+    /* find the log store start address and end address */
+    find_start_and_end_addr();
+#ifdef FLASH_LOG_USING_RECORD
+    /* the torn record is only at the end of log */
+    seal_torn_record();
+#endif
+#ifdef FLASH_LOG_USING_STAGING
+    cur_ring->staged_size = 0;
+#endif
+}
+
+/**
+ * Lock the log rings by port when the log channel or the background pre-erase is used.
+ */
+static void log_lock(void) {
+#if defined(FLASH_LOG_USING_CHANNEL) || defined(FLASH_LOG_USING_PRE_ERASE)
+    flash_log_lock();
+#endif
+}
+
+/**
+ * Unlock the log rings.
+ */
+static void log_unlock(void) {
+#if defined(FLASH_LOG_USING_CHANNEL) || defined(FLASH_LOG_USING_PRE_ERASE)
+    flash_log_unlock();
+#endif
+}
+
+#ifndef FLASH_LOG_USING_SECTOR_HEAD
 /**
  * Find the log store start address and end address.
  * It's like a ring buffer which implement by flash.
@@ -106,17 +393,17 @@ static void find_start_and_end_addr(void) {
     /* all status sector counts */
     size_t empty_sec_counts = 0, using_sec_counts = 0, full_sector_counts = 0;
     /* total sector number */
-    size_t total_sec_num = flash_log_size / flash_erase_min_size;
+    size_t total_sec_num = cur_ring->area_size / flash_erase_min_size;
     /* see comment of find_start_and_end_addr function */
     uint8_t cur_log_sec_state = 0;
 
     /* get the first sector status */
-    cur_sec_status = flash_get_sector_status(log_area_start_addr, flash_erase_min_size);
+    cur_sec_status = flash_get_sector_status(cur_ring->area_start_addr, flash_erase_min_size);
     last_sec_status = cur_sec_status;
 
-    for (cur_size = flash_erase_min_size; cur_size < flash_log_size; cur_size += flash_erase_min_size) {
+    for (cur_size = flash_erase_min_size; cur_size < cur_ring->area_size; cur_size += flash_erase_min_size) {
         /* get current sector status */
-        cur_sec_status = flash_get_sector_status(log_area_start_addr + cur_size, flash_erase_min_size);
+        cur_sec_status = flash_get_sector_status(cur_ring->area_start_addr + cur_size, flash_erase_min_size);
         /* compare last and current status */
         switch (last_sec_status) {
         case FLASH_SECTOR_EMPTY: {
@@ -125,11 +412,11 @@ static void find_start_and_end_addr(void) {
                 break;
             case FLASH_SECTOR_USING:
                 FLASH_DEBUG("Error: Log area error! Now will clean all log area.\n");
-                flash_log_clean();
+                clean_log();
                 return;
             case FLASH_SECTOR_FULL:
                 FLASH_DEBUG("Error: Log area error! Now will clean all log area.\n");
-                flash_log_clean();
+                clean_log();
                 return;
             }
             empty_sec_counts++;
@@ -140,18 +427,18 @@ static void find_start_and_end_addr(void) {
             case FLASH_SECTOR_EMPTY:
                 /* like state 1 */
                 cur_log_sec_state = 1;
-                log_start_addr = log_area_start_addr;
-                cur_using_sec_addr = log_area_start_addr + cur_size - flash_erase_min_size;
+                cur_ring->start_addr = cur_ring->area_start_addr;
+                cur_using_sec_addr = cur_ring->area_start_addr + cur_size - flash_erase_min_size;
                 break;
             case FLASH_SECTOR_USING:
                 FLASH_DEBUG("Error: Log area error! Now will clean all log area.\n");
-                flash_log_clean();
+                clean_log();
                 return;
             case FLASH_SECTOR_FULL:
                 /* like state 2 */
                 cur_log_sec_state = 2;
-                log_start_addr = log_area_start_addr + cur_size;
-                cur_using_sec_addr = log_area_start_addr + cur_size - flash_erase_min_size;
+                cur_ring->start_addr = cur_ring->area_start_addr + cur_size;
+                cur_using_sec_addr = cur_ring->area_start_addr + cur_size - flash_erase_min_size;
                 break;
             }
             using_sec_counts++;
@@ -163,22 +450,22 @@ static void find_start_and_end_addr(void) {
                 /* like state 1 */
                 if (cur_log_sec_state == 2) {
                     FLASH_DEBUG("Error: Log area error! Now will clean all log area.\n");
-                    flash_log_clean();
+                    clean_log();
                     return;
                 } else {
                     cur_log_sec_state = 1;
-                    log_start_addr = log_area_start_addr;
+                    cur_ring->start_addr = cur_ring->area_start_addr;
                     /* word alignment */
-                    log_end_addr = log_area_start_addr + cur_size - 4;
-                    cur_using_sec_addr = log_area_start_addr + cur_size - flash_erase_min_size;
+                    cur_ring->end_addr = cur_ring->area_start_addr + cur_size - 4;
+                    cur_using_sec_addr = cur_ring->area_start_addr + cur_size - flash_erase_min_size;
                 }
                 break;
             case FLASH_SECTOR_USING:
                 if(total_sec_num <= 2) {
                     /* like state 1 */
                     cur_log_sec_state = 1;
-                    log_start_addr = log_area_start_addr;
-                    cur_using_sec_addr = log_area_start_addr + cur_size;
+                    cur_ring->start_addr = cur_ring->area_start_addr;
+                    cur_using_sec_addr = cur_ring->area_start_addr + cur_size;
                 } else {
                     /* state 1 or 2*/
                 }
@@ -204,38 +491,86 @@ static void find_start_and_end_addr(void) {
 
     if (using_sec_counts > 1) {
         FLASH_DEBUG("Error: Log area error! Now will clean all log area.\n");
-        flash_log_clean();
+        clean_log();
         return;
     } else if (empty_sec_counts == total_sec_num) {
-        log_start_addr = log_end_addr = log_area_start_addr;
+        cur_ring->start_addr = cur_ring->end_addr = cur_ring->area_start_addr;
     } else if (full_sector_counts == total_sec_num) {
+#ifdef FLASH_LOG_USING_RECORD
+        /* the record padding fills the using sector to its end, so the sector after it isn't erased */
+        if (find_newest_record_sector()) {
+            return;
+        }
+#endif
         /* this state is almost impossible */
         FLASH_DEBUG("Error: Log area error! Now will clean all log area.\n");
-        flash_log_clean();
+        clean_log();
         return;
     } else if (((cur_log_sec_state == 1) && (cur_using_sec_addr != 0))
             || (cur_log_sec_state == 2)) {
         /* find the end address */
-        log_end_addr = flash_find_sec_using_end_addr(cur_using_sec_addr, flash_erase_min_size);
+        cur_ring->end_addr = flash_find_sec_using_end_addr(cur_using_sec_addr, flash_erase_min_size);
+    }
+}
+
+#ifdef FLASH_LOG_USING_RECORD
+/**
+ * Find the log start address and end address by record sequence when all sectors are full.
+ * The sector which first record has the greatest sequence is the newest sector.
+ *
+ * @return true when the newest sector has been found
+ */
+static bool find_newest_record_sector(void) {
+    uint32_t sec_addr, sec_end_addr, addr, head[LOG_RECORD_HEAD_WORD_SIZE], newest_sec_addr = 0,
+            newest_seq = 0;
+
+    for (sec_addr = cur_ring->area_start_addr; sec_addr < cur_ring->area_start_addr + cur_ring->area_size;
+            sec_addr += flash_erase_min_size) {
+        sec_end_addr = sec_addr + flash_erase_min_size;
+        /* the leading filled words are skipped */
+        for (addr = sec_addr; addr + LOG_RECORD_HEAD_BYTE_SIZE <= sec_end_addr; addr += 4) {
+            flash_read(addr, head, 4);
+            if (head[LOG_RECORD_HEAD_INDEX_INFO] != 0) {
+                break;
+            }
+        }
+        if (addr + LOG_RECORD_HEAD_BYTE_SIZE > sec_end_addr
+                || LOG_RECORD_MAGIC_OF(head[LOG_RECORD_HEAD_INDEX_INFO]) != LOG_RECORD_MAGIC) {
+            continue;
+        }
+        flash_read(addr, head, LOG_RECORD_HEAD_BYTE_SIZE);
+        if (head[LOG_RECORD_HEAD_INDEX_SEQ] >= newest_seq) {
+            newest_seq = head[LOG_RECORD_HEAD_INDEX_SEQ];
+            newest_sec_addr = sec_addr;
+        }
+    }
+    if (newest_sec_addr == 0) {
+        return false;
     }
+    /* the sector after the newest sector is the oldest sector */
+    cur_ring->end_addr = newest_sec_addr + flash_erase_min_size - 4;
+    cur_ring->start_addr = get_next_flash_sec_addr(newest_sec_addr);
+
+    return true;
 }
+#endif /* FLASH_LOG_USING_RECORD */
 
 /**
  * Get log used flash total size.
  *
  * @return log used flash total size
  */
-size_t flash_log_get_used_size(void) {
-    FLASH_ASSERT(log_start_addr);
-    FLASH_ASSERT(log_end_addr);
+static size_t get_used_size(void) {
+    FLASH_ASSERT(cur_ring->start_addr);
+    FLASH_ASSERT(cur_ring->end_addr);
 
     /* must be call this function after initialize OK */
     FLASH_ASSERT(init_ok);
 
-    if (log_start_addr < log_end_addr) {
-        return log_end_addr - log_start_addr + 4;
-    } else if (log_start_addr > log_end_addr) {
-        return flash_log_size - (log_start_addr - log_end_addr) + 4;
+    if (cur_ring->start_addr < cur_ring->end_addr) {
+        return cur_ring->end_addr - cur_ring->start_addr + 4;
+    } else if (cur_ring->start_addr > cur_ring->end_addr) {
+        return cur_ring->area_size - (cur_ring->start_addr - cur_ring->end_addr) + 4;
     } else {
         return 0;
     }
@@ -252,9 +587,9 @@ size_t flash_log_get_used_size(void) {
  *
  * @return result
  */
-FlashErrCode flash_log_read(size_t index, uint32_t *log, size_t size) {
+static FlashErrCode read_log(size_t index, uint32_t *log, size_t size) {
     FlashErrCode result = FLASH_NO_ERR;
-    size_t cur_using_size = flash_log_get_used_size();
+    size_t cur_using_size = get_used_size();
     size_t read_size_temp = 0;
 
     FLASH_ASSERT(size % 4 == 0);
@@ -266,10 +601,10 @@ FlashErrCode flash_log_read(size_t index, uint32_t *log, size_t size) {
         return result;
     }
 
-    if (log_start_addr < log_end_addr) {
-        result = flash_read(log_area_start_addr + index, log, size);
-    } else if (log_start_addr > log_end_addr) {
-        if (log_start_addr + index + size <= log_area_start_addr + flash_log_size) {
+    if (cur_ring->start_addr < cur_ring->end_addr) {
+        result = flash_read(cur_ring->area_start_addr + index, log, size);
+    } else if (cur_ring->start_addr > cur_ring->end_addr) {
+        if (cur_ring->start_addr + index + size <= cur_ring->area_start_addr + cur_ring->area_size) {
             /*                          Flash log area
              *                         |--------------|
              * log_area_start_addr --> |##############|
@@ -287,8 +622,8 @@ FlashErrCode flash_log_read(size_t index, uint32_t *log, size_t size) {
              *
              * read from (log_start_addr + index) to (log_start_addr + index + size)
              */
-            result = flash_read(log_start_addr + index, log, size);
-        } else if (log_start_addr + index < log_area_start_addr + flash_log_size) {
+            result = flash_read(cur_ring->start_addr + index, log, size);
+        } else if (cur_ring->start_addr + index < cur_ring->area_start_addr + cur_ring->area_size) {
             /*                          Flash log area
              *                         |--------------|
              * log_area_start_addr --> |**************| <-- read end
@@ -307,10 +642,11 @@ FlashErrCode flash_log_read(size_t index, uint32_t *log, size_t size) {
              * step1: read from (log_start_addr + index) to flash log area end address
              * step2: read from flash log area start address to read size's end address
              */
-            read_size_temp = (log_area_start_addr + flash_log_size) - (log_start_addr + index);
-            result = flash_read(log_start_addr + index, log, read_size_temp);
+            read_size_temp = (cur_ring->area_start_addr + cur_ring->area_size)
+                    - (cur_ring->start_addr + index);
+            result = flash_read(cur_ring->start_addr + index, log, read_size_temp);
             if (result == FLASH_NO_ERR) {
-                result = flash_read(log_area_start_addr, log + read_size_temp,
+                result = flash_read(cur_ring->area_start_addr, log + read_size_temp / 4,
                         size - read_size_temp);
             }
         } else {
@@ -330,7 +666,7 @@ FlashErrCode flash_log_read(size_t index, uint32_t *log, size_t size) {
              *                         |--------------|
              * read from (log_start_addr + index - flash_log_size) to read size's end address
              */
-            result = flash_read(log_start_addr + index - flash_log_size, log, size);
+            result = flash_read(cur_ring->start_addr + index - cur_ring->area_size, log, size);
         }
     }
 
@@ -345,9 +681,9 @@ FlashErrCode flash_log_read(size_t index, uint32_t *log, size_t size) {
  *
  * @return result
  */
-FlashErrCode flash_log_write(const uint32_t *log, size_t size) {
+static FlashErrCode write_log(const uint32_t *log, size_t size) {
     FlashErrCode result = FLASH_NO_ERR;
-    size_t cur_using_size = flash_log_get_used_size(), write_size = 0, writable_size = 0;
+    size_t cur_using_size = get_used_size(), write_size = 0, writable_size = 0;
     uint32_t write_addr, erase_addr;
 
     FLASH_ASSERT(size % 4 == 0);
@@ -355,9 +691,9 @@ FlashErrCode flash_log_write(const uint32_t *log, size_t size) {
     FLASH_ASSERT(init_ok);
 
     /* write address is after log end address  */
-    write_addr = log_end_addr + 4;
+    write_addr = cur_ring->end_addr + 4;
     /* write the already erased but not used area */
-    writable_size = flash_erase_min_size - ((write_addr - log_area_start_addr) % flash_erase_min_size);
+    writable_size = flash_erase_min_size - ((write_addr - cur_ring->area_start_addr) % flash_erase_min_size);
     if (writable_size != flash_erase_min_size) {
         if (size > writable_size) {
             result = flash_write(write_addr, log, writable_size);
@@ -367,7 +703,7 @@ FlashErrCode flash_log_write(const uint32_t *log, size_t size) {
             write_size += writable_size;
         } else {
             result = flash_write(write_addr, log, size);
-            log_end_addr = write_addr + size - 4;
+            cur_ring->end_addr = write_addr + size - 4;
             goto exit;
         }
     }
@@ -376,8 +712,8 @@ FlashErrCode flash_log_write(const uint32_t *log, size_t size) {
         /* calculate next available sector address */
         erase_addr = write_addr = get_next_flash_sec_addr(write_addr - 4);
         /* move the flash log start address to next available sector address */
-        if (log_start_addr == erase_addr) {
-            log_start_addr = get_next_flash_sec_addr(log_start_addr);
+        if (cur_ring->start_addr == erase_addr) {
+            cur_ring->start_addr = get_next_flash_sec_addr(cur_ring->start_addr);
         }
         /* erase sector */
         result = flash_erase(erase_addr, flash_erase_min_size);
@@ -387,7 +723,7 @@ FlashErrCode flash_log_write(const uint32_t *log, size_t size) {
                 if (result != FLASH_NO_ERR) {
                     goto exit;
                 }
-                log_end_addr = write_addr + flash_erase_min_size - 4;
+                cur_ring->end_addr = write_addr + flash_erase_min_size - 4;
                 write_size += flash_erase_min_size;
                 write_addr += flash_erase_min_size;
             } else {
@@ -395,7 +731,7 @@ FlashErrCode flash_log_write(const uint32_t *log, size_t size) {
                 if (result != FLASH_NO_ERR) {
                     goto exit;
                 }
-                log_end_addr = write_addr + (size - write_size) - 4;
+                cur_ring->end_addr = write_addr + (size - write_size) - 4;
                 break;
             }
         } else {
@@ -406,6 +742,7 @@ FlashErrCode flash_log_write(const uint32_t *log, size_t size) {
 exit:
     return result;
 }
+#endif /* FLASH_LOG_USING_SECTOR_HEAD */
 
 /**
  * Get next flash sector address.The log total sector like ring buffer which implement by flash.
@@ -415,13 +752,13 @@ exit:
  * @return next flash sector address
  */
 static uint32_t get_next_flash_sec_addr(uint32_t cur_addr) {
-    size_t cur_sec_id = (cur_addr - log_area_start_addr) / flash_erase_min_size;
-    size_t sec_total_num = flash_log_size / flash_erase_min_size;
+    size_t cur_sec_id = (cur_addr - cur_ring->area_start_addr) / flash_erase_min_size;
+    size_t sec_total_num = cur_ring->area_size / flash_erase_min_size;
     if (cur_sec_id + 1 >= sec_total_num) {
         /* return to ring head */
-        return log_area_start_addr;
+        return cur_ring->area_start_addr;
     } else {
-        return log_area_start_addr + (cur_sec_id + 1) * flash_erase_min_size;
+        return cur_ring->area_start_addr + (cur_sec_id + 1) * flash_erase_min_size;
     }
 }
 
@@ -430,18 +767,1661 @@ static uint32_t get_next_flash_sec_addr(uint32_t cur_addr) {
  *
  * @return result
  */
-FlashErrCode flash_log_clean(void) {
+static FlashErrCode clean_log(void) {
     FlashErrCode result = FLASH_NO_ERR;
 
-    FLASH_ASSERT(log_area_start_addr);
-    FLASH_ASSERT(flash_log_size);
+    FLASH_ASSERT(cur_ring->area_start_addr);
+    FLASH_ASSERT(cur_ring->area_size);
 
     /* clean address */
-    log_start_addr = log_end_addr = log_area_start_addr;
+    cur_ring->start_addr = cur_ring->end_addr = cur_ring->area_start_addr;
+#ifdef FLASH_LOG_USING_SECTOR_HEAD
+    cur_ring->sector_seq = 0;
+#endif
+#ifdef FLASH_LOG_USING_PRE_ERASE
+    cur_ring->pre_erased_num = 0;
+#endif
+#ifdef FLASH_LOG_USING_STAGING
+    /* the staged log is dropped too */
+    cur_ring->staged_size = 0;
+#endif
+#ifdef FLASH_LOG_USING_ITERATOR
+    memset(cur_ring->sec_first_seq, 0, sizeof(cur_ring->sec_first_seq));
+#endif
+#ifdef FLASH_LOG_USING_TIME_INDEX
+    cur_ring->record_time = 0;
+    memset(cur_ring->sec_min_time, 0xFF, sizeof(cur_ring->sec_min_time));
+#endif
     /* erase log flash area */
-    result = flash_erase(log_area_start_addr, flash_log_size);
+    result = flash_erase(cur_ring->area_start_addr, cur_ring->area_size);
+
+    return result;
+}
+
+/**
+ * Clean all log of the selected log ring.
+ * @see clean_log
+ *
+ * @return result
+ */
+FlashErrCode flash_log_clean(void) {
+    FlashErrCode result;
+
+    log_lock();
+    result = clean_log();
+    log_unlock();
+
+    return result;
+}
+
+#ifdef FLASH_LOG_USING_SECTOR_HEAD
+/**
+ * Find the log store start address and end address by sector head.
+ * The oldest sector is the log start sector, and the newest sector is the using sector.
+ * The sector which has no valid sector head is empty.
+ */
+static void find_start_and_end_addr(void) {
+    uint32_t sec_addr, newest_addr = 0, oldest_addr = 0, oldest_seq = 0, head[LOG_SECTOR_HEAD_WORD_SIZE],
+            block[16];
+    size_t i, read_size;
+
+    cur_ring->sector_seq = 0;
+    for (sec_addr = cur_ring->area_start_addr; sec_addr < cur_ring->area_start_addr + cur_ring->area_size;
+            sec_addr += flash_erase_min_size) {
+        flash_read(sec_addr, head, LOG_SECTOR_HEAD_BYTE_SIZE);
+        if (head[LOG_SECTOR_HEAD_INDEX_MAGIC] != LOG_SECTOR_MAGIC) {
+            continue;
+        }
+        if (!newest_addr || head[LOG_SECTOR_HEAD_INDEX_SEQ] > cur_ring->sector_seq) {
+            newest_addr = sec_addr;
+            cur_ring->sector_seq = head[LOG_SECTOR_HEAD_INDEX_SEQ];
+        }
+        if (!oldest_addr || head[LOG_SECTOR_HEAD_INDEX_SEQ] < oldest_seq) {
+            oldest_addr = sec_addr;
+            oldest_seq = head[LOG_SECTOR_HEAD_INDEX_SEQ];
+        }
+    }
+
+    if (!newest_addr) {
+        /* all sectors are empty */
+        cur_ring->start_addr = cur_ring->end_addr = cur_ring->area_start_addr;
+        return;
+    }
+    cur_ring->start_addr = oldest_addr;
+    flash_read(newest_addr, head, LOG_SECTOR_HEAD_BYTE_SIZE);
+    if (head[LOG_SECTOR_HEAD_INDEX_STATE] != 0xFFFFFFFF) {
+        /* the newest sector is full */
+        cur_ring->end_addr = newest_addr + flash_erase_min_size - 4;
+        return;
+    }
+    /* find the last written word in using sector from the sector end */
+    cur_ring->end_addr = newest_addr + LOG_SECTOR_HEAD_BYTE_SIZE - 4;
+    for (sec_addr = newest_addr + flash_erase_min_size; sec_addr > newest_addr + LOG_SECTOR_HEAD_BYTE_SIZE;
+            sec_addr -= read_size) {
+        read_size = sec_addr - (newest_addr + LOG_SECTOR_HEAD_BYTE_SIZE);
+        read_size = read_size < sizeof(block) ? read_size : sizeof(block);
+        flash_read(sec_addr - read_size, block, read_size);
+        for (i = read_size / 4; i > 0; i--) {
+            if (block[i - 1] != 0xFFFFFFFF) {
+                cur_ring->end_addr = sec_addr - read_size + (i - 1) * 4;
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * Get log used flash total size. The sector head isn't contained.
+ *
+ * @return log used flash total size
+ */
+static size_t get_used_size(void) {
+    uint32_t end_sec_addr;
+    size_t sec_num;
+
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    if (cur_ring->start_addr == cur_ring->end_addr) {
+        return 0;
+    }
+    end_sec_addr = cur_ring->area_start_addr + (cur_ring->end_addr - cur_ring->area_start_addr)
+            / flash_erase_min_size * flash_erase_min_size;
+    if (cur_ring->start_addr <= end_sec_addr) {
+        sec_num = (end_sec_addr - cur_ring->start_addr) / flash_erase_min_size;
+    } else {
+        sec_num = (cur_ring->area_size - (cur_ring->start_addr - end_sec_addr)) / flash_erase_min_size;
+    }
+
+    return sec_num * (flash_erase_min_size - LOG_SECTOR_HEAD_BYTE_SIZE)
+            + (cur_ring->end_addr + 4 - (end_sec_addr + LOG_SECTOR_HEAD_BYTE_SIZE));
+}
+
+/**
+ * Read log from flash. The sector head will be skipped.
+ *
+ * @param index index for saved log.
+ *        Minimum index is 0.
+ *        Maximum index is log used flash total size - 1.
+ * @param log the log which will read from flash
+ * @param size read bytes size
+ *
+ * @return result
+ */
+static FlashErrCode read_log(size_t index, uint32_t *log, size_t size) {
+    FlashErrCode result = FLASH_NO_ERR;
+    size_t sec_data_size = flash_erase_min_size - LOG_SECTOR_HEAD_BYTE_SIZE, read_size;
+    uint32_t read_addr;
+
+    FLASH_ASSERT(size % 4 == 0);
+    FLASH_ASSERT(index + size <= get_used_size());
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    /* read the log data by sectors */
+    while (size && result == FLASH_NO_ERR) {
+        read_addr = cur_ring->start_addr + index / sec_data_size * flash_erase_min_size;
+        if (read_addr >= cur_ring->area_start_addr + cur_ring->area_size) {
+            read_addr -= cur_ring->area_size;
+        }
+        read_addr += LOG_SECTOR_HEAD_BYTE_SIZE + index % sec_data_size;
+        read_size = sec_data_size - index % sec_data_size;
+        read_size = size < read_size ? size : read_size;
+        result = flash_read(read_addr, log, read_size);
+        index += read_size;
+        log += read_size / 4;
+        size -= read_size;
+    }
+
+    return result;
+}
+
+/**
+ * Write log to flash. The next sector will be erased and its sector head will be written
+ * when the using sector is full.
+ *
+ * @param log the log which will be write to flash
+ * @param size write bytes size
+ *
+ * @return result
+ */
+static FlashErrCode write_log(const uint32_t *log, size_t size) {
+    FlashErrCode result = FLASH_NO_ERR;
+    size_t write_size;
+    uint32_t write_addr, sec_end_addr;
+
+    FLASH_ASSERT(size % 4 == 0);
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    while (size && result == FLASH_NO_ERR) {
+        write_addr = cur_ring->end_addr + 4;
+        sec_end_addr = cur_ring->area_start_addr + (cur_ring->end_addr - cur_ring->area_start_addr)
+                / flash_erase_min_size * flash_erase_min_size + flash_erase_min_size;
+        if (cur_ring->start_addr == cur_ring->end_addr || write_addr == sec_end_addr) {
+            result = open_next_sector();
+            continue;
+        }
+        write_size = sec_end_addr - write_addr;
+        write_size = size < write_size ? size : write_size;
+        result = flash_write(write_addr, log, write_size);
+        cur_ring->end_addr = write_addr + write_size - 4;
+        log += write_size / 4;
+        size -= write_size;
+    }
+
+    return result;
+}
+
+/**
+ * Set the using sector to full, then erase the next sector and write its sector head.
+ * The oldest sector will be dropped when the log area is full.
+ *
+ * @return result
+ */
+static FlashErrCode open_next_sector(void) {
+    FlashErrCode result = FLASH_NO_ERR;
+    uint32_t sec_addr, state = LOG_SECTOR_STATE_FULL, magic = LOG_SECTOR_MAGIC;
+
+    if (cur_ring->start_addr == cur_ring->end_addr) {
+        /* the log is empty */
+        sec_addr = cur_ring->area_start_addr;
+    } else {
+        /* the sector head state word is the third word */
+        sec_addr = cur_ring->area_start_addr + (cur_ring->end_addr - cur_ring->area_start_addr)
+                / flash_erase_min_size * flash_erase_min_size;
+#ifdef FLASH_LOG_USING_TIME_INDEX
+        result = write_sec_max_time(sec_addr);
+        if (result == FLASH_NO_ERR) {
+            result = flash_write(sec_addr + LOG_SECTOR_HEAD_INDEX_STATE * 4, &state, 4);
+        }
+#else
+        result = flash_write(sec_addr + LOG_SECTOR_HEAD_INDEX_STATE * 4, &state, 4);
+#endif
+        if (result != FLASH_NO_ERR) {
+            return result;
+        }
+        sec_addr = get_next_flash_sec_addr(sec_addr);
+        /* move the flash log start address to next available sector address */
+        if (cur_ring->start_addr == sec_addr) {
+            cur_ring->start_addr = get_next_flash_sec_addr(cur_ring->start_addr);
+        }
+    }
+#ifdef FLASH_LOG_USING_PRE_ERASE
+    if (cur_ring->pre_erased_num) {
+        /* the sector has been erased in background */
+        cur_ring->pre_erased_num--;
+    } else {
+        /* the background pre-erase can't keep up, then erase inline */
+        result = erase_log_sector(sec_addr);
+    }
+#else
+    result = erase_log_sector(sec_addr);
+#endif
+    if (result == FLASH_NO_ERR) {
+        cur_ring->sector_seq++;
+        /* the magic code is written after sequence number, so the torn sector head is invalid */
+        result = flash_write(sec_addr + LOG_SECTOR_HEAD_INDEX_SEQ * 4, &cur_ring->sector_seq, 4);
+        if (result == FLASH_NO_ERR) {
+            result = flash_write(sec_addr + LOG_SECTOR_HEAD_INDEX_MAGIC * 4, &magic, 4);
+        }
+    }
+    if (result == FLASH_NO_ERR) {
+        if (cur_ring->start_addr == cur_ring->end_addr) {
+            cur_ring->start_addr = sec_addr;
+        }
+        cur_ring->end_addr = sec_addr + LOG_SECTOR_HEAD_BYTE_SIZE - 4;
+    }
+
+    return result;
+}
+
+/**
+ * Erase the log sector, its RAM summary will be cleared.
+ *
+ * @param sec_addr sector address
+ *
+ * @return result
+ */
+static FlashErrCode erase_log_sector(uint32_t sec_addr) {
+    FlashErrCode result;
+
+    result = flash_erase(sec_addr, flash_erase_min_size);
+#ifdef FLASH_LOG_USING_TIME_INDEX
+    if (result == FLASH_NO_ERR) {
+        set_sec_min_time(sec_addr, 0xFFFFFFFF);
+    }
+#endif
+
+    return result;
+}
+#endif /* FLASH_LOG_USING_SECTOR_HEAD */
+
+/**
+ * Get log used flash total size of the selected log ring.
+ * @see get_used_size
+ *
+ * @return log used flash total size
+ */
+size_t flash_log_get_used_size(void) {
+    size_t used_size;
+
+    log_lock();
+    used_size = get_used_size();
+    log_unlock();
+
+    return used_size;
+}
+
+/**
+ * Read log from flash of the selected log ring.
+ * @see read_log
+ *
+ * @param index index for saved log
+ * @param log the log which will read from flash
+ * @param size read bytes size
+ *
+ * @return result
+ */
+FlashErrCode flash_log_read(size_t index, uint32_t *log, size_t size) {
+    FlashErrCode result;
+
+    log_lock();
+    result = read_log(index, log, size);
+    log_unlock();
+
+    return result;
+}
+
+/**
+ * Write log to flash of the selected log ring.
+ * @see write_log
+ *
+ * @param log the log which will be write to flash
+ * @param size write bytes size
+ *
+ * @return result
+ */
+FlashErrCode flash_log_write(const uint32_t *log, size_t size) {
+    FlashErrCode result;
+
+    log_lock();
+    result = write_log(log, size);
+    log_unlock();
+
+    return result;
+}
+
+#ifdef FLASH_LOG_USING_PRE_ERASE
+/**
+ * Erase the log sectors after the using sector in background, then the log write never erases
+ * inline when it keeps up. Only one sector is erased every call, so it should be called
+ * periodically, such as in a low priority task. The blank sector is verified by reading and isn't
+ * erased again. The log rings are locked during the erasure, so the log writer waits for it.
+ *
+ * @return result
+ */
+FlashErrCode flash_log_pre_erase(void) {
+    FlashErrCode result = FLASH_NO_ERR;
+    log_ring_t selected_ring;
+    size_t ring_num = 1, i;
+    bool erased = false;
+
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+#ifdef FLASH_LOG_USING_CHANNEL
+    ring_num = log_channel_num;
+#endif
+    log_lock();
+    selected_ring = cur_ring;
+    for (i = 0; i < ring_num && !erased && result == FLASH_NO_ERR; i++) {
+        cur_ring = &log_rings[i];
+        result = pre_erase_ring(&erased);
+    }
+    cur_ring = selected_ring;
+    log_unlock();
+
+    return result;
+}
+
+/**
+ * Pre-erase the next sector of the current ring until there are enough pre-erased sectors.
+ * The oldest sector start address is moved ahead of time when it's erased.
+ *
+ * @param erased the sector has been erased
+ *
+ * @return result
+ */
+static FlashErrCode pre_erase_ring(bool *erased) {
+    FlashErrCode result = FLASH_NO_ERR;
+    uint32_t sec_addr, block[16];
+    size_t i, j;
+    bool blank = true;
+
+    /* the first sector of empty log is erased when it's opened */
+    if (cur_ring->start_addr == cur_ring->end_addr
+            || cur_ring->pre_erased_num >= FLASH_LOG_PRE_ERASE_SEC_NUM) {
+        return result;
+    }
+    /* the sector after the pre-erased sectors */
+    sec_addr = cur_ring->area_start_addr + (cur_ring->end_addr - cur_ring->area_start_addr)
+            / flash_erase_min_size * flash_erase_min_size;
+    for (i = 0; i <= cur_ring->pre_erased_num; i++) {
+        sec_addr = get_next_flash_sec_addr(sec_addr);
+    }
+    for (i = 0; i < flash_erase_min_size && blank; i += sizeof(block)) {
+        flash_read(sec_addr + i, block, sizeof(block));
+        for (j = 0; j < sizeof(block) / 4; j++) {
+            if (block[j] != 0xFFFFFFFF) {
+                blank = false;
+                break;
+            }
+        }
+    }
+    if (!blank) {
+        /* the oldest sector will be dropped */
+        if (cur_ring->start_addr == sec_addr) {
+            cur_ring->start_addr = get_next_flash_sec_addr(cur_ring->start_addr);
+        }
+        result = erase_log_sector(sec_addr);
+        *erased = true;
+    }
+    if (result == FLASH_NO_ERR) {
+        cur_ring->pre_erased_num++;
+    }
+
+    return result;
+}
+#endif /* FLASH_LOG_USING_PRE_ERASE */
+
+#ifdef FLASH_LOG_USING_RECORD
+/**
+ * Get the remaining writable size of using sector. The record will be written to next sector
+ * when it's 0.
+ *
+ * @return remaining writable size
+ */
+static size_t get_cur_sec_remain_size(void) {
+    size_t remain_size = flash_erase_min_size
+            - ((cur_ring->end_addr + 4 - cur_ring->area_start_addr) % flash_erase_min_size);
+
+#ifdef FLASH_LOG_USING_SECTOR_HEAD
+    /* the log is empty */
+    if (cur_ring->start_addr == cur_ring->end_addr) {
+        return 0;
+    }
+#endif
+    return remain_size == flash_erase_min_size ? 0 : remain_size;
+}
+
+/**
+ * Convert the log index to flash address.
+ *
+ * @param index log index
+ *
+ * @return flash address
+ */
+static uint32_t log_index_to_addr(size_t index) {
+    size_t sec_data_size = flash_erase_min_size - LOG_SECTOR_HEAD_BYTE_SIZE;
+    uint32_t addr = cur_ring->start_addr + index / sec_data_size * flash_erase_min_size;
+
+    if (addr >= cur_ring->area_start_addr + cur_ring->area_size) {
+        addr -= cur_ring->area_size;
+    }
+
+    return addr + LOG_SECTOR_HEAD_BYTE_SIZE + index % sec_data_size;
+}
+
+/**
+ * Calculate the record CRC32 code by head and data.
+ *
+ * @param head record head
+ * @param data record data
+ * @param len record data length
+ *
+ * @return CRC32 code
+ */
+static uint32_t calc_record_crc(const uint32_t *head, const void *data, size_t len) {
+    uint32_t block[LOG_RECORD_BLOCK_SIZE / 4], crc;
+    size_t i, calc_size, pad_len = (len + 3) / 4 * 4;
+
+    crc = calc_crc32(0, head, LOG_RECORD_HEAD_INDEX_CRC * 4);
+    for (i = 0; i < pad_len; i += calc_size) {
+        calc_size = pad_len - i < LOG_RECORD_BLOCK_SIZE ? pad_len - i : LOG_RECORD_BLOCK_SIZE;
+        /* the word alignment part is 0 */
+        block[calc_size / 4 - 1] = 0;
+        memcpy(block, (const uint8_t *) data + i, len - i < calc_size ? len - i : calc_size);
+        crc = calc_crc32(crc, block, calc_size);
+    }
+
+    return crc;
+}
+
+/**
+ * Append a log record to flash. The record will be written to next sector when the current
+ * sector can't contain it.
+ *
+ * @param data record data
+ * @param len record data length, the record storage size can't be more than erase minimum size
+ *
+ * @return result
+ */
+static FlashErrCode append_record(const void *data, size_t len) {
+    FlashErrCode result = FLASH_NO_ERR;
+    uint32_t head[LOG_RECORD_HEAD_WORD_SIZE], block[LOG_RECORD_BLOCK_SIZE / 4], commit;
+    size_t remain_size, write_size, i;
+#ifdef FLASH_LOG_USING_ITERATOR
+    bool first_in_sec;
+#endif
+#ifdef FLASH_LOG_USING_TIME_INDEX
+    /* the timestamp never goes back, so the sector timestamps are ascending */
+    uint32_t time = flash_log_port_get_time();
+
+    time = time < cur_ring->record_time ? cur_ring->record_time : time;
+#endif
+
+    FLASH_ASSERT(len <= 0xFFFF);
+    FLASH_ASSERT(LOG_RECORD_SIZE(len) <= flash_erase_min_size - LOG_SECTOR_HEAD_BYTE_SIZE);
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    /* fill the remaining part of current sector by 0 */
+    remain_size = get_cur_sec_remain_size();
+#ifdef FLASH_LOG_USING_ITERATOR
+    /* the record is the first record of its sector */
+    first_in_sec = cur_ring->start_addr == cur_ring->end_addr || remain_size < LOG_RECORD_SIZE(len)
+            || remain_size == flash_erase_min_size - LOG_SECTOR_HEAD_BYTE_SIZE;
+#endif
+    if (remain_size && remain_size < LOG_RECORD_SIZE(len)) {
+        memset(block, 0, sizeof(block));
+        for (; remain_size && result == FLASH_NO_ERR; remain_size -= write_size) {
+            write_size = remain_size < sizeof(block) ? remain_size : sizeof(block);
+            result = write_log(block, write_size);
+        }
+        if (result != FLASH_NO_ERR) {
+            return result;
+        }
+    }
+
+    head[LOG_RECORD_HEAD_INDEX_INFO] = LOG_RECORD_INFO(len);
+    head[LOG_RECORD_HEAD_INDEX_SEQ] = cur_ring->record_seq + 1;
+#ifdef FLASH_LOG_USING_TIME_INDEX
+    head[LOG_RECORD_HEAD_INDEX_TIME] = time;
+#endif
+    head[LOG_RECORD_HEAD_INDEX_CRC] = calc_record_crc(head, data, len);
+    result = write_log(head, LOG_RECORD_HEAD_BYTE_SIZE);
+#ifdef FLASH_LOG_USING_ITERATOR
+    if (result == FLASH_NO_ERR && first_in_sec) {
+        update_record_index(cur_ring->end_addr + 4 - LOG_RECORD_HEAD_BYTE_SIZE, cur_ring->record_seq + 1);
+    }
+#endif
+#ifdef FLASH_LOG_USING_TIME_INDEX
+    if (result == FLASH_NO_ERR) {
+        result = write_sec_min_time(cur_ring->area_start_addr + (cur_ring->end_addr
+                - cur_ring->area_start_addr) / flash_erase_min_size * flash_erase_min_size, time);
+    }
+#endif
+    /* the data is copied to word aligned block */
+    for (i = 0; i < len && result == FLASH_NO_ERR; i += write_size) {
+        write_size = len - i < sizeof(block) ? len - i : sizeof(block);
+        block[(write_size + 3) / 4 - 1] = 0;
+        memcpy(block, (const uint8_t *) data + i, write_size);
+        result = write_log(block, (write_size + 3) / 4 * 4);
+    }
+    /* the commit word is written last */
+    if (result == FLASH_NO_ERR) {
+        commit = LOG_RECORD_COMMIT(len);
+        result = write_log(&commit, 4);
+    }
+    cur_ring->record_seq++;
+#ifdef FLASH_LOG_USING_TIME_INDEX
+    cur_ring->record_time = time;
+#endif
+
+    return result;
+}
+
+/**
+ * Append a log record to the selected log ring.
+ * @see append_record
+ *
+ * @param data record data
+ * @param len record data length
+ *
+ * @return result
+ */
+FlashErrCode flash_log_append_record(const void *data, size_t len) {
+    FlashErrCode result;
+
+    log_lock();
+    result = append_record(data, len);
+    log_unlock();
+
+    return result;
+}
+
+/**
+ * Read and verify the record at the log index.
+ *
+ * @param index the record log index
+ * @param head the record head
+ * @param buf the buffer to store record data, it can be NULL
+ * @param size buffer size, the data which is more than it will be dropped
+ *
+ * @return true: it's a committed record and its CRC32 code is OK
+ */
+static bool check_record(size_t index, uint32_t *head, void *buf, size_t size) {
+    uint32_t block[LOG_RECORD_BLOCK_SIZE / 4], commit, crc;
+    size_t data_len, pad_len, i, read_size;
+
+    read_log(index, head, LOG_RECORD_HEAD_BYTE_SIZE);
+    data_len = LOG_RECORD_LEN_OF(head[LOG_RECORD_HEAD_INDEX_INFO]);
+    pad_len = (data_len + 3) / 4 * 4;
+    read_log(index + LOG_RECORD_HEAD_BYTE_SIZE + pad_len, &commit, 4);
+    if (head[LOG_RECORD_HEAD_INDEX_INFO] != LOG_RECORD_INFO(data_len) || commit != LOG_RECORD_COMMIT(data_len)) {
+        return false;
+    }
+    /* verify the record by block and copy data to buffer */
+    crc = calc_crc32(0, head, LOG_RECORD_HEAD_INDEX_CRC * 4);
+    for (i = 0; i < pad_len; i += read_size) {
+        read_size = pad_len - i < sizeof(block) ? pad_len - i : sizeof(block);
+        read_log(index + LOG_RECORD_HEAD_BYTE_SIZE + i, block, read_size);
+        crc = calc_crc32(crc, block, read_size);
+        if (buf && i < size) {
+            memcpy((uint8_t *) buf + i, block, size - i < read_size ? size - i : read_size);
+        }
+    }
+
+    return crc == head[LOG_RECORD_HEAD_INDEX_CRC];
+}
+
+/**
+ * Find the first committed record from the log index. The filled words, broken and uncommitted
+ * records will be skipped.
+ *
+ * @param index the log index to start, it will be the found record log index
+ * @param end_index the found record must be before it
+ * @param head the found record head
+ * @param buf the buffer to store record data, it can be NULL
+ * @param size buffer size, the data which is more than it will be dropped
+ *
+ * @return true: found
+ */
+static bool find_next_record(size_t *index, size_t end_index, uint32_t *head, void *buf, size_t size) {
+    size_t record_size;
+
+    while (*index + 4 <= end_index) {
+        read_log(*index, head, 4);
+        /* the blank or filled word is between records */
+        if (head[LOG_RECORD_HEAD_INDEX_INFO] == 0xFFFFFFFF || head[LOG_RECORD_HEAD_INDEX_INFO] == 0) {
+            *index += 4;
+            continue;
+        }
+        record_size = LOG_RECORD_SIZE(LOG_RECORD_LEN_OF(head[LOG_RECORD_HEAD_INDEX_INFO]));
+        if (LOG_RECORD_MAGIC_OF(head[LOG_RECORD_HEAD_INDEX_INFO]) != LOG_RECORD_MAGIC
+                || *index + record_size > end_index) {
+            /* the record never crosses the sector, so the next sector starts with a record */
+            *index += flash_erase_min_size - (log_index_to_addr(*index) - cur_ring->area_start_addr)
+                    % flash_erase_min_size;
+            continue;
+        }
+        if (check_record(*index, head, buf, size)) {
+            return true;
+        }
+        *index += record_size;
+    }
+
+    return false;
+}
+
+/**
+ * Read a committed log record. The broken and uncommitted records will be skipped.
+ *
+ * @param index the record index for saved log, 0 is the oldest. It will be the next record index.
+ * @param buf the buffer to store record data
+ * @param size buffer size, the data which is more than it will be dropped
+ * @param len the record data length
+ *
+ * @return result, FLASH_LOG_NO_RECORD when there is no more record
+ */
+static FlashErrCode read_next_record(size_t *index, void *buf, size_t size, size_t *len) {
+    uint32_t head[LOG_RECORD_HEAD_WORD_SIZE];
+
+    FLASH_ASSERT(index);
+    FLASH_ASSERT(len);
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    if (!find_next_record(index, get_used_size(), head, buf, size)) {
+        return FLASH_LOG_NO_RECORD;
+    }
+    *len = LOG_RECORD_LEN_OF(head[LOG_RECORD_HEAD_INDEX_INFO]);
+    *index += LOG_RECORD_SIZE(*len);
+
+    return FLASH_NO_ERR;
+}
+
+/**
+ * Read a committed log record of the selected log ring.
+ * @see read_next_record
+ *
+ * @param index the record index for saved log, it will be the next record index
+ * @param buf the buffer to store record data
+ * @param size buffer size
+ * @param len the record data length
+ *
+ * @return result, FLASH_LOG_NO_RECORD when there is no more record
+ */
+FlashErrCode flash_log_read_record(size_t *index, void *buf, size_t size, size_t *len) {
+    FlashErrCode result;
+
+    log_lock();
+    result = read_next_record(index, buf, size, len);
+    log_unlock();
+
+    return result;
+}
+
+/**
+ * Fill the blank words by 0, the written words will not be changed.
+ *
+ * @param addr start address
+ * @param end_addr end address
+ *
+ * @return true: some blank words have been filled
+ */
+static bool fill_blank_words(uint32_t addr, uint32_t end_addr) {
+    uint32_t word, zero = 0;
+    bool filled = false;
+
+    for (; addr < end_addr; addr += 4) {
+        flash_read(addr, &word, 4);
+        if (word == 0xFFFFFFFF) {
+            flash_write(addr, &zero, 4);
+            filled = true;
+        }
+    }
+
+    return filled;
+}
+
+/**
+ * Seal the torn record at the end of log by 0, so the next record can be appended after it.
+ * It also finds the last committed record sequence number. Only the current sector and its
+ * previous sector will be read.
+ */
+static void seal_torn_record(void) {
+    uint32_t sec_addr, addr, used_end_addr, end_addr, head[LOG_RECORD_HEAD_WORD_SIZE], commit;
+    size_t i, record_size;
+
+    cur_ring->record_seq = 0;
+#ifdef FLASH_LOG_USING_TIME_INDEX
+    cur_ring->record_time = 0;
+#endif
+    if (cur_ring->start_addr == cur_ring->end_addr) {
+        return;
+    }
+#ifdef FLASH_LOG_USING_SECTOR_HEAD
+    /* the log end address is the last written word or the last sector head word when initialize */
+    used_end_addr = cur_ring->end_addr + 4;
+#else
+    /* the log end address is the first blank address or the last word of full sector when initialize */
+    used_end_addr = (cur_ring->end_addr + 3) / 4 * 4;
+    flash_read(used_end_addr, &commit, 4);
+    if (commit != 0xFFFFFFFF) {
+        used_end_addr += 4;
+    }
+#endif
+    end_addr = used_end_addr;
+    sec_addr = cur_ring->area_start_addr + (cur_ring->end_addr - cur_ring->area_start_addr)
+            / flash_erase_min_size * flash_erase_min_size;
+    for (i = 0; i < 2; i++) {
+        for (addr = sec_addr + LOG_SECTOR_HEAD_BYTE_SIZE; addr < sec_addr + flash_erase_min_size;
+                addr += record_size) {
+            flash_read(addr, head, 4);
+            /* the blank or filled word is between records */
+            if (head[LOG_RECORD_HEAD_INDEX_INFO] == 0xFFFFFFFF || head[LOG_RECORD_HEAD_INDEX_INFO] == 0) {
+                record_size = 4;
+                continue;
+            }
+            record_size = LOG_RECORD_SIZE(LOG_RECORD_LEN_OF(head[LOG_RECORD_HEAD_INDEX_INFO]));
+            if (LOG_RECORD_MAGIC_OF(head[LOG_RECORD_HEAD_INDEX_INFO]) != LOG_RECORD_MAGIC
+                    || addr + record_size > sec_addr + flash_erase_min_size) {
+                /* the torn head can't be walked, so the current sector will be closed */
+                if (i == 0 && fill_blank_words(addr, sec_addr + flash_erase_min_size)) {
+                    end_addr = sec_addr + flash_erase_min_size;
+                    FLASH_INFO("Warning: The torn log record has been sealed.\n");
+                }
+                break;
+            }
+            flash_read(addr, head, LOG_RECORD_HEAD_BYTE_SIZE);
+            flash_read(addr + record_size - 4, &commit, 4);
+            if (commit == LOG_RECORD_COMMIT(LOG_RECORD_LEN_OF(head[LOG_RECORD_HEAD_INDEX_INFO]))) {
+                cur_ring->record_seq = head[LOG_RECORD_HEAD_INDEX_SEQ];
+#ifdef FLASH_LOG_USING_TIME_INDEX
+                cur_ring->record_time = head[LOG_RECORD_HEAD_INDEX_TIME];
+#endif
+            }
+            /* the torn record is only at the end of current sector */
+            if (i == 0 && addr + record_size > used_end_addr) {
+                if (fill_blank_words(addr, addr + record_size)) {
+                    FLASH_INFO("Warning: The torn log record has been sealed.\n");
+                }
+                end_addr = addr + record_size;
+            }
+        }
+        /* there is no committed record in current sector, then find it in previous sector */
+        if (i == 0 && cur_ring->record_seq == 0 && sec_addr != cur_ring->start_addr) {
+            if (sec_addr == cur_ring->area_start_addr) {
+                sec_addr += cur_ring->area_size;
+            }
+            sec_addr -= flash_erase_min_size;
+        } else {
+            break;
+        }
+    }
+    /* the next record is appended after the last record */
+    cur_ring->end_addr = end_addr - 4;
+}
+#endif /* FLASH_LOG_USING_RECORD */
+
+#ifdef FLASH_LOG_USING_ITERATOR
+/**
+ * Build the sparse record index by reading the first record head of every indexed sector.
+ */
+static void build_record_index(void) {
+    size_t sec_num = cur_ring->area_size / flash_erase_min_size, sec_data_size = flash_erase_min_size
+            - LOG_SECTOR_HEAD_BYTE_SIZE, used_size = get_used_size(), index, i;
+    uint32_t head[LOG_RECORD_HEAD_WORD_SIZE], sec;
+
+    cur_ring->index_stride = (sec_num + FLASH_LOG_ITER_INDEX_SIZE - 1) / FLASH_LOG_ITER_INDEX_SIZE;
+    memset(cur_ring->sec_first_seq, 0, sizeof(cur_ring->sec_first_seq));
+    for (index = 0; index < used_size; index = (index / sec_data_size + 1) * sec_data_size) {
+        sec = (log_index_to_addr(index) - cur_ring->area_start_addr) / flash_erase_min_size;
+        if (sec % cur_ring->index_stride) {
+            continue;
+        }
+        /* the leading blank or filled words are skipped */
+        for (i = index; i + LOG_RECORD_HEAD_BYTE_SIZE <= used_size && i < index + sec_data_size; i += 4) {
+            read_log(i, head, 4);
+            if (head[LOG_RECORD_HEAD_INDEX_INFO] != 0xFFFFFFFF && head[LOG_RECORD_HEAD_INDEX_INFO] != 0) {
+                if (LOG_RECORD_MAGIC_OF(head[LOG_RECORD_HEAD_INDEX_INFO]) == LOG_RECORD_MAGIC) {
+                    read_log(i, head, LOG_RECORD_HEAD_BYTE_SIZE);
+                    cur_ring->sec_first_seq[sec / cur_ring->index_stride] = head[LOG_RECORD_HEAD_INDEX_SEQ];
+                }
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Update the sparse record index when the first record of sector has been written.
+ *
+ * @param head_addr the record head address
+ * @param seq the record sequence number
+ */
+static void update_record_index(uint32_t head_addr, uint32_t seq) {
+    size_t sec = (head_addr - cur_ring->area_start_addr) / flash_erase_min_size;
+
+    if (sec % cur_ring->index_stride == 0) {
+        cur_ring->sec_first_seq[sec / cur_ring->index_stride] = seq;
+    }
+}
+
+/**
+ * Convert the flash address to log index.
+ *
+ * @param addr flash address
+ *
+ * @return log index, it's more than log used size when the address isn't in saved log sectors
+ */
+static size_t log_addr_to_index(uint32_t addr) {
+    size_t sec_num = cur_ring->area_size / flash_erase_min_size;
+    size_t start_sec = (cur_ring->start_addr - cur_ring->area_start_addr) / flash_erase_min_size;
+    size_t sec = (addr - cur_ring->area_start_addr) / flash_erase_min_size;
+
+    return (sec + sec_num - start_sec) % sec_num * (flash_erase_min_size - LOG_SECTOR_HEAD_BYTE_SIZE)
+            + (addr - cur_ring->area_start_addr) % flash_erase_min_size - LOG_SECTOR_HEAD_BYTE_SIZE;
+}
+
+/**
+ * Find the last committed record before the log index. The commit word before the index is used
+ * to find the record head. The sector will be walked from its start when the record before the
+ * index is broken.
+ *
+ * @param index the found record must end before it, it will be the found record log index
+ * @param head the found record head
+ *
+ * @return true: found
+ */
+static bool find_prev_record(size_t *index, uint32_t *head) {
+    size_t sec_data_size = flash_erase_min_size - LOG_SECTOR_HEAD_BYTE_SIZE, end_index = *index, sec_index,
+            pos, record_size, found_index = 0, i;
+    uint32_t commit = 0;
+    bool found;
+
+    while (end_index) {
+        sec_index = (end_index - 1) / sec_data_size * sec_data_size;
+        /* the blank or filled words before the record end are skipped */
+        for (pos = end_index; pos > sec_index; pos -= 4) {
+            read_log(pos - 4, &commit, 4);
+            if (commit != 0xFFFFFFFF && commit != 0) {
+                break;
+            }
+        }
+        if (pos > sec_index) {
+            record_size = LOG_RECORD_SIZE(LOG_RECORD_LEN_OF(commit));
+            if (LOG_RECORD_MAGIC_OF(commit) == LOG_RECORD_COMMIT_MAGIC && pos - sec_index >= record_size
+                    && check_record(pos - record_size, head, NULL, 0)) {
+                *index = pos - record_size;
+                return true;
+            }
+            /* the record before the end is broken, walk this sector from its start */
+            for (i = sec_index, found = false; find_next_record(&i, pos, head, NULL, 0);
+                    i += LOG_RECORD_SIZE(LOG_RECORD_LEN_OF(head[LOG_RECORD_HEAD_INDEX_INFO]))) {
+                found_index = i;
+                found = true;
+            }
+            if (found) {
+                *index = found_index;
+                read_log(found_index, head, LOG_RECORD_HEAD_BYTE_SIZE);
+                return true;
+            }
+        }
+        end_index = sec_index;
+    }
+
+    return false;
+}
+
+/**
+ * Find the log index of iterator current record.
+ *
+ * @param iter log iterator
+ * @param index the current record log index
+ *
+ * @return false: the current record has been dropped or the iterator isn't set
+ */
+static bool locate_iter(const flash_log_iter *iter, size_t *index) {
+    uint32_t head[LOG_RECORD_HEAD_WORD_SIZE];
+
+    if (!iter->seq) {
+        return false;
+    }
+    *index = log_addr_to_index(iter->addr);
+    if (*index + LOG_RECORD_SIZE(iter->len) > get_used_size()) {
+        return false;
+    }
+    read_log(*index, head, LOG_RECORD_HEAD_BYTE_SIZE);
+
+    return head[LOG_RECORD_HEAD_INDEX_INFO] == LOG_RECORD_INFO(iter->len)
+            && head[LOG_RECORD_HEAD_INDEX_SEQ] == iter->seq;
+}
+
+/**
+ * Set the iterator current record.
+ *
+ * @param iter log iterator
+ * @param index the record log index
+ * @param head the record head
+ *
+ * @return result
+ */
+static FlashErrCode set_iter(flash_log_iter *iter, size_t index, const uint32_t *head) {
+    iter->addr = log_index_to_addr(index);
+    iter->seq = head[LOG_RECORD_HEAD_INDEX_SEQ];
+    iter->len = LOG_RECORD_LEN_OF(head[LOG_RECORD_HEAD_INDEX_INFO]);
+
+    return FLASH_NO_ERR;
+}
+
+/**
+ * Move the log iterator to the oldest record.
+ *
+ * @param iter log iterator
+ *
+ * @return result, FLASH_LOG_NO_RECORD when there is no record
+ */
+static FlashErrCode iter_to_first(flash_log_iter *iter) {
+    uint32_t head[LOG_RECORD_HEAD_WORD_SIZE];
+    size_t index = 0;
+
+    FLASH_ASSERT(iter);
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    if (!find_next_record(&index, get_used_size(), head, NULL, 0)) {
+        return FLASH_LOG_NO_RECORD;
+    }
+
+    return set_iter(iter, index, head);
+}
+
+/**
+ * Move the log iterator to the newest record.
+ *
+ * @param iter log iterator
+ *
+ * @return result, FLASH_LOG_NO_RECORD when there is no record
+ */
+static FlashErrCode iter_to_last(flash_log_iter *iter) {
+    uint32_t head[LOG_RECORD_HEAD_WORD_SIZE];
+    size_t index;
+
+    FLASH_ASSERT(iter);
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    index = get_used_size();
+    if (!find_prev_record(&index, head)) {
+        return FLASH_LOG_NO_RECORD;
+    }
+
+    return set_iter(iter, index, head);
+}
+
+/**
+ * Move the log iterator to the next (newer) record. The iterator will be moved to the oldest
+ * record which is newer than the current record when the current record has been dropped.
+ *
+ * @param iter log iterator
+ *
+ * @return result, FLASH_LOG_NO_RECORD when there is no newer record
+ */
+static FlashErrCode iter_to_next(flash_log_iter *iter) {
+    uint32_t head[LOG_RECORD_HEAD_WORD_SIZE];
+    size_t index;
+
+    FLASH_ASSERT(iter);
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    if (!locate_iter(iter, &index)) {
+        return seek_iter(iter, iter->seq + 1);
+    }
+    index += LOG_RECORD_SIZE(iter->len);
+    if (!find_next_record(&index, get_used_size(), head, NULL, 0)) {
+        return FLASH_LOG_NO_RECORD;
+    }
+
+    return set_iter(iter, index, head);
+}
+
+/**
+ * Move the log iterator to the previous (older) record.
+ *
+ * @param iter log iterator
+ *
+ * @return result, FLASH_LOG_NO_RECORD when there is no older record or the current record has
+ *         been dropped
+ */
+static FlashErrCode iter_to_prev(flash_log_iter *iter) {
+    uint32_t head[LOG_RECORD_HEAD_WORD_SIZE];
+    size_t index;
+
+    FLASH_ASSERT(iter);
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    if (!locate_iter(iter, &index) || !find_prev_record(&index, head)) {
+        return FLASH_LOG_NO_RECORD;
+    }
+
+    return set_iter(iter, index, head);
+}
+
+/**
+ * Move the log iterator to the oldest record whose sequence number isn't less than the given.
+ * The walk starts from the nearest indexed sector.
+ *
+ * @param iter log iterator
+ * @param seq record sequence number
+ *
+ * @return result, FLASH_LOG_NO_RECORD when there is no such record
+ */
+static FlashErrCode seek_iter(flash_log_iter *iter, uint32_t seq) {
+    uint32_t head[LOG_RECORD_HEAD_WORD_SIZE], first_seq;
+    size_t sec_data_size = flash_erase_min_size - LOG_SECTOR_HEAD_BYTE_SIZE, used_size, index = 0, i, sec;
+
+    FLASH_ASSERT(iter);
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    used_size = get_used_size();
+    /* find the newest indexed sector whose first record isn't newer than the given */
+    for (i = 0; i < used_size; i += sec_data_size) {
+        sec = (log_index_to_addr(i) - cur_ring->area_start_addr) / flash_erase_min_size;
+        first_seq = cur_ring->sec_first_seq[sec / cur_ring->index_stride];
+        if (sec % cur_ring->index_stride == 0 && first_seq && first_seq <= seq) {
+            index = i;
+        }
+    }
+    while (find_next_record(&index, used_size, head, NULL, 0)) {
+        if (head[LOG_RECORD_HEAD_INDEX_SEQ] >= seq) {
+            return set_iter(iter, index, head);
+        }
+        index += LOG_RECORD_SIZE(LOG_RECORD_LEN_OF(head[LOG_RECORD_HEAD_INDEX_INFO]));
+    }
+
+    return FLASH_LOG_NO_RECORD;
+}
+
+/**
+ * Read the log iterator current record data.
+ *
+ * @param iter log iterator
+ * @param buf the buffer to store record data
+ * @param size buffer size, the data which is more than it will be dropped
+ *
+ * @return result, FLASH_LOG_NO_RECORD when the current record has been dropped
+ */
+static FlashErrCode read_iter(const flash_log_iter *iter, void *buf, size_t size) {
+    uint32_t head[LOG_RECORD_HEAD_WORD_SIZE];
+    size_t index;
+
+    FLASH_ASSERT(iter);
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    if (!locate_iter(iter, &index) || !check_record(index, head, buf, size)) {
+        return FLASH_LOG_NO_RECORD;
+    }
+
+    return FLASH_NO_ERR;
+}
+
+/**
+ * Move the log iterator to the oldest record of the selected log ring.
+ * @see iter_to_first
+ *
+ * @param iter log iterator
+ *
+ * @return result, FLASH_LOG_NO_RECORD when there is no record
+ */
+FlashErrCode flash_log_iter_first(flash_log_iter *iter) {
+    FlashErrCode result;
+
+    log_lock();
+    result = iter_to_first(iter);
+    log_unlock();
+
+    return result;
+}
+
+/**
+ * Move the log iterator to the newest record of the selected log ring.
+ * @see iter_to_last
+ *
+ * @param iter log iterator
+ *
+ * @return result, FLASH_LOG_NO_RECORD when there is no record
+ */
+FlashErrCode flash_log_iter_last(flash_log_iter *iter) {
+    FlashErrCode result;
+
+    log_lock();
+    result = iter_to_last(iter);
+    log_unlock();
+
+    return result;
+}
+
+/**
+ * Move the log iterator to the next (newer) record of the selected log ring.
+ * @see iter_to_next
+ *
+ * @param iter log iterator
+ *
+ * @return result, FLASH_LOG_NO_RECORD when there is no newer record
+ */
+FlashErrCode flash_log_iter_next(flash_log_iter *iter) {
+    FlashErrCode result;
+
+    log_lock();
+    result = iter_to_next(iter);
+    log_unlock();
+
+    return result;
+}
+
+/**
+ * Move the log iterator to the previous (older) record of the selected log ring.
+ * @see iter_to_prev
+ *
+ * @param iter log iterator
+ *
+ * @return result, FLASH_LOG_NO_RECORD when there is no older record
+ */
+FlashErrCode flash_log_iter_prev(flash_log_iter *iter) {
+    FlashErrCode result;
+
+    log_lock();
+    result = iter_to_prev(iter);
+    log_unlock();
+
+    return result;
+}
+
+/**
+ * Move the log iterator to the oldest record whose sequence number isn't less than the given.
+ * @see seek_iter
+ *
+ * @param iter log iterator
+ * @param seq record sequence number
+ *
+ * @return result, FLASH_LOG_NO_RECORD when there is no such record
+ */
+FlashErrCode flash_log_iter_seek(flash_log_iter *iter, uint32_t seq) {
+    FlashErrCode result;
+
+    log_lock();
+    result = seek_iter(iter, seq);
+    log_unlock();
+
+    return result;
+}
+
+/**
+ * Read the log iterator current record data of the selected log ring.
+ * @see read_iter
+ *
+ * @param iter log iterator
+ * @param buf the buffer to store record data
+ * @param size buffer size
+ *
+ * @return result, FLASH_LOG_NO_RECORD when the current record has been dropped
+ */
+FlashErrCode flash_log_iter_read(const flash_log_iter *iter, void *buf, size_t size) {
+    FlashErrCode result;
+
+    log_lock();
+    result = read_iter(iter, buf, size);
+    log_unlock();
+
+    return result;
+}
+#endif /* FLASH_LOG_USING_ITERATOR */
+
+#ifdef FLASH_LOG_USING_TIME_INDEX
+/**
+ * Build the RAM time summary by reading the minimum timestamp in every summarized sector head.
+ */
+static void build_time_index(void) {
+    size_t sec_num = cur_ring->area_size / flash_erase_min_size, i;
+
+    cur_ring->time_stride = (sec_num + FLASH_LOG_TIME_INDEX_SIZE - 1) / FLASH_LOG_TIME_INDEX_SIZE;
+    memset(cur_ring->sec_min_time, 0xFF, sizeof(cur_ring->sec_min_time));
+    for (i = 0; i < sec_num; i += cur_ring->time_stride) {
+        flash_read(cur_ring->area_start_addr + i * flash_erase_min_size + LOG_SECTOR_HEAD_INDEX_MIN_TIME * 4,
+                &cur_ring->sec_min_time[i / cur_ring->time_stride], 4);
+    }
+}
+
+/**
+ * Set the sector minimum timestamp in RAM time summary when the sector is summarized.
+ *
+ * @param sec_addr sector address
+ * @param time the minimum timestamp, 0xFFFFFFFF is empty
+ */
+static void set_sec_min_time(uint32_t sec_addr, uint32_t time) {
+    size_t sec = (sec_addr - cur_ring->area_start_addr) / flash_erase_min_size;
+
+    if (sec % cur_ring->time_stride == 0) {
+        cur_ring->sec_min_time[sec / cur_ring->time_stride] = time;
+    }
+}
+
+/**
+ * Get the minimum timestamp of saved log sector. It's read from RAM time summary when the sector
+ * is summarized, otherwise it's read from sector head.
+ *
+ * @param sec_index the saved log sector index, 0 is the oldest sector
+ *
+ * @return the minimum timestamp, 0xFFFFFFFF is empty
+ */
+static uint32_t get_sec_min_time(size_t sec_index) {
+    uint32_t sec_addr = log_index_to_addr(sec_index * (flash_erase_min_size - LOG_SECTOR_HEAD_BYTE_SIZE))
+            - LOG_SECTOR_HEAD_BYTE_SIZE, time;
+    size_t sec = (sec_addr - cur_ring->area_start_addr) / flash_erase_min_size;
+
+    if (sec % cur_ring->time_stride == 0) {
+        return cur_ring->sec_min_time[sec / cur_ring->time_stride];
+    }
+    flash_read(sec_addr + LOG_SECTOR_HEAD_INDEX_MIN_TIME * 4, &time, 4);
+
+    return time;
+}
+
+/**
+ * Write the sector minimum timestamp when the first record is written to the sector.
+ *
+ * @param sec_addr sector address
+ * @param time record timestamp
+ *
+ * @return result
+ */
+static FlashErrCode write_sec_min_time(uint32_t sec_addr, uint32_t time) {
+    FlashErrCode result = FLASH_NO_ERR;
+    uint32_t min_time;
+
+    flash_read(sec_addr + LOG_SECTOR_HEAD_INDEX_MIN_TIME * 4, &min_time, 4);
+    if (min_time == 0xFFFFFFFF) {
+        result = flash_write(sec_addr + LOG_SECTOR_HEAD_INDEX_MIN_TIME * 4, &time, 4);
+        set_sec_min_time(sec_addr, time);
+    }
+
+    return result;
+}
+
+/**
+ * Write the sector maximum timestamp before the sector is set to full. The minimum timestamp is
+ * written too when the sector has no record, so the timestamps of all full sectors are ascending.
+ *
+ * @param sec_addr sector address
+ *
+ * @return result
+ */
+static FlashErrCode write_sec_max_time(uint32_t sec_addr) {
+    FlashErrCode result;
+
+    result = write_sec_min_time(sec_addr, cur_ring->record_time);
+    if (result == FLASH_NO_ERR) {
+        result = flash_write(sec_addr + LOG_SECTOR_HEAD_INDEX_MAX_TIME * 4, &cur_ring->record_time, 4);
+    }
+
+    return result;
+}
+
+/**
+ * Query the committed log records in the time range. The saved log sectors are found by binary
+ * search on the sector minimum timestamps, so only the sectors in time range will be read.
+ *
+ * @param start_time the start time of range, contain it
+ * @param end_time the end time of range, contain it
+ * @param buf the buffer to store record data
+ * @param size buffer size, the data which is more than it will be dropped
+ * @param cb the callback for every record in time range, the query stops when it returns false
+ * @param arg the callback argument
+ *
+ * @return result, FLASH_LOG_NO_RECORD when there is no record in time range
+ */
+static FlashErrCode query_time_range(uint32_t start_time, uint32_t end_time, void *buf, size_t size,
+        flash_log_query_cb cb, void *arg) {
+    uint32_t head[LOG_RECORD_HEAD_WORD_SIZE], max_time;
+    size_t sec_data_size = flash_erase_min_size - LOG_SECTOR_HEAD_BYTE_SIZE, used_size, sec_num, low, high,
+            mid, index, len;
+    bool found = false;
+
+    FLASH_ASSERT(buf);
+    FLASH_ASSERT(cb);
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    used_size = get_used_size();
+    sec_num = (used_size + sec_data_size - 1) / sec_data_size;
+    /* find the newest sector whose minimum timestamp is less than the start time, the records which
+     * have the same timestamp may be in the adjacent sectors */
+    for (low = 0, high = sec_num; low < high;) {
+        mid = (low + high) / 2;
+        if (get_sec_min_time(mid) < start_time) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    index = low ? (low - 1) * sec_data_size : 0;
+    /* all records in full sector are older than the start time, then start from the next sector */
+    if (low && low < sec_num) {
+        flash_read(log_index_to_addr(index) - LOG_SECTOR_HEAD_BYTE_SIZE + LOG_SECTOR_HEAD_INDEX_MAX_TIME * 4,
+                &max_time, 4);
+        if (max_time < start_time) {
+            index += sec_data_size;
+        }
+    }
+
+    while (find_next_record(&index, used_size, head, buf, size)) {
+        if (head[LOG_RECORD_HEAD_INDEX_TIME] > end_time) {
+            break;
+        }
+        len = LOG_RECORD_LEN_OF(head[LOG_RECORD_HEAD_INDEX_INFO]);
+        if (head[LOG_RECORD_HEAD_INDEX_TIME] >= start_time) {
+            found = true;
+            if (!cb(head[LOG_RECORD_HEAD_INDEX_TIME], buf, len, arg)) {
+                break;
+            }
+        }
+        index += LOG_RECORD_SIZE(len);
+    }
+
+    return found ? FLASH_NO_ERR : FLASH_LOG_NO_RECORD;
+}
+
+/**
+ * Query the records of the selected log ring in time range. The log rings are locked during the
+ * query, so the callback can't call the log functions.
+ * @see query_time_range
+ *
+ * @param start_time the start time
+ * @param end_time the end time
+ * @param buf the buffer to store record data
+ * @param size buffer size
+ * @param cb the callback for every record in time range
+ * @param arg the callback argument
+ *
+ * @return result, FLASH_LOG_NO_RECORD when there is no record in time range
+ */
+FlashErrCode flash_log_query_range(uint32_t start_time, uint32_t end_time, void *buf, size_t size,
+        flash_log_query_cb cb, void *arg) {
+    FlashErrCode result;
+
+    log_lock();
+    result = query_time_range(start_time, end_time, buf, size, cb, arg);
+    log_unlock();
+
+    return result;
+}
+#endif /* FLASH_LOG_USING_TIME_INDEX */
+
+#ifdef FLASH_LOG_USING_STAGING
+/**
+ * Append log to staging buffer, the log can be any length. The staged log will be saved when the
+ * staged size reaches FLASH_LOG_STAGING_THRESHOLD.
+ *
+ * @param log the log which will be appended
+ * @param size log bytes size
+ *
+ * @return result
+ */
+static FlashErrCode stage_log(const void *log, size_t size) {
+    FlashErrCode result = FLASH_NO_ERR;
+    size_t copy_size;
+
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    while (size) {
+        copy_size = FLASH_LOG_STAGING_SIZE - cur_ring->staged_size;
+        copy_size = size < copy_size ? size : copy_size;
+        memcpy((uint8_t *) cur_ring->staging_buf + cur_ring->staged_size, log, copy_size);
+        cur_ring->staged_size += copy_size;
+        log = (const uint8_t *) log + copy_size;
+        size -= copy_size;
+        if (cur_ring->staged_size >= FLASH_LOG_STAGING_THRESHOLD) {
+            result = save_staged_log(false);
+            if (result != FLASH_NO_ERR) {
+                break;
+            }
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Save all staged log to flash.
+ * The last not full word will be filled by '\0' when the log record isn't used.
+ *
+ * @return result
+ */
+static FlashErrCode flush_staged_log(void) {
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    if (!cur_ring->staged_size) {
+        return FLASH_NO_ERR;
+    }
+
+    return save_staged_log(true);
+}
+
+/**
+ * Save the staged log to flash. The staged log is saved as one log record when the log record is
+ * used, otherwise it's saved in full words and the remaining bytes are kept in staging buffer.
+ *
+ * @param all save all staged log, the last not full word will be filled by '\0'
+ *
+ * @return result
+ */
+static FlashErrCode save_staged_log(bool all) {
+    FlashErrCode result = FLASH_NO_ERR;
+#ifdef FLASH_LOG_USING_RECORD
+    /* the whole record is always saved */
+    (void) all;
+    result = append_record(cur_ring->staging_buf, cur_ring->staged_size);
+    if (result == FLASH_NO_ERR) {
+        cur_ring->staged_size = 0;
+    }
+#else
+    size_t save_size = cur_ring->staged_size / 4 * 4;
+
+    if (all && save_size < cur_ring->staged_size) {
+        memset((uint8_t *) cur_ring->staging_buf + cur_ring->staged_size, 0, 4 - cur_ring->staged_size % 4);
+        save_size += 4;
+    }
+    result = write_log(cur_ring->staging_buf, save_size);
+    if (result == FLASH_NO_ERR) {
+        if (save_size < cur_ring->staged_size) {
+            /* keep the remaining bytes at the start of staging buffer */
+            memmove(cur_ring->staging_buf, (uint8_t *) cur_ring->staging_buf + save_size,
+                    cur_ring->staged_size - save_size);
+            cur_ring->staged_size -= save_size;
+        } else {
+            cur_ring->staged_size = 0;
+        }
+    }
+#endif
+
+    return result;
+}
+
+/**
+ * Append log to the staging buffer of the selected log ring.
+ * @see stage_log
+ *
+ * @param log the log which will be appended
+ * @param size log bytes size
+ *
+ * @return result
+ */
+FlashErrCode flash_log_append(const void *log, size_t size) {
+    FlashErrCode result;
+
+    log_lock();
+    result = stage_log(log, size);
+    log_unlock();
+
+    return result;
+}
+
+/**
+ * Save all staged log of the selected log ring to flash.
+ * @see flush_staged_log
+ *
+ * @return result
+ */
+FlashErrCode flash_log_flush(void) {
+    FlashErrCode result;
+
+    log_lock();
+    result = flush_staged_log();
+    log_unlock();
+
+    return result;
+}
+#endif /* FLASH_LOG_USING_STAGING */
+
+#ifdef FLASH_LOG_USING_CHANNEL
+/**
+ * Find the log channel by name.
+ *
+ * @param name channel name
+ *
+ * @return channel index, it's the channel number when not found
+ */
+size_t flash_log_channel_find(const char *name) {
+    size_t i;
+
+    FLASH_ASSERT(name);
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    for (i = 0; i < log_channel_num; i++) {
+        if (log_rings[i].name && !strcmp(log_rings[i].name, name)) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/**
+ * Select the log channel, all other log functions will operate on it. The default is channel 0.
+ *
+ * @param channel channel index
+ */
+void flash_log_channel_select(size_t channel) {
+    FLASH_ASSERT(channel < log_channel_num);
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    log_lock();
+    cur_ring = &log_rings[channel];
+    log_unlock();
+}
+
+/**
+ * Set the log channel minimum level. The initial level is configured in port.
+ *
+ * @param channel channel index
+ * @param level minimum level
+ */
+void flash_log_channel_set_level(size_t channel, uint8_t level) {
+    FLASH_ASSERT(channel < log_channel_num);
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    log_rings[channel].level = level;
+}
+
+/**
+ * Check whether the log of this level will be saved to the channel. It can be called before
+ * formatting the log.
+ *
+ * @param channel channel index
+ * @param level log level
+ *
+ * @return true: the log will be saved
+ */
+bool flash_log_channel_enabled(size_t channel, uint8_t level) {
+    FLASH_ASSERT(channel < log_channel_num);
+
+    return level >= log_rings[channel].level;
+}
+
+/**
+ * Write log to the log channel. The log whose level is less than the channel minimum level will
+ * be dropped before any flash operation. It's saved as a log record when log record is used, and
+ * it's appended to the channel staging buffer when log staging buffer is used.
+ * The selected channel isn't changed.
+ *
+ * @param channel channel index
+ * @param level log level
+ * @param log the log which will be saved
+ * @param size log bytes size, it must be word alignment when the log staging buffer and log record
+ *        aren't used
+ *
+ * @return result
+ */
+FlashErrCode flash_log_channel_write(size_t channel, uint8_t level, const void *log, size_t size) {
+    FlashErrCode result;
+    log_ring_t selected_ring;
+
+    FLASH_ASSERT(channel < log_channel_num);
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    if (level < log_rings[channel].level) {
+        return FLASH_NO_ERR;
+    }
+
+    /* the selected log ring is swapped under lock, so the writers of other channels don't see it */
+    log_lock();
+    selected_ring = cur_ring;
+    cur_ring = &log_rings[channel];
+#if defined(FLASH_LOG_USING_STAGING)
+    result = stage_log(log, size);
+#elif defined(FLASH_LOG_USING_RECORD)
+    result = append_record(log, size);
+#else
+    result = write_log(log, size);
+#endif
+    cur_ring = selected_ring;
+    log_unlock();
 
     return result;
 }
+#endif /* FLASH_LOG_USING_CHANNEL */
 
 #endif
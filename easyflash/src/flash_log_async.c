@@ -0,0 +1,284 @@
+/*
+ * This file is part of the EasyFlash Library.
+ *
+ * Copyright (c) 2015, Armink, <armink.ztl@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * 'Software'), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED 'AS IS', WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Function: Save logs to flash asynchronously by a lock-free multi-producer RAM ring.
+ * Created on: 2026-10-19
+ */
+
+#include "flash.h"
+#include <string.h>
+
+#ifdef FLASH_USING_LOG
+
+#ifdef FLASH_LOG_USING_ASYNC
+
+/**
+ * The producers reserve the space of ring by CAS on the reserve position, so it's O(1) and can be
+ * called in ISR. Every entry in ring is head word (commit flag and log length) + log + word
+ * alignment part. The head word is published by CAS after the log has been copied. The drain
+ * worker saves the committed entries in order and stops at the first uncommitted entry. The
+ * drained space is cleared to 0 before the drain position moves, so an unpublished head is 0.
+ * The ring positions are increased freely, the ring index is the position modulo ring size.
+ */
+
+/* the entry head committed flag */
+#define LOG_ENTRY_COMMITTED            0x80000000
+/* get the log length from entry head */
+#define LOG_ENTRY_LEN_OF(head)         ((head) & 0xFFFF)
+/* the entry bytes size by log length, contain head word and word alignment part */
+#define LOG_ENTRY_SIZE(len)            (4 + ((len) + 3) / 4 * 4)
+
+/* the RAM ring */
+static uint32_t log_ring[FLASH_LOG_ASYNC_RING_SIZE / 4];
+/* the reserve position of producers and the drain position of worker */
+static volatile uint32_t ring_reserve_pos = 0, ring_drain_pos = 0;
+/* the drained logs which will be saved to flash */
+static uint32_t drain_buf[FLASH_LOG_ASYNC_BATCH_SIZE / 4];
+/* the asynchronous log statistics */
+static flash_log_async_stats log_stats;
+/* initialize OK flag */
+static bool init_ok = false;
+
+static void ring_copy(uint32_t pos, void *buf, size_t size, bool to_ring);
+static void atomic_add(volatile uint32_t *value, uint32_t inc);
+static void atomic_max(volatile uint32_t *value, uint32_t new_value);
+static void save_drained_log(size_t size);
+
+/**
+ * The log asynchronous save function initialize.
+ * The drain worker will be created by port.
+ *
+ * @return result
+ */
+FlashErrCode flash_log_async_init(void) {
+    FlashErrCode result = FLASH_NO_ERR;
+
+    FLASH_ASSERT(FLASH_LOG_ASYNC_BATCH_SIZE % 4 == 0);
+
+    memset(log_ring, 0, sizeof(log_ring));
+    ring_reserve_pos = ring_drain_pos = 0;
+    memset(&log_stats, 0, sizeof(log_stats));
+
+    result = flash_log_async_port_init();
+    if (result == FLASH_NO_ERR) {
+        init_ok = true;
+    }
+
+    return result;
+}
+
+/**
+ * Write log to RAM ring, it will be saved by the drain worker. This function will return
+ * immediately and it can be called by multiple producers (contain ISR) without lock.
+ *
+ * @param log the log which will be saved
+ * @param size log bytes size, it can't be more than FLASH_LOG_ASYNC_BATCH_SIZE. It must be word
+ *        alignment when the log staging buffer and log record aren't used.
+ *
+ * @return result, FLASH_LOG_RING_FULL when the log is dropped
+ */
+FlashErrCode flash_log_async_write(const void *log, size_t size) {
+    uint32_t pos, head;
+
+    FLASH_ASSERT(size && size <= FLASH_LOG_ASYNC_BATCH_SIZE);
+#if !defined(FLASH_LOG_USING_STAGING) && !defined(FLASH_LOG_USING_RECORD)
+    FLASH_ASSERT(size % 4 == 0);
+#endif
+    /* must be call this function after initialize OK */
+    FLASH_ASSERT(init_ok);
+
+    /* reserve the entry space */
+    do {
+        pos = ring_reserve_pos;
+        if (pos + LOG_ENTRY_SIZE(size) - ring_drain_pos > FLASH_LOG_ASYNC_RING_SIZE) {
+            atomic_add(&log_stats.drops, 1);
+            return FLASH_LOG_RING_FULL;
+        }
+    } while (!flash_log_async_port_cas(&ring_reserve_pos, pos, pos + LOG_ENTRY_SIZE(size)));
+    atomic_max(&log_stats.high_water, pos + LOG_ENTRY_SIZE(size) - ring_drain_pos);
+
+    ring_copy(pos + 4, (void *) log, size, true);
+    /* publish the entry */
+    head = LOG_ENTRY_COMMITTED | size;
+    flash_log_async_port_cas(&log_ring[pos % FLASH_LOG_ASYNC_RING_SIZE / 4], 0, head);
+
+    /* wake up the drain worker */
+    flash_log_async_port_notify();
+
+    return FLASH_NO_ERR;
+}
+
+/**
+ * The drain worker handler. It must be called by the port worker after it was notified.
+ * All committed logs are saved by batch, the flush latency is measured by port tick.
+ * @see flash_log_async_port_notify
+ */
+void flash_log_async_worker(void) {
+    uint32_t pos, head, start_tick, latency;
+    size_t len, drained_size = 0, entry_num = 0;
+
+    FLASH_ASSERT(init_ok);
+
+    start_tick = flash_log_async_port_get_tick();
+    while (true) {
+        pos = ring_drain_pos;
+        head = ((volatile uint32_t *) log_ring)[pos % FLASH_LOG_ASYNC_RING_SIZE / 4];
+        if (!(head & LOG_ENTRY_COMMITTED)) {
+            break;
+        }
+        len = LOG_ENTRY_LEN_OF(head);
+        if (drained_size + len > FLASH_LOG_ASYNC_BATCH_SIZE) {
+            save_drained_log(drained_size);
+            drained_size = 0;
+        }
+        ring_copy(pos + 4, (uint8_t *) drain_buf + drained_size, len, false);
+        drained_size += len;
+        /* clear the drained entry, then the space can be reserved again */
+        ring_copy(pos, NULL, LOG_ENTRY_SIZE(len), true);
+        flash_log_async_port_cas(&ring_drain_pos, pos, pos + LOG_ENTRY_SIZE(len));
+        entry_num++;
+#if defined(FLASH_LOG_USING_RECORD) && !defined(FLASH_LOG_USING_STAGING)
+        /* every log is a record */
+        save_drained_log(drained_size);
+        drained_size = 0;
+#endif
+    }
+    if (drained_size) {
+        save_drained_log(drained_size);
+    }
+
+    if (entry_num) {
+#ifdef FLASH_LOG_USING_STAGING
+        if (flash_log_flush() != FLASH_NO_ERR) {
+            log_stats.flush_errors++;
+        }
+#endif
+        latency = flash_log_async_port_get_tick() - start_tick;
+        log_stats.flush_count++;
+        log_stats.flush_latency_last = latency;
+        if (latency > log_stats.flush_latency_max) {
+            log_stats.flush_latency_max = latency;
+        }
+    }
+#ifdef FLASH_LOG_USING_PRE_ERASE
+    /* erase the next sector after flush, the next drained log needn't wait for the erasure */
+    if (flash_log_pre_erase() != FLASH_NO_ERR) {
+        log_stats.flush_errors++;
+    }
+#endif
+}
+
+/**
+ * Get the asynchronous log statistics.
+ *
+ * @param stats the statistics
+ */
+void flash_log_async_get_stats(flash_log_async_stats *stats) {
+    FLASH_ASSERT(stats);
+
+    *stats = log_stats;
+    stats->used_size = ring_reserve_pos - ring_drain_pos;
+}
+
+/**
+ * Copy data to or from RAM ring. The data will be cleared to 0 when copy to ring and buf is NULL.
+ *
+ * @param pos ring position
+ * @param buf data buffer
+ * @param size data bytes size
+ * @param to_ring copy to ring
+ */
+static void ring_copy(uint32_t pos, void *buf, size_t size, bool to_ring) {
+    size_t index = pos % FLASH_LOG_ASYNC_RING_SIZE, copy_size;
+
+    while (size) {
+        copy_size = FLASH_LOG_ASYNC_RING_SIZE - index;
+        copy_size = size < copy_size ? size : copy_size;
+        if (!to_ring) {
+            memcpy(buf, (uint8_t *) log_ring + index, copy_size);
+        } else if (buf) {
+            memcpy((uint8_t *) log_ring + index, buf, copy_size);
+        } else {
+            memset((uint8_t *) log_ring + index, 0, copy_size);
+        }
+        if (buf) {
+            buf = (uint8_t *) buf + copy_size;
+        }
+        size -= copy_size;
+        index = 0;
+    }
+}
+
+/**
+ * Add the value by CAS.
+ *
+ * @param value the value
+ * @param inc increment
+ */
+static void atomic_add(volatile uint32_t *value, uint32_t inc) {
+    uint32_t old_value;
+
+    do {
+        old_value = *value;
+    } while (!flash_log_async_port_cas(value, old_value, old_value + inc));
+}
+
+/**
+ * Update the value to the maximum value by CAS.
+ *
+ * @param value the value
+ * @param new_value new value
+ */
+static void atomic_max(volatile uint32_t *value, uint32_t new_value) {
+    uint32_t old_value;
+
+    do {
+        old_value = *value;
+    } while (new_value > old_value && !flash_log_async_port_cas(value, old_value, new_value));
+}
+
+/**
+ * Save the drained logs to flash. The failure is counted in statistics.
+ *
+ * @param size drained logs size
+ */
+static void save_drained_log(size_t size) {
+    FlashErrCode result;
+
+#if defined(FLASH_LOG_USING_STAGING)
+    result = flash_log_append(drain_buf, size);
+#elif defined(FLASH_LOG_USING_RECORD)
+    result = flash_log_append_record(drain_buf, size);
+#else
+    result = flash_log_write(drain_buf, size);
+#endif
+    if (result != FLASH_NO_ERR) {
+        log_stats.flush_errors++;
+        FLASH_INFO("Error: Save asynchronous log failed(%d).\n", result);
+    }
+}
+
+#endif /* FLASH_LOG_USING_ASYNC */
+
+#endif /* FLASH_USING_LOG */
@@ -0,0 +1,309 @@
+/*
+ * This file is part of the EasyFlash Library.
+ *
+ * Copyright (c) 2015, Armink, <armink.ztl@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * 'Software'), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED 'AS IS', WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Function: Save the crash dump to a pre-erased reserve area in fault handler.
+ * Created on: 2026-10-19
+ */
+
+#include "flash.h"
+#include <string.h>
+
+#if defined(FLASH_USING_LOG) && defined(FLASH_LOG_USING_CRASHDUMP)
+
+/**
+ * The crash dump area is kept erased, so the dump is only written without erase and lock. Every
+ * flash_log_crashdump_write appends a part, it's head(2 words) + data + word alignment part. The
+ * head contains information (magic code, part type and data length) and the CRC32 code of
+ * information, data and word alignment part. The information is written first and the CRC32 code
+ * is written last, so the torn part has a blank or broken CRC32 code and it's skipped by its data
+ * length. The parts are found when initialize, the area will be erased again by
+ * flash_log_crashdump_clean after the dump has been read.
+ */
+
+/* the crash dump part head index and size */
+enum {
+    /* the part information (magic code, type and data length) index in head */
+    CRASHDUMP_HEAD_INDEX_INFO = 0,
+    /* the part CRC32 code index in head */
+    CRASHDUMP_HEAD_INDEX_CRC,
+    /* the part head word size */
+    CRASHDUMP_HEAD_WORD_SIZE,
+    /* the part head byte size */
+    CRASHDUMP_HEAD_BYTE_SIZE = CRASHDUMP_HEAD_WORD_SIZE * 4,
+};
+/* the part information magic code(bit24-31) */
+#define CRASHDUMP_MAGIC                0xCD
+/* make the part information by type(bit16-23) and data length(bit0-15) */
+#define CRASHDUMP_INFO(type, len)      (((uint32_t) CRASHDUMP_MAGIC << 24) | ((uint32_t) (type) << 16) \
+                                        | (len))
+/* get the magic code, type and data length from part information */
+#define CRASHDUMP_MAGIC_OF(info)       ((info) >> 24)
+#define CRASHDUMP_TYPE_OF(info)        (((info) >> 16) & 0xFF)
+#define CRASHDUMP_LEN_OF(info)         ((info) & 0xFFFF)
+/* the part storage size by data length, contain head and word alignment part */
+#define CRASHDUMP_PART_SIZE(len)       (CRASHDUMP_HEAD_BYTE_SIZE + ((len) + 3) / 4 * 4)
+/* the maximum data length of one part, it's word alignment */
+#define CRASHDUMP_PART_LEN_MAX         0xFFFC
+/* the block bytes size when read or write part data, must be word alignment */
+#define CRASHDUMP_BLOCK_SIZE           32
+
+/* crash dump area start address and size in flash */
+static uint32_t crashdump_addr = 0;
+static size_t crashdump_size = 0;
+/* the next part address when write */
+static uint32_t crashdump_write_addr = 0;
+/* the found crash dump storage size when initialize */
+static size_t crashdump_found_size = 0;
+/* the crash dump area has been erased */
+static bool crashdump_ready = false;
+
+static bool read_part(uint32_t addr, uint32_t *info, bool *complete);
+static bool area_is_blank(void);
+
+/**
+ * Flash crash dump area initialize. The crash dump which was saved before reset will be found.
+ * The area is erased again when there is no crash dump, otherwise it's erased after the dump has
+ * been read. @see flash_log_crashdump_clean
+ *
+ * @param start_addr crash dump area start address in flash
+ * @param area_size crash dump area size
+ * @param erase_min_size the minimum size of flash erasure
+ *
+ * @return result
+ */
+FlashErrCode flash_log_crashdump_init(uint32_t start_addr, size_t area_size, size_t erase_min_size) {
+    FlashErrCode result = FLASH_NO_ERR;
+    uint32_t addr, info;
+    bool complete, found = false;
+
+    FLASH_ASSERT(start_addr);
+    FLASH_ASSERT(area_size);
+    FLASH_ASSERT(area_size % erase_min_size == 0);
+
+    crashdump_addr = start_addr;
+    crashdump_size = area_size;
+    crashdump_ready = false;
+
+    /* find all parts, the torn part is skipped by its data length */
+    for (addr = crashdump_addr; read_part(addr, &info, &complete); ) {
+        found = found || complete;
+        addr += CRASHDUMP_PART_SIZE(CRASHDUMP_LEN_OF(info));
+    }
+    crashdump_found_size = found ? addr - crashdump_addr : 0;
+
+    if (crashdump_found_size) {
+        FLASH_INFO("Found the crash dump (%ld bytes) which was saved before reset.\n", crashdump_found_size);
+    } else if (area_is_blank()) {
+        crashdump_write_addr = crashdump_addr;
+        crashdump_ready = true;
+    } else {
+        /* there are only torn parts */
+        result = flash_log_crashdump_clean();
+    }
+
+    return result;
+}
+
+/**
+ * Write a part of crash dump (registers, stack or the last logs in RAM) to the pre-erased area.
+ * It only writes flash without erase and lock, so it can be called in fault handler which
+ * interrupts are disabled. The runtime is bounded by the data size.
+ *
+ * @param type the part type which is defined by user
+ * @param data the part data
+ * @param size data bytes size, the data which is more than the remaining area will be dropped
+ *
+ * @return result, FLASH_WRITE_ERR when the area isn't erased or full
+ */
+FlashErrCode flash_log_crashdump_write(uint8_t type, const void *data, size_t size) {
+    FlashErrCode result = FLASH_NO_ERR;
+    uint32_t head[CRASHDUMP_HEAD_WORD_SIZE], block[CRASHDUMP_BLOCK_SIZE / 4], part_addr, crc;
+    size_t remain_size, write_size, i;
+
+    part_addr = crashdump_write_addr;
+    /* the RAM may be broken when crash, so the write address is checked again */
+    if (!crashdump_ready || part_addr < crashdump_addr || part_addr % 4
+            || part_addr + CRASHDUMP_HEAD_BYTE_SIZE >= crashdump_addr + crashdump_size) {
+        return FLASH_WRITE_ERR;
+    }
+    remain_size = crashdump_addr + crashdump_size - part_addr - CRASHDUMP_HEAD_BYTE_SIZE;
+    size = size < remain_size ? size : remain_size;
+    size = size < CRASHDUMP_PART_LEN_MAX ? size : CRASHDUMP_PART_LEN_MAX;
+    /* the next part is written after this part even if this part is torn */
+    crashdump_write_addr = part_addr + CRASHDUMP_PART_SIZE(size);
+
+    head[CRASHDUMP_HEAD_INDEX_INFO] = CRASHDUMP_INFO(type, size);
+    crc = calc_crc32(0, &head[CRASHDUMP_HEAD_INDEX_INFO], 4);
+    /* the information is written first, then the next part can be found even if this part is torn */
+    result = flash_write(part_addr, &head[CRASHDUMP_HEAD_INDEX_INFO], 4);
+    /* the data may be not word alignment, so it's copied to block */
+    for (i = 0; i < size && result == FLASH_NO_ERR; i += write_size) {
+        write_size = size - i < CRASHDUMP_BLOCK_SIZE ? (size - i + 3) / 4 * 4 : CRASHDUMP_BLOCK_SIZE;
+        block[write_size / 4 - 1] = 0;
+        memcpy(block, (const uint8_t *) data + i, size - i < write_size ? size - i : write_size);
+        crc = calc_crc32(crc, block, write_size);
+        result = flash_write(part_addr + CRASHDUMP_HEAD_BYTE_SIZE + i, block, write_size);
+    }
+    if (result == FLASH_NO_ERR) {
+        head[CRASHDUMP_HEAD_INDEX_CRC] = crc;
+        result = flash_write(part_addr + CRASHDUMP_HEAD_INDEX_CRC * 4, &head[CRASHDUMP_HEAD_INDEX_CRC], 4);
+    }
+
+    return result;
+}
+
+/**
+ * Get the crash dump storage size which was found when initialize.
+ *
+ * @return crash dump size, 0 is no crash dump
+ */
+size_t flash_log_crashdump_get_size(void) {
+    return crashdump_found_size;
+}
+
+/**
+ * Read a part of the crash dump which was found when initialize. The torn part is skipped.
+ *
+ * @param index the part storage index in crash dump, 0 is the first part. It will be the next
+ *        part index.
+ * @param type the part type
+ * @param buf the buffer to store part data
+ * @param size buffer size, the data which is more than it will be dropped
+ * @param len the part data length
+ *
+ * @return result, FLASH_LOG_NO_RECORD when there is no more part
+ */
+FlashErrCode flash_log_crashdump_read(size_t *index, uint8_t *type, void *buf, size_t size, size_t *len) {
+    uint32_t block[CRASHDUMP_BLOCK_SIZE / 4], info;
+    size_t read_size, data_len, i;
+    bool complete = false;
+
+    FLASH_ASSERT(index);
+    FLASH_ASSERT(crashdump_addr);
+
+    while (*index < crashdump_found_size && read_part(crashdump_addr + *index, &info, &complete)
+            && !complete) {
+        *index += CRASHDUMP_PART_SIZE(CRASHDUMP_LEN_OF(info));
+    }
+    if (*index >= crashdump_found_size || !complete) {
+        return FLASH_LOG_NO_RECORD;
+    }
+    data_len = CRASHDUMP_LEN_OF(info);
+    for (i = 0; i < data_len && i < size; i += read_size) {
+        read_size = data_len - i < CRASHDUMP_BLOCK_SIZE ? data_len - i : CRASHDUMP_BLOCK_SIZE;
+        read_size = size - i < read_size ? size - i : read_size;
+        flash_read(crashdump_addr + *index + CRASHDUMP_HEAD_BYTE_SIZE + i, block, (read_size + 3) / 4 * 4);
+        memcpy((uint8_t *) buf + i, block, read_size);
+    }
+    if (type) {
+        *type = CRASHDUMP_TYPE_OF(info);
+    }
+    if (len) {
+        *len = data_len;
+    }
+    *index += CRASHDUMP_PART_SIZE(data_len);
+
+    return FLASH_NO_ERR;
+}
+
+/**
+ * Erase the crash dump area, then the next crash dump can be written.
+ *
+ * @return result
+ */
+FlashErrCode flash_log_crashdump_clean(void) {
+    FlashErrCode result;
+
+    FLASH_ASSERT(crashdump_addr);
+
+    crashdump_ready = false;
+    result = flash_erase(crashdump_addr, crashdump_size);
+    if (result == FLASH_NO_ERR) {
+        crashdump_found_size = 0;
+        crashdump_write_addr = crashdump_addr;
+        crashdump_ready = true;
+    }
+
+    return result;
+}
+
+/**
+ * Read and check the part head and data.
+ *
+ * @param addr part address
+ * @param info the part information
+ * @param complete the part is written completely, otherwise it's torn
+ *
+ * @return true is a part, it's written completely or torn
+ */
+static bool read_part(uint32_t addr, uint32_t *info, bool *complete) {
+    uint32_t head[CRASHDUMP_HEAD_WORD_SIZE], block[CRASHDUMP_BLOCK_SIZE / 4], crc;
+    size_t data_size, read_size, i;
+
+    *complete = false;
+    if (addr + CRASHDUMP_HEAD_BYTE_SIZE > crashdump_addr + crashdump_size) {
+        return false;
+    }
+    flash_read(addr, head, CRASHDUMP_HEAD_BYTE_SIZE);
+    *info = head[CRASHDUMP_HEAD_INDEX_INFO];
+    /* the data size contains word alignment part */
+    data_size = CRASHDUMP_PART_SIZE(CRASHDUMP_LEN_OF(*info)) - CRASHDUMP_HEAD_BYTE_SIZE;
+    if (CRASHDUMP_MAGIC_OF(*info) != CRASHDUMP_MAGIC
+            || addr + CRASHDUMP_HEAD_BYTE_SIZE + data_size > crashdump_addr + crashdump_size) {
+        return false;
+    }
+    crc = calc_crc32(0, &head[CRASHDUMP_HEAD_INDEX_INFO], 4);
+    for (i = 0; i < data_size; i += read_size) {
+        read_size = data_size - i < CRASHDUMP_BLOCK_SIZE ? data_size - i : CRASHDUMP_BLOCK_SIZE;
+        flash_read(addr + CRASHDUMP_HEAD_BYTE_SIZE + i, block, read_size);
+        crc = calc_crc32(crc, block, read_size);
+    }
+    *complete = crc == head[CRASHDUMP_HEAD_INDEX_CRC];
+
+    return true;
+}
+
+/**
+ * Check the crash dump area is blank.
+ *
+ * @return true is blank
+ */
+static bool area_is_blank(void) {
+    uint32_t block[CRASHDUMP_BLOCK_SIZE / 4], read_addr;
+    size_t i;
+
+    for (read_addr = crashdump_addr; read_addr < crashdump_addr + crashdump_size;
+            read_addr += CRASHDUMP_BLOCK_SIZE) {
+        flash_read(read_addr, block, CRASHDUMP_BLOCK_SIZE);
+        for (i = 0; i < CRASHDUMP_BLOCK_SIZE / 4; i++) {
+            if (block[i] != 0xFFFFFFFF) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+#endif /* defined(FLASH_USING_LOG) && defined(FLASH_LOG_USING_CRASHDUMP) */
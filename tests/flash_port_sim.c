@@ -0,0 +1,200 @@
+/*
+ * This file is part of the EasyFlash Library.
+ *
+ * Copyright (c) 2015, Armink, <armink.ztl@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * 'Software'), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED 'AS IS', WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Function: Host test port. The flash is simulated by RAM with NOR flash write rule.
+ * Created on: 2026-10-19
+ */
+
+/**
+ * Build: gcc -no-pie -I../easyflash/inc [-DFLASH_xxx] ../easyflash/src/flash*.c flash_port_sim.c
+ *        test_xxx.c -o test_xxx
+ * Usage: test_xxx, it returns 0 when all checks passed.
+ *
+ * The needed optional functions are enabled by -D, see the Build line in every test file.
+ * The library saves RAM address in uint32_t, so -no-pie (or -m32) is needed on 64-bit host. The
+ * library reads the flash directly by address too, so the simulated flash is mapped to its
+ * address by mmap.
+ * A reboot is simulated by calling flash_init again, the power loss is simulated by
+ * sim_fail_write_after, the flash write will fail after the set number of words.
+ * The log lock is an error check mutex, so the nested lock is checked too. The flash write yields
+ * the CPU like a real flash programming, so the other log threads run during it. -pthread is
+ * needed when the log channel or the background pre-erase is used.
+ */
+
+#include "flash_port_sim.h"
+#include <string.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#if defined(FLASH_LOG_USING_CHANNEL) || defined(FLASH_LOG_USING_PRE_ERASE)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/* the simulated flash, it's mapped to SIM_FLASH_BASE */
+static uint8_t *sim_flash = NULL;
+
+static const flash_env default_env_set[] = {
+        {"boot_times", "0"},
+        {"device_id", "1"},
+};
+
+size_t sim_erase_count = 0;
+int sim_fail_write_after = -1;
+#if defined(FLASH_LOG_USING_CHANNEL) || defined(FLASH_LOG_USING_PRE_ERASE)
+/* the log lock */
+static pthread_mutex_t log_lock;
+#endif
+
+/**
+ * Erase all simulated flash.
+ */
+void sim_flash_reset(void) {
+#if defined(FLASH_LOG_USING_CHANNEL) || defined(FLASH_LOG_USING_PRE_ERASE)
+    pthread_mutexattr_t attr;
+#endif
+
+    if (!sim_flash) {
+        sim_flash = mmap((void *) SIM_FLASH_BASE, SIM_FLASH_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        SIM_CHECK(sim_flash == (uint8_t *) SIM_FLASH_BASE);
+#if defined(FLASH_LOG_USING_CHANNEL) || defined(FLASH_LOG_USING_PRE_ERASE)
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+        SIM_CHECK(pthread_mutex_init(&log_lock, &attr) == 0);
+        pthread_mutexattr_destroy(&attr);
+#endif
+    }
+    memset(sim_flash, 0xFF, SIM_FLASH_SIZE);
+    sim_erase_count = 0;
+    sim_fail_write_after = -1;
+}
+
+/**
+ * Get the simulated flash data pointer.
+ *
+ * @param addr flash address
+ *
+ * @return data pointer
+ */
+uint8_t *sim_flash_ptr(uint32_t addr) {
+    SIM_CHECK(addr >= SIM_FLASH_BASE && addr < SIM_FLASH_BASE + SIM_FLASH_SIZE);
+
+    return sim_flash + (addr - SIM_FLASH_BASE);
+}
+
+FlashErrCode flash_port_init(uint32_t *env_addr, size_t *env_total_size, size_t *erase_min_size,
+        flash_env const **default_env, size_t *default_env_size, size_t *log_size) {
+    *env_addr = SIM_FLASH_BASE;
+    *env_total_size = SIM_ENV_SIZE;
+    *erase_min_size = SIM_ERASE_MIN_SIZE;
+    *default_env = default_env_set;
+    *default_env_size = sizeof(default_env_set) / sizeof(default_env_set[0]);
+    *log_size = SIM_LOG_SIZE;
+
+    return FLASH_NO_ERR;
+}
+
+FlashErrCode flash_read(uint32_t addr, uint32_t *buf, size_t size) {
+    SIM_CHECK(size % 4 == 0 && addr % 4 == 0);
+    SIM_CHECK(addr >= SIM_FLASH_BASE && addr + size <= SIM_FLASH_BASE + SIM_FLASH_SIZE);
+
+    memcpy(buf, sim_flash_ptr(addr), size);
+
+    return FLASH_NO_ERR;
+}
+
+FlashErrCode flash_erase(uint32_t addr, size_t size) {
+    size = (size + SIM_ERASE_MIN_SIZE - 1) / SIM_ERASE_MIN_SIZE * SIM_ERASE_MIN_SIZE;
+    SIM_CHECK((addr - SIM_FLASH_BASE) % SIM_ERASE_MIN_SIZE == 0);
+    SIM_CHECK(addr >= SIM_FLASH_BASE && addr + size <= SIM_FLASH_BASE + SIM_FLASH_SIZE);
+
+    memset(sim_flash_ptr(addr), 0xFF, size);
+    sim_erase_count += size / SIM_ERASE_MIN_SIZE;
+
+    return FLASH_NO_ERR;
+}
+
+FlashErrCode flash_write(uint32_t addr, const uint32_t *buf, size_t size) {
+    uint32_t word;
+    size_t i;
+
+    SIM_CHECK(size % 4 == 0 && addr % 4 == 0);
+    SIM_CHECK(addr >= SIM_FLASH_BASE && addr + size <= SIM_FLASH_BASE + SIM_FLASH_SIZE);
+#if defined(FLASH_LOG_USING_CHANNEL) || defined(FLASH_LOG_USING_PRE_ERASE)
+    sched_yield();
+#endif
+
+    for (i = 0; i < size; i += 4) {
+        if (sim_fail_write_after == 0) {
+            return FLASH_WRITE_ERR;
+        } else if (sim_fail_write_after > 0) {
+            sim_fail_write_after--;
+        }
+        memcpy(&word, sim_flash_ptr(addr + i), 4);
+#ifdef SIM_WORD_WRITE_ONCE
+        SIM_CHECK(word == 0xFFFFFFFF);
+#endif
+        /* the NOR flash bit only can be written from 1 to 0 */
+        SIM_CHECK((word & buf[i / 4]) == buf[i / 4]);
+        word &= buf[i / 4];
+        memcpy(sim_flash_ptr(addr + i), &word, 4);
+    }
+
+    return FLASH_NO_ERR;
+}
+
+void flash_env_lock(void) {
+}
+
+void flash_env_unlock(void) {
+}
+
+#if defined(FLASH_LOG_USING_CHANNEL) || defined(FLASH_LOG_USING_PRE_ERASE)
+void flash_log_lock(void) {
+    /* the lock fails when it's taken again by the same thread */
+    SIM_CHECK(pthread_mutex_lock(&log_lock) == 0);
+}
+
+void flash_log_unlock(void) {
+    SIM_CHECK(pthread_mutex_unlock(&log_lock) == 0);
+}
+#endif
+
+void flash_log_debug(const char *file, const long line, const char *format, ...) {
+    (void) file;
+    (void) line;
+    (void) format;
+}
+
+void flash_log_info(const char *format, ...) {
+    (void) format;
+}
+
+void flash_print(const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
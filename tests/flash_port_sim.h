@@ -0,0 +1,77 @@
+/*
+ * This file is part of the EasyFlash Library.
+ *
+ * Copyright (c) 2015, Armink, <armink.ztl@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * 'Software'), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED 'AS IS', WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Function: Host test port. The flash is simulated by RAM with NOR flash write rule.
+ * Created on: 2026-10-19
+ */
+
+#ifndef FLASH_PORT_SIM_H_
+#define FLASH_PORT_SIM_H_
+
+#include "flash.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* the simulated flash start address and size */
+#define SIM_FLASH_BASE                 0x08000000
+#ifndef SIM_FLASH_SIZE
+#define SIM_FLASH_SIZE                 (256 * 1024)
+#endif
+/* the minimum size of flash erasure */
+#ifndef SIM_ERASE_MIN_SIZE
+#define SIM_ERASE_MIN_SIZE             (2 * 1024)
+#endif
+/* the ENV section size */
+#ifdef FLASH_ENV_USING_SLOTTED_MODE
+#define SIM_ENV_SIZE                   (2 * SIM_ERASE_MIN_SIZE)
+#elif defined(FLASH_ENV_USING_SHARDED_MODE)
+#define SIM_ENV_SIZE                   (FLASH_ENV_SHARD_NUM * SIM_ERASE_MIN_SIZE)
+#else
+#define SIM_ENV_SIZE                   FLASH_USER_SETTING_ENV_SIZE
+#endif
+/* the log area size */
+#ifndef SIM_LOG_SIZE
+#define SIM_LOG_SIZE                   (4 * SIM_ERASE_MIN_SIZE)
+#endif
+
+/* check the condition, exit with the failed line when it's false */
+#define SIM_CHECK(EXPR)                                                       \
+do {                                                                          \
+    if (!(EXPR)) {                                                            \
+        printf("%s:%d: check (%s) failed.\n", __FILE__, __LINE__, #EXPR);     \
+        exit(1);                                                              \
+    }                                                                         \
+} while (0)
+
+/* SIM_WORD_WRITE_ONCE: every word only can be written once after erased, such as ECC flash */
+
+/* the erased sectors number */
+extern size_t sim_erase_count;
+/* the flash write will fail after this words number, -1 is never fail */
+extern int sim_fail_write_after;
+
+void sim_flash_reset(void);
+uint8_t *sim_flash_ptr(uint32_t addr);
+
+#endif /* FLASH_PORT_SIM_H_ */
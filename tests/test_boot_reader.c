@@ -0,0 +1,68 @@
+/*
+ * This file is part of the EasyFlash Library.
+ *
+ * Copyright (c) 2015, Armink, <armink.ztl@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * 'Software'), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED 'AS IS', WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Function: Host test. Read the ENV by bootloader reader without flash_init.
+ * Created on: 2026-10-19
+ */
+
+/**
+ * Build: gcc -no-pie -I../easyflash/inc -DFLASH_ENV_USING_BOOT_READER [-DFLASH_ENV_USING_SLOTTED_MODE]
+ *        ../easyflash/src/flash*.c flash_port_sim.c test_boot_reader.c -o test_boot_reader
+ */
+
+#include "flash_port_sim.h"
+#include <string.h>
+
+int main(void) {
+    char value[16];
+    size_t i;
+
+    /* the default value is got when the ENV isn't saved */
+    sim_flash_reset();
+    SIM_CHECK(flash_env_boot_get("device_id", value, sizeof(value), true) == FLASH_NO_ERR);
+    SIM_CHECK(!strcmp(value, "1"));
+    SIM_CHECK(flash_env_boot_get("not_exist", value, sizeof(value), true) == FLASH_ENV_NAME_ERR);
+
+    /* the reader doesn't change the ENV area of the application, it's read between the saves */
+    SIM_CHECK(flash_init() == FLASH_NO_ERR);
+    for (i = 0; i < 20; i++) {
+        sprintf(value, "%ld", (long) i);
+        SIM_CHECK(flash_set_env("boot_times", value) == FLASH_NO_ERR);
+        SIM_CHECK(flash_save_env() == FLASH_NO_ERR);
+        SIM_CHECK(flash_env_boot_get("boot_times", value, sizeof(value), true) == FLASH_NO_ERR);
+        SIM_CHECK(atoi(value) == (int) i);
+    }
+    SIM_CHECK(flash_env_boot_get("boot_times", value, 2, true) == FLASH_ENV_FULL);
+
+    /* the broken ENV isn't read as default value */
+    for (i = 0; i < SIM_ENV_SIZE; i += 4) {
+        memset(sim_flash_ptr(SIM_FLASH_BASE + i), 0x00, 4);
+    }
+    SIM_CHECK(flash_env_boot_get("device_id", value, sizeof(value), true) == FLASH_ENV_BROKEN);
+    SIM_CHECK(flash_env_boot_get("device_id", value, sizeof(value), false) == FLASH_ENV_BROKEN);
+
+    printf("Boot reader test passed.\n");
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * This file is part of the EasyFlash Library.
+ *
+ * Copyright (c) 2015, Armink, <armink.ztl@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * 'Software'), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED 'AS IS', WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Function: Host test. The counter rollover, reboot and power loss.
+ * Created on: 2026-10-19
+ */
+
+/**
+ * Build: gcc -no-pie -I../easyflash/inc -DFLASH_USING_COUNTER [-DFLASH_COUNTER_USING_BIT_CLEAR]
+ *        [-DSIM_WORD_WRITE_ONCE, only without FLASH_COUNTER_USING_BIT_CLEAR]
+ *        ../easyflash/src/flash*.c flash_port_sim.c test_counter.c -o test_counter
+ */
+
+#include "flash_port_sim.h"
+
+#define INC_NUM                        20000
+
+int main(void) {
+    uint32_t before, after;
+    size_t i, erase_count;
+
+    sim_flash_reset();
+    SIM_CHECK(flash_init() == FLASH_NO_ERR);
+    for (i = 0; i < FLASH_COUNTER_NUM; i++) {
+        SIM_CHECK(flash_counter_get(i) == 0);
+    }
+
+    /* the counters are increased over many sector switches and reboots */
+    erase_count = sim_erase_count;
+    for (i = 0; i < INC_NUM; i++) {
+        SIM_CHECK(flash_counter_inc(i % 3) == FLASH_NO_ERR);
+        if (i == 777) {
+            SIM_CHECK(flash_flag_set(3) == FLASH_NO_ERR);
+        }
+        if (i % 997 == 0) {
+            SIM_CHECK(flash_init() == FLASH_NO_ERR);
+        }
+    }
+    printf("%d increases erased %ld sectors.\n", INC_NUM, (long) (sim_erase_count - erase_count));
+    SIM_CHECK(flash_init() == FLASH_NO_ERR);
+    SIM_CHECK(flash_counter_get(0) == (INC_NUM + 2) / 3);
+    SIM_CHECK(flash_counter_get(1) == (INC_NUM + 1) / 3);
+    SIM_CHECK(flash_counter_get(2) == INC_NUM / 3);
+    SIM_CHECK(flash_counter_get(3) == 0);
+    SIM_CHECK(flash_flag_test(3) && !flash_flag_test(2));
+
+    /* only one busy counter, it can use the whole sector in word mode */
+    erase_count = sim_erase_count;
+    for (i = 0; i < 4000; i++) {
+        SIM_CHECK(flash_counter_inc(0) == FLASH_NO_ERR);
+    }
+#ifdef FLASH_COUNTER_USING_BIT_CLEAR
+    SIM_CHECK(sim_erase_count - erase_count <= 4000 / ((SIM_ERASE_MIN_SIZE / 4 - 2 - FLASH_COUNTER_NUM
+            - FLASH_FLAG_NUM) / FLASH_COUNTER_NUM * 32) + 1);
+#else
+    SIM_CHECK(sim_erase_count - erase_count <= 4000 / (SIM_ERASE_MIN_SIZE / 4 - 2 - FLASH_COUNTER_NUM
+            - FLASH_FLAG_NUM) + 1);
+#endif
+
+    /* power loss at any word write, the counter is increased by one or not changed */
+    for (i = 0; i < 3000; i++) {
+        before = flash_counter_get(3);
+        sim_fail_write_after = (i % 7 == 0) ? (int) (i % 5) : -1;
+        flash_counter_inc(3);
+        sim_fail_write_after = -1;
+        SIM_CHECK(flash_init() == FLASH_NO_ERR);
+        after = flash_counter_get(3);
+        SIM_CHECK(after == before || after == before + 1);
+        SIM_CHECK(flash_flag_test(3));
+    }
+    SIM_CHECK(flash_counter_get(0) == (INC_NUM + 2) / 3 + 4000);
+
+    printf("Counter test passed.\n");
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * This file is part of the EasyFlash Library.
+ *
+ * Copyright (c) 2015, Armink, <armink.ztl@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * 'Software'), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED 'AS IS', WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Function: Host test. The crash dump which has torn part.
+ * Created on: 2026-10-19
+ */
+
+/**
+ * Build: gcc -no-pie -I../easyflash/inc -DFLASH_LOG_USING_CRASHDUMP ../easyflash/src/flash*.c
+ *        flash_port_sim.c test_crashdump.c -o test_crashdump
+ */
+
+#include "flash_port_sim.h"
+#include <string.h>
+
+int main(void) {
+    uint32_t regs[16], stack[100], buf[100];
+    size_t index, len, i;
+    uint8_t type;
+
+    for (i = 0; i < 100; i++) {
+        stack[i] = i * 3;
+    }
+    for (i = 0; i < 16; i++) {
+        regs[i] = 0x20000000 + i;
+    }
+    sim_flash_reset();
+    SIM_CHECK(flash_init() == FLASH_NO_ERR);
+    SIM_CHECK(flash_log_crashdump_get_size() == 0);
+
+    /* the first part is torn, the later parts are kept */
+    sim_fail_write_after = 5;
+    SIM_CHECK(flash_log_crashdump_write(1, stack, sizeof(stack)) == FLASH_WRITE_ERR);
+    sim_fail_write_after = -1;
+    SIM_CHECK(flash_log_crashdump_write(2, regs, sizeof(regs)) == FLASH_NO_ERR);
+    SIM_CHECK(flash_log_crashdump_write(3, "last log", 9) == FLASH_NO_ERR);
+
+    SIM_CHECK(flash_init() == FLASH_NO_ERR);
+    SIM_CHECK(flash_log_crashdump_get_size() > 0);
+    index = 0;
+    SIM_CHECK(flash_log_crashdump_read(&index, &type, buf, sizeof(buf), &len) == FLASH_NO_ERR);
+    SIM_CHECK(type == 2 && len == sizeof(regs) && !memcmp(buf, regs, sizeof(regs)));
+    SIM_CHECK(flash_log_crashdump_read(&index, &type, buf, sizeof(buf), &len) == FLASH_NO_ERR);
+    SIM_CHECK(type == 3 && len == 9 && !strcmp((char *) buf, "last log"));
+    SIM_CHECK(flash_log_crashdump_read(&index, &type, buf, sizeof(buf), &len) == FLASH_LOG_NO_RECORD);
+
+    /* the dump isn't overwritten until it's cleaned */
+    SIM_CHECK(flash_log_crashdump_write(4, regs, sizeof(regs)) == FLASH_WRITE_ERR);
+    SIM_CHECK(flash_log_crashdump_clean() == FLASH_NO_ERR);
+    SIM_CHECK(flash_init() == FLASH_NO_ERR);
+    SIM_CHECK(flash_log_crashdump_get_size() == 0);
+
+    /* only a torn part, the area is erased again when initialize */
+    sim_fail_write_after = 0;
+    SIM_CHECK(flash_log_crashdump_write(1, stack, sizeof(stack)) == FLASH_WRITE_ERR);
+    sim_fail_write_after = -1;
+    SIM_CHECK(flash_init() == FLASH_NO_ERR);
+    SIM_CHECK(flash_log_crashdump_get_size() == 0);
+    SIM_CHECK(flash_log_crashdump_write(2, regs, sizeof(regs)) == FLASH_NO_ERR);
+
+    printf("Crash dump test passed.\n");
+
+    return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * This file is part of the EasyFlash Library.
+ *
+ * Copyright (c) 2015, Armink, <armink.ztl@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * 'Software'), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED 'AS IS', WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Function: Host test. The log record wrap, reboot and torn append.
+ * Created on: 2026-10-19
+ */
+
+/**
+ * Build: gcc -no-pie -I../easyflash/inc -DFLASH_LOG_USING_RECORD [-DFLASH_LOG_USING_SECTOR_HEAD]
+ *        [-DFLASH_LOG_USING_ITERATOR] [-DSIM_LOG_SIZE=12288] ../easyflash/src/flash*.c flash_port_sim.c
+ *        test_log.c -o test_log
+ */
+
+#include "flash_port_sim.h"
+#include <string.h>
+
+#define APPEND_NUM                     2000
+
+/**
+ * Check all records after reboot. The records must be continuous and the last one is the newest.
+ *
+ * @param len record data length
+ * @param newest the newest appended record number
+ */
+static void check_records(size_t len, uint32_t newest) {
+    uint32_t data[64], last = 0;
+    size_t index = 0, read_len, num = 0;
+
+    SIM_CHECK(flash_init() == FLASH_NO_ERR);
+    SIM_CHECK(flash_log_get_used_size() > 0);
+    while (flash_log_read_record(&index, data, sizeof(data), &read_len) == FLASH_NO_ERR) {
+        SIM_CHECK(read_len == len);
+        SIM_CHECK(num == 0 || data[0] == last + 1);
+        SIM_CHECK(data[len / 4 - 1] == data[0]);
+        last = data[0];
+        num++;
+    }
+    SIM_CHECK(last == newest);
+    /* the oldest sector is erased when the ring is wrapped, the others are kept */
+    SIM_CHECK(num >= (SIM_LOG_SIZE / SIM_ERASE_MIN_SIZE - 1) * (SIM_ERASE_MIN_SIZE / (len + 20) - 1)
+            || num == newest);
+}
+
+/**
+ * Check the power loss at every word of the first append. The torn record must be dropped or kept
+ * after reboot, and the next record must be appended after it.
+ *
+ * @param len record data length
+ */
+static void check_torn_append(size_t len) {
+    uint32_t data[64];
+    size_t fail, index, read_len, num;
+    bool first_ok;
+
+    for (fail = 0; fail <= len / 4 + 8; fail++) {
+        sim_flash_reset();
+        SIM_CHECK(flash_init() == FLASH_NO_ERR);
+        memset(data, 0, sizeof(data));
+        data[0] = data[len / 4 - 1] = 1;
+        sim_fail_write_after = (int) fail;
+        first_ok = flash_log_append_record(data, len) == FLASH_NO_ERR;
+        sim_fail_write_after = -1;
+        /* reboot after power loss */
+        SIM_CHECK(flash_init() == FLASH_NO_ERR);
+        SIM_CHECK(flash_log_get_used_size() < SIM_LOG_SIZE);
+        data[0] = data[len / 4 - 1] = 2;
+        SIM_CHECK(flash_log_append_record(data, len) == FLASH_NO_ERR);
+        /* reboot again, the appended record must be kept */
+        SIM_CHECK(flash_init() == FLASH_NO_ERR);
+        for (index = 0, num = 0; flash_log_read_record(&index, data, sizeof(data), &read_len) == FLASH_NO_ERR;
+                num++) {
+            SIM_CHECK(read_len == len);
+            SIM_CHECK(data[len / 4 - 1] == data[0]);
+            SIM_CHECK(data[0] == (first_ok ? num + 1 : 2));
+        }
+        SIM_CHECK(num == (first_ok ? 2 : 1));
+    }
+}
+
+int main(void) {
+    const size_t lens[] = { 112, 240, 60 };
+    uint32_t data[64];
+    size_t i, n;
+
+    for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        sim_flash_reset();
+        SIM_CHECK(flash_init() == FLASH_NO_ERR);
+        SIM_CHECK(flash_log_get_used_size() == 0);
+        /* reboot after every append, so every sector end state is checked */
+        for (n = 1; n <= APPEND_NUM; n++) {
+            memset(data, 0, sizeof(data));
+            data[0] = data[lens[i] / 4 - 1] = (uint32_t) n;
+            SIM_CHECK(flash_log_append_record(data, lens[i]) == FLASH_NO_ERR);
+            check_records(lens[i], (uint32_t) n);
+        }
+        printf("%ld bytes records appended, %ld sectors erased.\n", (long) lens[i], (long) sim_erase_count);
+        check_torn_append(lens[i]);
+    }
+
+    printf("Log test passed.\n");
+
+    return 0;
+}
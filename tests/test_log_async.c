@@ -0,0 +1,169 @@
+/*
+ * This file is part of the EasyFlash Library.
+ *
+ * Copyright (c) 2015, Armink, <armink.ztl@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * 'Software'), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED 'AS IS', WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Function: Host test. The asynchronous log is written by multiple preempted producer threads.
+ * Created on: 2026-10-19
+ */
+
+/**
+ * Build: gcc -no-pie -pthread -I../easyflash/inc -DFLASH_LOG_USING_ASYNC -DFLASH_LOG_USING_RECORD
+ *        [-DFLASH_LOG_USING_SECTOR_HEAD] -DSIM_FLASH_SIZE=0x100000 -DSIM_LOG_SIZE=0x80000
+ *        ../easyflash/src/flash*.c flash_port_sim.c test_log_async.c -o test_log_async
+ * The log area can keep all logs, so every log is checked.
+ */
+
+#include "flash_port_sim.h"
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define PRODUCER_NUM                   4
+#define LOG_NUM                        12000
+
+/* the drain worker thread, it's created by port */
+static pthread_t worker_thread;
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_cond = PTHREAD_COND_INITIALIZER;
+/* the worker notified times and the stop flag */
+static size_t worker_notified = 0;
+static bool worker_stop = false;
+
+/**
+ * The drain worker thread. All logs are drained before it stops.
+ *
+ * @param arg unused
+ *
+ * @return NULL
+ */
+static void *worker_entry(void *arg) {
+    bool stop = false;
+
+    (void) arg;
+    while (!stop) {
+        pthread_mutex_lock(&worker_lock);
+        while (!worker_notified && !worker_stop) {
+            pthread_cond_wait(&worker_cond, &worker_lock);
+        }
+        worker_notified = 0;
+        stop = worker_stop;
+        pthread_mutex_unlock(&worker_lock);
+        flash_log_async_worker();
+    }
+
+    return NULL;
+}
+
+FlashErrCode flash_log_async_port_init(void) {
+    SIM_CHECK(pthread_create(&worker_thread, NULL, worker_entry, NULL) == 0);
+
+    return FLASH_NO_ERR;
+}
+
+void flash_log_async_port_notify(void) {
+    pthread_mutex_lock(&worker_lock);
+    worker_notified++;
+    pthread_cond_signal(&worker_cond);
+    pthread_mutex_unlock(&worker_lock);
+}
+
+bool flash_log_async_port_cas(volatile uint32_t *addr, uint32_t expected, uint32_t desired) {
+    return __sync_bool_compare_and_swap(addr, expected, desired);
+}
+
+uint32_t flash_log_async_port_get_tick(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint32_t) (now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+/**
+ * The producer thread. Every log is producer ID and its sequence number, it's written again when
+ * the RAM ring is full, so no log is lost.
+ *
+ * @param arg producer ID
+ *
+ * @return NULL
+ */
+static void *producer_entry(void *arg) {
+    uint32_t log[2] = { (uint32_t) (size_t) arg, 0 };
+    FlashErrCode result;
+
+    for (log[1] = 1; log[1] <= LOG_NUM / PRODUCER_NUM; log[1]++) {
+        while ((result = flash_log_async_write(log, sizeof(log))) == FLASH_LOG_RING_FULL) {
+            sched_yield();
+        }
+        SIM_CHECK(result == FLASH_NO_ERR);
+        /* let the other producers preempt it */
+        if (log[1] % 7 == 0) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+int main(void) {
+    pthread_t producers[PRODUCER_NUM];
+    uint32_t log[2], last[PRODUCER_NUM] = { 0 };
+    size_t i, index = 0, len, num = 0;
+    flash_log_async_stats stats;
+
+    sim_flash_reset();
+    SIM_CHECK(flash_init() == FLASH_NO_ERR);
+    for (i = 0; i < PRODUCER_NUM; i++) {
+        SIM_CHECK(pthread_create(&producers[i], NULL, producer_entry, (void *) i) == 0);
+    }
+    for (i = 0; i < PRODUCER_NUM; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    pthread_mutex_lock(&worker_lock);
+    worker_stop = true;
+    pthread_cond_signal(&worker_cond);
+    pthread_mutex_unlock(&worker_lock);
+    pthread_join(worker_thread, NULL);
+
+    flash_log_async_get_stats(&stats);
+    SIM_CHECK(stats.used_size == 0);
+    SIM_CHECK(stats.flush_errors == 0);
+    SIM_CHECK(stats.high_water <= FLASH_LOG_ASYNC_RING_SIZE);
+    /* all logs are kept, every producer logs are in order and continuous */
+    while (flash_log_read_record(&index, log, sizeof(log), &len) == FLASH_NO_ERR) {
+        SIM_CHECK(len == sizeof(log) && log[0] < PRODUCER_NUM);
+        SIM_CHECK(log[1] == last[log[0]] + 1);
+        last[log[0]] = log[1];
+        num++;
+    }
+    for (i = 0; i < PRODUCER_NUM; i++) {
+        SIM_CHECK(last[i] == LOG_NUM / PRODUCER_NUM);
+    }
+    SIM_CHECK(num == LOG_NUM);
+    printf("%ld logs written, %ld ring full retries, ring high water %ld bytes.\n", (long) num,
+            (long) stats.drops, (long) stats.high_water);
+
+    printf("Log asynchronous test passed.\n");
+
+    return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * This file is part of the EasyFlash Library.
+ *
+ * Copyright (c) 2015, Armink, <armink.ztl@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * 'Software'), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED 'AS IS', WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Function: Host test. The log channels are written by multiple threads at the same time, and the
+ *           log sectors are pre-erased by another thread.
+ * Created on: 2026-10-19
+ */
+
+/**
+ * Build: gcc -no-pie -pthread -I../easyflash/inc -DFLASH_LOG_USING_CHANNEL -DFLASH_LOG_USING_RECORD
+ *        [-DFLASH_LOG_USING_SECTOR_HEAD [-DFLASH_LOG_USING_PRE_ERASE]] -DSIM_LOG_SIZE=0x6000
+ *        ../easyflash/src/flash*.c flash_port_sim.c test_log_channel.c -o test_log_channel
+ */
+
+#include "flash_port_sim.h"
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#define CHANNEL_NUM                    3
+#define RECORD_NUM                     2000
+#define RECORD_LEN                     24
+/* the sectors which keep the records in every channel, the oldest sector is erased when wrapped */
+#ifdef FLASH_LOG_USING_PRE_ERASE
+#define KEEP_SEC_NUM(sec_num)          ((sec_num) - 1 - FLASH_LOG_PRE_ERASE_SEC_NUM)
+#else
+#define KEEP_SEC_NUM(sec_num)          ((sec_num) - 1)
+#endif
+
+/* every channel has 4 sectors and the minimum level is 2 */
+static const flash_log_channel log_channel_set[CHANNEL_NUM] = {
+    { "boot", 4, 2 },
+    { "fault", 4, 2 },
+    { "debug", 4, 2 },
+};
+
+#ifdef FLASH_LOG_USING_PRE_ERASE
+/* the writer threads are running */
+static volatile bool writing = true;
+#endif
+
+void flash_log_port_get_channels(flash_log_channel const **channels, size_t *channel_num) {
+    *channels = log_channel_set;
+    *channel_num = CHANNEL_NUM;
+}
+
+/**
+ * The channel writer thread. Every record is channel index and its sequence number.
+ * The record whose level is less than the channel minimum level is written too, it must be dropped.
+ *
+ * @param arg channel index
+ *
+ * @return NULL
+ */
+static void *writer_entry(void *arg) {
+    uint32_t data[RECORD_LEN / 4];
+    size_t channel = (size_t) arg;
+
+    memset(data, 0, sizeof(data));
+    data[0] = (uint32_t) channel;
+    for (data[1] = 1; data[1] <= RECORD_NUM; data[1]++) {
+        data[RECORD_LEN / 4 - 1] = data[1];
+        SIM_CHECK(flash_log_channel_write(channel, 2, data, RECORD_LEN) == FLASH_NO_ERR);
+        SIM_CHECK(flash_log_channel_write(channel, 1, data, RECORD_LEN) == FLASH_NO_ERR);
+        if (data[1] % 5 == 0) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+#ifdef FLASH_LOG_USING_PRE_ERASE
+/**
+ * The background pre-erase thread, it erases the sectors until all writers are finished.
+ *
+ * @param arg unused
+ *
+ * @return NULL
+ */
+static void *pre_erase_entry(void *arg) {
+    (void) arg;
+    while (writing) {
+        SIM_CHECK(flash_log_pre_erase() == FLASH_NO_ERR);
+        sched_yield();
+    }
+
+    return NULL;
+}
+#endif
+
+/**
+ * Check the records of channel. The records must be written by its writer, continuous and the
+ * last one is the newest.
+ *
+ * @param channel channel index
+ */
+static void check_channel(size_t channel) {
+    uint32_t data[RECORD_LEN / 4], last = 0;
+    size_t index = 0, len, num = 0;
+
+    flash_log_channel_select(channel);
+    while (flash_log_read_record(&index, data, sizeof(data), &len) == FLASH_NO_ERR) {
+        SIM_CHECK(len == RECORD_LEN);
+        SIM_CHECK(data[0] == channel);
+        SIM_CHECK(num == 0 || data[1] == last + 1);
+        SIM_CHECK(data[RECORD_LEN / 4 - 1] == data[1]);
+        last = data[1];
+        num++;
+    }
+    SIM_CHECK(last == RECORD_NUM);
+    SIM_CHECK(num >= KEEP_SEC_NUM(log_channel_set[channel].sec_num)
+            * (SIM_ERASE_MIN_SIZE / (RECORD_LEN + 20) - 1));
+    printf("%s channel keeps %ld records.\n", log_channel_set[channel].name, (long) num);
+}
+
+int main(void) {
+    pthread_t writers[CHANNEL_NUM];
+#ifdef FLASH_LOG_USING_PRE_ERASE
+    pthread_t pre_eraser;
+#endif
+    size_t i;
+
+    sim_flash_reset();
+    SIM_CHECK(flash_init() == FLASH_NO_ERR);
+#ifdef FLASH_LOG_USING_PRE_ERASE
+    SIM_CHECK(pthread_create(&pre_eraser, NULL, pre_erase_entry, NULL) == 0);
+#endif
+    for (i = 0; i < CHANNEL_NUM; i++) {
+        SIM_CHECK(pthread_create(&writers[i], NULL, writer_entry, (void *) i) == 0);
+    }
+    for (i = 0; i < CHANNEL_NUM; i++) {
+        pthread_join(writers[i], NULL);
+    }
+#ifdef FLASH_LOG_USING_PRE_ERASE
+    writing = false;
+    pthread_join(pre_eraser, NULL);
+#endif
+    for (i = 0; i < CHANNEL_NUM; i++) {
+        check_channel(i);
+    }
+    /* reboot, the channels are found again */
+    SIM_CHECK(flash_init() == FLASH_NO_ERR);
+    for (i = 0; i < CHANNEL_NUM; i++) {
+        check_channel(i);
+    }
+
+    printf("Log channel test passed.\n");
+
+    return 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * This file is part of the EasyFlash Library.
+ *
+ * Copyright (c) 2015, Armink, <armink.ztl@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * 'Software'), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED 'AS IS', WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Function: Host test. The slotted mode ENV rollover, reboot and power loss.
+ * Created on: 2026-10-19
+ */
+
+
+/**
+ * Build: gcc -no-pie -I../easyflash/inc -DFLASH_ENV_USING_SLOTTED_MODE [-DSIM_ERASE_MIN_SIZE=8192]
+ *        ../easyflash/src/flash*.c flash_port_sim.c test_slotted.c -o test_slotted
+ */
+
+#include "flash_port_sim.h"
+#include <string.h>
+
+#define SAVE_NUM                       500
+
+int main(void) {
+    char value[16], old_value[16];
+    size_t i, erase_count, slot_num = SIM_ERASE_MIN_SIZE / FLASH_USER_SETTING_ENV_SIZE;
+
+    sim_flash_reset();
+    SIM_CHECK(flash_init() == FLASH_NO_ERR);
+    SIM_CHECK(!strcmp(flash_get_env("device_id"), "1"));
+
+    /* the saves are rolled over all sectors many times, every sector is erased when its slots are used */
+    erase_count = sim_erase_count;
+    for (i = 0; i < SAVE_NUM; i++) {
+        sprintf(value, "%ld", (long) i);
+        SIM_CHECK(flash_set_env("boot_times", value) == FLASH_NO_ERR);
+        SIM_CHECK(flash_save_env() == FLASH_NO_ERR);
+        if (i % 7 == 0) {
+            SIM_CHECK(flash_init() == FLASH_NO_ERR);
+            SIM_CHECK(!strcmp(flash_get_env("boot_times"), value));
+        }
+    }
+    printf("%d saves erased %ld sectors.\n", SAVE_NUM, (long) (sim_erase_count - erase_count));
+    SIM_CHECK(sim_erase_count - erase_count <= SAVE_NUM / slot_num + 1);
+    SIM_CHECK(flash_init() == FLASH_NO_ERR);
+    sprintf(value, "%d", SAVE_NUM - 1);
+    SIM_CHECK(!strcmp(flash_get_env("boot_times"), value));
+    SIM_CHECK(!strcmp(flash_get_env("device_id"), "1"));
+
+    /* power loss at any word of the save, the new or the last saved ENV is loaded */
+    for (i = 0; i < 200; i++) {
+        strcpy(old_value, flash_get_env("boot_times"));
+        sprintf(value, "t%ld", (long) i);
+        SIM_CHECK(flash_set_env("boot_times", value) == FLASH_NO_ERR);
+        sim_fail_write_after = (int) i;
+        flash_save_env();
+        sim_fail_write_after = -1;
+        SIM_CHECK(flash_init() == FLASH_NO_ERR);
+        SIM_CHECK(!strcmp(flash_get_env("boot_times"), value)
+                || !strcmp(flash_get_env("boot_times"), old_value));
+        SIM_CHECK(!strcmp(flash_get_env("device_id"), "1"));
+    }
+
+    printf("Slotted test passed.\n");
+
+    return 0;
+}
@@ -0,0 +1,310 @@
+/*
+ * This file is part of the EasyFlash Library.
+ *
+ * Copyright (c) 2015, Armink, <armink.ztl@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * 'Software'), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED 'AS IS', WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Function: Host tool. Generate the default ENV image from default_env_set in flash_port.c.
+ * Created on: 2026-10-19
+ */
+
+/**
+ * Build: gcc env_image.c -o env_image
+ * Usage: env_image <flash_port.c> <flash_env_image.c>
+ *
+ * The generated file must be added to the project and FLASH_ENV_USING_DEFAULT_IMAGE must be
+ * defined. Please generate it again after default_env_set has been changed.
+ * The image is the ENV data section of normal mode, the target must be little endian.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* the maximum size of port source file */
+#define SRC_SIZE_MAX                   (256 * 1024)
+/* the maximum size of ENV image */
+#define IMAGE_SIZE_MAX                 (64 * 1024)
+/* the ENV CRC32 code and head bytes size */
+#define ENV_HEAD_BYTE_SIZE             8
+/* the ENV name maximum length */
+#define ENV_KEY_LEN_MAX                0xFF
+/* the ENV value maximum length */
+#define ENV_VALUE_LEN_MAX              0xFFFF
+/* the ENV flags, it's same as flash_env.c */
+#define ENV_FLAG_WRITE_THROUGH         0x02
+
+static char src[SRC_SIZE_MAX];
+static uint8_t image[IMAGE_SIZE_MAX];
+static size_t image_size = 0;
+
+/**
+ * Calculate the CRC32 code. It's same as calc_crc32 in flash_utils.c.
+ */
+static uint32_t calc_crc32(uint32_t crc, const void *buf, size_t size) {
+    const uint8_t *p = buf;
+    int i;
+
+    crc = crc ^ ~0U;
+    while (size--) {
+        crc ^= *p++;
+        for (i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+
+    return crc ^ ~0U;
+}
+
+/**
+ * Skip the space and comment.
+ *
+ * @return the next valid char
+ */
+static const char *skip_space(const char *p) {
+    while (*p) {
+        if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+            p++;
+        } else if (p[0] == '/' && p[1] == '*') {
+            const char *end = strstr(p + 2, "*/");
+            p = end ? end + 2 : p + strlen(p);
+        } else if (p[0] == '/' && p[1] == '/') {
+            p += strcspn(p, "\n");
+        } else {
+            break;
+        }
+    }
+
+    return p;
+}
+
+/**
+ * Parse the C string literal. The adjacent literals will be joined.
+ *
+ * @param p the start of literal
+ * @param str the parsed string
+ * @param size string buffer size
+ *
+ * @return the next char after literal, NULL when parse failed
+ */
+static const char *parse_string(const char *p, char *str, size_t size) {
+    size_t len = 0;
+
+    if (*p != '"') {
+        return NULL;
+    }
+    while (*p == '"') {
+        for (p++; *p != '"'; p++) {
+            char c = *p;
+            if (c == '\0' || c == '\n' || len + 1 >= size) {
+                return NULL;
+            }
+            if (c == '\\') {
+                p++;
+                switch (*p) {
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case '\\': c = '\\'; break;
+                case '"': c = '"'; break;
+                case '\'': c = '\''; break;
+                default: return NULL;
+                }
+            }
+            str[len++] = c;
+        }
+        p = skip_space(p + 1);
+    }
+    str[len] = '\0';
+
+    return p;
+}
+
+/**
+ * Put a word to image by little endian.
+ */
+static void put_word(uint8_t *buf, uint32_t word) {
+    buf[0] = (uint8_t) (word >> 0);
+    buf[1] = (uint8_t) (word >> 8);
+    buf[2] = (uint8_t) (word >> 16);
+    buf[3] = (uint8_t) (word >> 24);
+}
+
+/**
+ * Append an ENV to image. The storage format is same as flash_env.c.
+ * CRC32 code(1 word) + head(1 word) + key\0value\0 + word alignment part
+ *
+ * @return 0: success
+ */
+static int append_env(const char *key, const char *value, uint8_t flags) {
+    size_t key_len = strlen(key), value_len = strlen(value), env_len;
+    uint8_t *env = image + image_size;
+
+    env_len = ENV_HEAD_BYTE_SIZE + (key_len + value_len + 2 + 3) / 4 * 4;
+    if (value_len > ENV_VALUE_LEN_MAX || image_size + env_len > IMAGE_SIZE_MAX) {
+        return -1;
+    }
+    memset(env, 0, env_len);
+    /* key length(bit0-7), flags(bit8-15), value length(bit16-31) */
+    put_word(env + 4, (uint32_t) key_len | ((uint32_t) flags << 8) | ((uint32_t) value_len << 16));
+    memcpy(env + ENV_HEAD_BYTE_SIZE, key, key_len);
+    memcpy(env + ENV_HEAD_BYTE_SIZE + key_len + 1, value, value_len);
+    put_word(env, calc_crc32(0, env + 4, env_len - 4));
+    image_size += env_len;
+
+    return 0;
+}
+
+/**
+ * Parse all ENV in default_env_set initializer, such as: { {"key", "value"}, ... };
+ * The key class is optional, such as: {"key", "value", FLASH_ENV_VOLATILE}. The volatile ENV
+ * isn't in image.
+ *
+ * @return 0: success
+ */
+static int parse_default_env_set(void) {
+    const char *p = strstr(src, "default_env_set[]");
+    static char key[1024], value[1024];
+    size_t i, class_len;
+    uint8_t flags;
+    int is_volatile;
+
+    if (!p || !(p = strchr(p, '='))) {
+        fprintf(stderr, "Error: Not find default_env_set initializer.\n");
+        return -1;
+    }
+    p = skip_space(p + 1);
+    if (*p++ != '{') {
+        goto __syntax_err;
+    }
+    for (p = skip_space(p); *p == '{'; p = skip_space(p)) {
+        p = parse_string(skip_space(p + 1), key, sizeof(key));
+        if (!p || *p++ != ',') {
+            goto __syntax_err;
+        }
+        p = parse_string(skip_space(p), value, sizeof(value));
+        if (!p) {
+            goto __syntax_err;
+        }
+        /* the optional key class */
+        flags = 0;
+        is_volatile = 0;
+        if (*p == ',') {
+            p = skip_space(p + 1);
+            class_len = strspn(p, "ABCDEFGHIJKLMNOPQRSTUVWXYZ_");
+            if (class_len == strlen("FLASH_ENV_VOLATILE") && !strncmp(p, "FLASH_ENV_VOLATILE", class_len)) {
+                is_volatile = 1;
+            } else if (class_len == strlen("FLASH_ENV_WRITE_THROUGH")
+                    && !strncmp(p, "FLASH_ENV_WRITE_THROUGH", class_len)) {
+                flags = ENV_FLAG_WRITE_THROUGH;
+            } else if (class_len != strlen("FLASH_ENV_WRITE_BACK")
+                    || strncmp(p, "FLASH_ENV_WRITE_BACK", class_len)) {
+                goto __syntax_err;
+            }
+            p = skip_space(p + class_len);
+        }
+        if (*p++ != '}') {
+            goto __syntax_err;
+        }
+        if (key[0] == '\0' || strchr(key, '=') || strlen(key) > ENV_KEY_LEN_MAX) {
+            fprintf(stderr, "Error: ENV name \"%s\" is invalid.\n", key);
+            return -1;
+        }
+        /* the default ENV name must be unique */
+        for (i = 0; i < image_size; ) {
+            char *env_key = (char *) image + i + ENV_HEAD_BYTE_SIZE;
+            size_t key_len = strlen(env_key), value_len = strlen(env_key + key_len + 1);
+            if (!strcmp(env_key, key)) {
+                fprintf(stderr, "Error: ENV name \"%s\" is already exist.\n", key);
+                return -1;
+            }
+            i += ENV_HEAD_BYTE_SIZE + (key_len + value_len + 2 + 3) / 4 * 4;
+        }
+        /* the volatile ENV is set by flash_env.c when initialize */
+        if (is_volatile) {
+            goto __next;
+        }
+        if (append_env(key, value, flags)) {
+            fprintf(stderr, "Error: ENV image is too large.\n");
+            return -1;
+        }
+__next:
+        p = skip_space(p);
+        if (*p == ',') {
+            p++;
+        }
+    }
+    if (*p == '}') {
+        return 0;
+    }
+
+__syntax_err:
+    fprintf(stderr, "Error: default_env_set must only contain string literals and key class.\n");
+    return -1;
+}
+
+int main(int argc, char *argv[]) {
+    FILE *fp;
+    size_t i, src_size;
+
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <flash_port.c> <flash_env_image.c>\n", argv[0]);
+        return 1;
+    }
+
+    if (!(fp = fopen(argv[1], "rb"))) {
+        fprintf(stderr, "Error: Open %s failed.\n", argv[1]);
+        return 1;
+    }
+    src_size = fread(src, 1, SRC_SIZE_MAX - 1, fp);
+    src[src_size] = '\0';
+    fclose(fp);
+
+    if (parse_default_env_set()) {
+        return 1;
+    }
+
+    if (!(fp = fopen(argv[2], "w"))) {
+        fprintf(stderr, "Error: Open %s failed.\n", argv[2]);
+        return 1;
+    }
+    fprintf(fp, "/* This file is generated by EasyFlash env_image tool from %s. Don't edit it. */\n\n", argv[1]);
+    fprintf(fp, "#include \"flash.h\"\n\n");
+    fprintf(fp, "#if defined(FLASH_USING_ENV) && defined(FLASH_ENV_USING_DEFAULT_IMAGE)\n\n");
+    fprintf(fp, "const uint32_t flash_default_env_image[] = {");
+    for (i = 0; i < image_size; i += 4) {
+        fprintf(fp, "%s0x%02X%02X%02X%02X,", i % 24 == 0 ? "\n    " : " ", image[i + 3], image[i + 2],
+                image[i + 1], image[i]);
+    }
+    /* an empty array is not allowed */
+    if (image_size == 0) {
+        fprintf(fp, "\n    0x00000000,");
+    }
+    fprintf(fp, "\n};\n\n");
+    fprintf(fp, "const size_t flash_default_env_image_size = %lu;\n\n", (unsigned long) image_size);
+    fprintf(fp, "#endif\n");
+    fclose(fp);
+
+    printf("Generate %s OK. The default ENV image size is %lu bytes.\n", argv[2], (unsigned long) image_size);
+
+    return 0;
+}